@@ -1,13 +1,20 @@
+#include <algorithm>
 #include <cstring>
+#include <limits>
 #include <map>
 #include <string>
 #include <iostream>
 
 #include "lib/utils/convert.hpp"
 #include "lib/driver/basic-driver.hpp"
+#include "lib/driver/posix-driver.hpp"
+#include "lib/driver/mmap-driver.hpp"
+#include "lib/driver/uring-driver.hpp"
 #include "lib/driver/bitmap-allocator.hpp"
 #include "lib/driver/cached-accesser.hpp"
 #include "lib/driver/basic-accesser.hpp"
+#include "lib/driver/mmap-accesser.hpp"
+#include "lib/driver/write-ahead-log.hpp"
 #include "database.hpp"
 
 using namespace cdb;
@@ -17,18 +24,101 @@ struct Database::DBHeader
     char magic[8];
     BlockIndex root_index;
     Length root_count;
+    Length page_size;   /** 0 for databases created before page size is configurable */
 };
 
 const char Database::MAGIC[8] = "--CDB--";
 
+/**
+ * Number of pages fitting in a cache of the given bytes, clamped to what the cache can index
+ */
+static inline Length
+cacheCapacity(std::uint64_t size, Length page_size)
+{
+    return static_cast<Length>(std::min<std::uint64_t>(
+        size / page_size, std::numeric_limits<Length>::max()));
+}
+
 Database *
 Database::Factory(std::string path)
+{ return Factory(path, Options()); }
+
+Database *
+Database::Factory(std::string path, const Options &options)
 {
     std::unique_ptr<Database> db(new Database());
 
-    db->_driver.reset(new BasicDriver(path.c_str()));
+    switch (options.driver) {
+        case DriverType::BASIC:
+            db->_driver.reset(new BasicDriver(path.c_str()));
+            break;
+        case DriverType::POSIX:
+            db->_driver.reset(new PosixDriver(path.c_str(), options.direct_io));
+            break;
+        case DriverType::MMAP:
+            db->_driver.reset(new MmapDriver(path.c_str()));
+            break;
+        case DriverType::URING:
+            db->_driver.reset(new UringDriver(path.c_str()));
+            break;
+    }
+
+    if (options.write_ahead_log && options.driver != DriverType::MMAP) {
+        // replays committed pages into the file before its header is read
+        db->_driver.reset(new WriteAheadLog(db->_driver.release(), (path + "-wal").c_str()));
+    }
+
+    // the header always fits in the smallest block, read it to find the page size
+    Length page_size = options.page_size;
+    bool existing = false;
+    {
+        Buffer header_buffer(Driver::BLOCK_SIZE);
+        db->_driver->readBlock(0, header_buffer);
+
+        auto header = reinterpret_cast<const DBHeader*>(header_buffer.content());
+        if (!std::strcmp(MAGIC, reinterpret_cast<const char*>(header->magic))) {
+            page_size = header->page_size ? header->page_size : Driver::BLOCK_SIZE;
+            existing = true;
+        }
+    }
+
+    if (page_size < Driver::BLOCK_SIZE || page_size > Driver::MAX_BLOCK_SIZE ||
+            (page_size & (page_size - 1))) {
+        throw DatabaseInvalidPageSizeException(page_size);
+    }
+
+    // smaller pages would make every write a read-modify-write of a whole aligned page
+    if (options.driver == DriverType::POSIX && options.direct_io &&
+            page_size < PosixDriver::DIRECT_IO_ALIGNMENT) {
+        if (existing) {
+            throw DatabaseDirectIOPageSizeException(page_size);
+        }
+        page_size = PosixDriver::DIRECT_IO_ALIGNMENT;
+    }
+    db->_driver->setBlockSize(page_size);
     db->_allocator.reset(new BitmapAllocator(db->_driver.get(), 1));
-    db->_accesser.reset(new CachedAccesser(db->_driver.get(), db->_allocator.get()));
+
+    if (options.driver == DriverType::MMAP) {
+        // the mapping is the cache, blocks are accessed in place
+        db->_accesser.reset(new MmapAccesser(
+                    static_cast<MmapDriver*>(db->_driver.get()),
+                    db->_allocator.get()
+                ));
+    }
+    else {
+        ReplacementPolicy *policy = nullptr;
+        if (options.cache_policy == CachePolicy::TWO_QUEUE) {
+            policy = new TwoQueueReplacementPolicy();
+        }
+
+        auto *accesser = new CachedAccesser(db->_driver.get(), db->_allocator.get(), policy);
+        db->_accesser.reset(accesser);
+        accesser->setCapacity(cacheCapacity(options.cache_size, page_size));
+        accesser->setReadahead(options.readahead);
+        if (options.background_flush) {
+            accesser->startFlusher();
+        }
+    }
 
     db->open();
 
@@ -121,6 +211,7 @@ Database::init()
             std::begin(header->magic)
         );
     header->root_index = _accesser->allocateBlock();
+    header->page_size = _accesser->blockSize();
 
     _root_table.reset(
             Table::Factory(
@@ -297,6 +388,52 @@ Database::updateRootTable()
     header->root_count = _root_table->getCount();
 }
 
+void
+Database::setCacheSize(std::uint64_t size)
+{
+    auto *accesser = dynamic_cast<CachedAccesser*>(_accesser.get());
+    if (accesser) {
+        accesser->setCapacity(cacheCapacity(size, _accesser->blockSize()));
+    }
+}
+
+void
+Database::commit()
+{
+    updateRootTable();
+    _accesser->flush();
+    _allocator->flush();
+    commitLog();
+}
+
+void
+Database::commitLog()
+{
+    auto *log = dynamic_cast<WriteAheadLog*>(_driver.get());
+    if (log) {
+        log->commit();
+    }
+}
+
+void
+Database::compact()
+{
+    for (auto &table : _tables) {
+        table->compact();
+    }
+
+    // the catalog is rebuilt in free blocks left at the front
+    updateRootTable();
+
+    _accesser->flush();
+    Length block_count = _allocator->trim();
+    _allocator->flush();
+    commitLog();
+    if (block_count) {
+        _driver->truncateBlocks(block_count);
+    }
+}
+
 Database *
 cdb::getGlobalDatabase()
 {
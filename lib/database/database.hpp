@@ -1,11 +1,13 @@
 #ifndef _DB_DATABASE_DATABASE_H_
 #define _DB_DATABASE_DATABASE_H_
 
+#include <cstdint>
 #include <exception>
 #include <list>
 #include "lib/driver/driver.hpp"
 #include "lib/driver/block-allocator.hpp"
 #include "lib/driver/driver-accesser.hpp"
+#include "lib/driver/cached-accesser.hpp"
 #include "lib/table/table.hpp"
 
 namespace cdb {
@@ -15,6 +17,30 @@ namespace cdb {
         { return "Database is invalid."; }
     };
 
+    struct DatabaseInvalidPageSizeException : public std::exception
+    {
+        Length page_size;
+
+        DatabaseInvalidPageSizeException(Length page_size)
+            : page_size(page_size)
+        { }
+
+        const char *what() const noexcept
+        { return "Page size must be a power of 2 between 1K and 64K."; }
+    };
+
+    struct DatabaseDirectIOPageSizeException : public std::exception
+    {
+        Length page_size;
+
+        DatabaseDirectIOPageSizeException(Length page_size)
+            : page_size(page_size)
+        { }
+
+        const char *what() const noexcept
+        { return "Pages smaller than 4K can not be accessed with direct I/O."; }
+    };
+
     struct DatabaseTableNotFoundException : public std::exception
     {
         std::string name;
@@ -40,6 +66,85 @@ namespace cdb {
 
     class Database
     {
+    public:
+        /**
+         * Kind of driver used to access the database file
+         */
+        enum class DriverType
+        {
+            BASIC,      /** stdio based, @see BasicDriver */
+            POSIX,      /** positional I/O on a file descriptor, @see PosixDriver */
+            MMAP,       /** memory mapped file without extra cache, @see MmapDriver */
+            URING       /** asynchronous I/O through io_uring, @see UringDriver */
+        };
+
+        /**
+         * Replacement policy of the block cache
+         */
+        enum class CachePolicy
+        {
+            LRU,        /** least recently used, @see LRUReplacementPolicy */
+            TWO_QUEUE   /** scan resistant 2Q, @see TwoQueueReplacementPolicy */
+        };
+
+        /**
+         * Options used when opening a database with Factory
+         */
+        struct Options
+        {
+            DriverType driver = DriverType::BASIC;
+
+            /**
+             * bypass the page cache of the OS, so the cache of the accesser is the only
+             * copy of data in memory. Only honored by DriverType::POSIX.
+             *
+             * Pages must be at least PosixDriver::DIRECT_IO_ALIGNMENT, otherwise every
+             * read goes through a bounce buffer and every write is a read-modify-write.
+             * The page size of a new database is raised to it, an existing database of
+             * smaller pages is rejected with DatabaseDirectIOPageSizeException.
+             */
+            bool direct_io = false;
+
+            /**
+             * size of each page, a power of 2 between Driver::BLOCK_SIZE and
+             * Driver::MAX_BLOCK_SIZE. Only used when creating a new database, an
+             * existing database always uses the page size it was created with.
+             */
+            Length page_size = Driver::BLOCK_SIZE;
+
+            /**
+             * number of blocks read at once when cache misses are sequential, 0 to
+             * disable. Not used by DriverType::MMAP.
+             */
+            Length readahead = 0;
+
+            /**
+             * how the block cache chooses blocks to evict. Not used by DriverType::MMAP.
+             */
+            CachePolicy cache_policy = CachePolicy::LRU;
+
+            /**
+             * memory used by the block cache in bytes, at least one page is cached.
+             * Not used by DriverType::MMAP.
+             */
+            std::uint64_t cache_size = CachedAccesser::CACHE_SIZE;
+
+            /**
+             * write dirty pages of the block cache in a background thread.
+             * Not used by DriverType::MMAP. @see CachedAccesser::startFlusher
+             */
+            bool background_flush = false;
+
+            /**
+             * log written pages ahead of the database file to "<path>-wal", so they
+             * are durable once committed and replayed when opened after a crash. Only
+             * commit() commits, changes after the last commit are discarded when closed.
+             * Not used by DriverType::MMAP. @see WriteAheadLog
+             */
+            bool write_ahead_log = false;
+        };
+
+    private:
         std::unique_ptr<Driver> _driver;
         std::unique_ptr<BlockAllocator> _allocator;
         std::unique_ptr<DriverAccesser> _accesser;
@@ -55,6 +160,9 @@ namespace cdb {
 
         void open();
         void close();
+
+        /** Commit pages written to the log, if opened with Options::write_ahead_log */
+        void commitLog();
     public:
         static const char MAGIC[8];
 
@@ -74,7 +182,28 @@ namespace cdb {
         std::string indexFor(std::string name);
         void updateRootTable();
 
+        /**
+         * Resize the block cache at runtime, no effect with DriverType::MMAP
+         *
+         * @param size memory used by the cache in bytes
+         */
+        void setCacheSize(std::uint64_t size);
+
+        /**
+         * Write all modified pages and make them durable. If opened with
+         * Options::write_ahead_log, they are committed at once after all are logged.
+         */
+        void commit();
+
+        /**
+         * Move pages of all tables and indices towards the beginning of the file, rebuild
+         * the catalog with the new roots, then truncate the free tail of the file and
+         * commit. No other operation should be running meanwhile.
+         */
+        void compact();
+
         static Database *Factory(std::string path);
+        static Database *Factory(std::string path, const Options &options);
     };
 
     Database *getGlobalDatabase();
@@ -12,9 +12,9 @@ BasicAccesser::~BasicAccesser()
 { flush(); }
 
 Slice
-BasicAccesser::access(BlockIndex index)
+BasicAccesser::access(BlockIndex index, Latch::Mode)
 {
-    auto result = _buffers.emplace(index, BufferWithCount{1, Buffer(Driver::BLOCK_SIZE)});
+    auto result = _buffers.emplace(index, BufferWithCount{1, Buffer(blockSize())});
     if (result.second) {
         _drv->readBlock(index, result.first->second.buffer);
     }
@@ -25,7 +25,7 @@ BasicAccesser::access(BlockIndex index)
 }
 
 void
-BasicAccesser::release(BlockIndex index, bool)
+BasicAccesser::release(BlockIndex index, bool, Latch::Mode)
 {
     auto iter = _buffers.find(index);
     if (iter != _buffers.end()) {
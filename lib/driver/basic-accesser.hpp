@@ -17,8 +17,8 @@ namespace cdb {
 
         std::map<BlockIndex, BufferWithCount> _buffers;
 
-        virtual Slice access(BlockIndex index);
-        virtual void release(BlockIndex index, bool);
+        virtual Slice access(BlockIndex index, Latch::Mode);
+        virtual void release(BlockIndex index, bool, Latch::Mode);
     public:
         BasicAccesser(Driver *drv, BlockAllocator *allocator);
 
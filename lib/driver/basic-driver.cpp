@@ -1,5 +1,8 @@
 #include <cassert>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "basic-driver.hpp"
 
 using namespace cdb;
@@ -24,27 +27,84 @@ BasicDriver::~BasicDriver()
 void
 BasicDriver::readBlocks(BlockIndex index, Length count, Slice dest)
 {
-    assert(dest.length() >= BLOCK_SIZE * count);
+    assert(dest.length() >= _block_size * count);
+    std::lock_guard<std::mutex> lock(_mutex);
 
-    std::fseek(_fd, index * BLOCK_SIZE, SEEK_SET);
+    std::fseek(_fd, static_cast<long>(index) * _block_size, SEEK_SET);
 
-    auto ret = std::fread(dest.content(), BLOCK_SIZE, count, _fd);
+    auto ret = std::fread(dest.content(), _block_size, count, _fd);
     if (ret != count) {
-        std::fill(dest.begin() + ret * BLOCK_SIZE, dest.begin() + count * BLOCK_SIZE, 0);
+        std::fill(dest.begin() + ret * _block_size, dest.begin() + count * _block_size, 0);
     }
 }
 
 void
 BasicDriver::writeBlocks(BlockIndex index, Length count, ConstSlice src)
 {
-    assert(src.length() >= BLOCK_SIZE * count);
+    assert(src.length() >= _block_size * count);
+    std::lock_guard<std::mutex> lock(_mutex);
 
-    std::fseek(_fd, index * BLOCK_SIZE, SEEK_SET);
+    std::fseek(_fd, static_cast<long>(index) * _block_size, SEEK_SET);
 
-    auto ret =  std::fwrite(src.content(), BLOCK_SIZE, count, _fd);
+    auto ret =  std::fwrite(src.content(), _block_size, count, _fd);
     assert(ret == count);
 }
 
+void
+BasicDriver::readBlocksScattered(BlockIndex index, Length count, Slice *dests)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::fseek(_fd, static_cast<long>(index) * _block_size, SEEK_SET);
+
+    Length i = 0;
+    for (; i < count; ++i) {
+        assert(dests[i].length() >= _block_size);
+
+        if (std::fread(dests[i].content(), _block_size, 1, _fd) != 1) {
+            break;
+        }
+    }
+
+    // reading beyond the end of file
+    for (; i < count; ++i) {
+        std::fill(dests[i].begin(), dests[i].begin() + _block_size, 0);
+    }
+}
+
+void
+BasicDriver::writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::fseek(_fd, static_cast<long>(index) * _block_size, SEEK_SET);
+
+    for (Length i = 0; i < count; ++i) {
+        assert(srcs[i].length() >= _block_size);
+
+        auto ret = std::fwrite(srcs[i].content(), _block_size, 1, _fd);
+        assert(ret == 1);
+    }
+}
+
 void
 BasicDriver::flush()
-{ std::fflush(_fd); }
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (std::fflush(_fd) != 0 || ::fsync(::fileno(_fd)) != 0) {
+        throw BasicDriverIOException();
+    }
+}
+
+void
+BasicDriver::truncateBlocks(Length count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::fflush(_fd);
+
+    struct stat st;
+    int fd = ::fileno(_fd);
+    off_t size = static_cast<off_t>(count) * _block_size;
+    if (::fstat(fd, &st) == 0 && st.st_size > size) {
+        auto ret = ::ftruncate(fd, size);
+        assert(ret == 0);
+    }
+}
@@ -2,10 +2,18 @@
 #define _DB_DRIVER_BASIC_DRIVER_H_
 
 #include <cstdio>
+#include <exception>
+#include <mutex>
 
 #include "driver.hpp"
 
 namespace cdb {
+    struct BasicDriverIOException : public std::exception
+    {
+        const char *what() const noexcept
+        { return "I/O error in BasicDriver"; }
+    };
+
     /**
      * Basic single file driver, read or write blocks directly.
      */
@@ -14,6 +22,9 @@ namespace cdb {
         /** internal file descriptor */
         FILE* _fd;
 
+        /** the file position is shared, so seeking and reading must not interleave */
+        std::mutex _mutex;
+
         // not copiable
         BasicDriver(const BasicDriver &) = delete;
         BasicDriver &operator = (const BasicDriver &) = delete;
@@ -79,8 +90,30 @@ namespace cdb {
          */
         virtual void writeBlocks(BlockIndex index, Length count, ConstSlice src);
 
-        /** Flush all data to disk. */
+        /** Flush the stdio buffer and sync the file to disk, throws BasicDriverIOException on failure. */
         virtual void flush();
+
+        /** Flush, then shrink the file with ftruncate, never extends it. */
+        virtual void truncateBlocks(Length count);
+
+    protected:
+        /**
+         * Read a run of contiguous blocks into separate pieces of memory, seeking only once.
+         *
+         * @param index index of first block
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         */
+        virtual void readBlocksScattered(BlockIndex index, Length count, Slice *dests);
+
+        /**
+         * Write a run of contiguous blocks from separate pieces of memory, seeking only once.
+         *
+         * @param index index of first block
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         */
+        virtual void writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs);
     };
 }
 
@@ -1,4 +1,10 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+
+#if defined __AVX512F__ || defined __AVX2__
+    #include <immintrin.h>
+#endif
 
 #include "bitmap-allocator.hpp"
 
@@ -9,14 +15,19 @@ using cdb::BlockIndex;
 
 #if defined __GNUC__
     #define cdb_count_leading_zero_32(x) (x ? __builtin_clz(x) : 32)
+    #define cdb_count_trailing_zero_32(x) (x ? __builtin_ctz(x) : 32)
 #elif defined __clang__
     #define cdb_count_leading_zero_32(x) (x ? __builtin_clz(x) : 32)
+    #define cdb_count_trailing_zero_32(x) (x ? __builtin_ctz(x) : 32)
 #elif defined _MSC_VER
     #include <intrin.h>
     #pragma intrinsic(_BitScanReverse)
+    #pragma intrinsic(_BitScanForward)
 
     #define cdb_count_leading_zero_32(x) \
         __count_leading_zero_32_helper(static_cast<std::uint32_t>(x))
+    #define cdb_count_trailing_zero_32(x) \
+        __count_trailing_zero_32_helper(static_cast<std::uint32_t>(x))
 
     static inline int __count_leading_zero_32_helper(std::uint32_t value) {
         unsigned long index;
@@ -27,31 +38,206 @@ using cdb::BlockIndex;
             return 32;
         }
     }
+
+    static inline int __count_trailing_zero_32_helper(std::uint32_t value) {
+        unsigned long index;
+        if (_BitScanForward(&index, value)) {
+            return index;
+        }
+        else {
+            return 32;
+        }
+    }
+#endif
+
+/**
+ * Mask of a range of bits in an operation unit
+ *
+ * @param offset the offset of the first bit
+ * @param length count of bits, offset + length must not be greater than 32
+ * @return the mask
+ */
+static inline std::uint32_t
+rangeMask(Length offset, Length length)
+{
+    std::uint32_t bits = length >= 32 ? ~static_cast<std::uint32_t>(0) : ~((~static_cast<std::uint32_t>(0)) << length);
+    return bits << offset;
+}
+
+/** a unit with this bit set has no free block at its end */
+static const std::uint32_t UNIT_TOP_BIT = 0x80000000u;
+
+/**
+ * Test two units packed in a 64-bit word for one without any bit of a mask set. The
+ * test may pass falsely for the upper unit if the lower one has no bit set.
+ *
+ * @param word the two units
+ * @param wide_mask the mask repeated in both units
+ * @return false if both units have a bit of the mask set
+ */
+static inline bool
+mayHaveClearUnit(std::uint64_t word, std::uint64_t wide_mask)
+{
+    std::uint64_t masked = word & wide_mask;
+    return (masked - 0x0000000100000001ull) & ~masked & 0x8000000080000000ull;
+}
+
+/**
+ * Find the first unit without any bit of a mask set, checking a vector of units at a
+ * time with AVX-512 or AVX2, or two units at a time otherwise
+ *
+ * @param units the units
+ * @param begin index of the first unit to check
+ * @param end index of the unit to stop at
+ * @param mask the bits to check
+ * @return index of the unit found, or end if not found
+ */
+static Length
+findClearUnit(const std::uint32_t *units, Length begin, Length end, std::uint32_t mask)
+{
+    Length i = begin;
+
+#if defined __AVX512F__
+    const __m512i masks = _mm512_set1_epi32(static_cast<int>(mask));
+    for (; i + 16 <= end; i += 16) {
+        __mmask16 clear = _mm512_testn_epi32_mask(_mm512_loadu_si512(units + i), masks);
+        if (clear) {
+            return i + cdb_count_trailing_zero_32(static_cast<std::uint32_t>(clear));
+        }
+    }
+#elif defined __AVX2__
+    const __m256i masks = _mm256_set1_epi32(static_cast<int>(mask));
+    for (; i + 8 <= end; i += 8) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + i));
+        __m256i clear = _mm256_cmpeq_epi32(_mm256_and_si256(value, masks), _mm256_setzero_si256());
+        std::uint32_t bits = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(clear)));
+        if (bits) {
+            return i + cdb_count_trailing_zero_32(bits);
+        }
+    }
+#endif
+
+    const std::uint64_t wide_mask = (static_cast<std::uint64_t>(mask) << 32) | mask;
+    for (; i + 2 <= end; i += 2) {
+        std::uint64_t word;
+        std::memcpy(&word, units + i, sizeof(word));
+        if (mayHaveClearUnit(word, wide_mask)) {
+            if (!(units[i] & mask)) {
+                return i;
+            }
+            if (!(units[i + 1] & mask)) {
+                return i + 1;
+            }
+        }
+    }
+
+    for (; i < end; ++i) {
+        if (!(units[i] & mask)) {
+            return i;
+        }
+    }
+    return end;
+}
+
+/**
+ * Find the last unit without any bit of a mask set
+ *
+ * @param units the units
+ * @param begin index of the first unit to check
+ * @param end index of the unit to stop at
+ * @param mask the bits to check
+ * @param found [out] index of the unit found
+ * @return false if not found
+ * @see findClearUnit
+ */
+static bool
+findLastClearUnit(const std::uint32_t *units, Length begin, Length end, std::uint32_t mask, Length &found)
+{
+    Length i = end;
+
+#if defined __AVX512F__
+    const __m512i masks = _mm512_set1_epi32(static_cast<int>(mask));
+    for (; i >= begin + 16; i -= 16) {
+        __mmask16 clear = _mm512_testn_epi32_mask(_mm512_loadu_si512(units + i - 16), masks);
+        if (clear) {
+            found = i - 1 - (cdb_count_leading_zero_32(static_cast<std::uint32_t>(clear)) - 16);
+            return true;
+        }
+    }
+#elif defined __AVX2__
+    const __m256i masks = _mm256_set1_epi32(static_cast<int>(mask));
+    for (; i >= begin + 8; i -= 8) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + i - 8));
+        __m256i clear = _mm256_cmpeq_epi32(_mm256_and_si256(value, masks), _mm256_setzero_si256());
+        std::uint32_t bits = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(clear)));
+        if (bits) {
+            found = i - 1 - (cdb_count_leading_zero_32(bits) - 24);
+            return true;
+        }
+    }
 #endif
 
+    const std::uint64_t wide_mask = (static_cast<std::uint64_t>(mask) << 32) | mask;
+    for (; i >= begin + 2; i -= 2) {
+        std::uint64_t word;
+        std::memcpy(&word, units + i - 2, sizeof(word));
+        if (mayHaveClearUnit(word, wide_mask)) {
+            if (!(units[i - 1] & mask)) {
+                found = i - 1;
+                return true;
+            }
+            if (!(units[i - 2] & mask)) {
+                found = i - 2;
+                return true;
+            }
+        }
+    }
+
+    for (; i > begin; --i) {
+        if (!(units[i - 1] & mask)) {
+            found = i - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 BitmapAllocator::BitmapAllocator(Driver *drv, BlockIndex start_at)
-    : BlockAllocator(drv, start_at), _count_block(Driver::BLOCK_SIZE)
+    : BlockAllocator(drv, start_at),
+      _block_per_section(drv->blockSize() * 8),
+      _max_section_count(drv->blockSize() / sizeof(Length)),
+      _max_unit_count(drv->blockSize() / sizeof(OperationUnit)),
+      _bitmap_capacity(BITMAP_CAPACITY),
+      _loaded_count(0),
+      _count_block(drv->blockSize()),
+      _free_space(_block_per_section)
 { 
     // read count block
     _drv->readBlock(_start_at, _count_block);
 
-    // read all bitmaps
+    // bitmaps are read on demand, guess their summaries by the counts
     Length *count_ptr = reinterpret_cast<Length*>(_count_block.content());
-    auto bitmap_count = count_ptr[MAX_SECTION_COUNT - 1];
+    auto bitmap_count = count_ptr[_max_section_count - 1];
 
     if (_bitmaps.size()) {
         _bitmaps.clear();
     }
 
+    _free_space.resize(bitmap_count);
     for (BlockIndex i = 0; i < bitmap_count; ++i, ++count_ptr) {
-        Buffer bitmap_buf(Driver::BLOCK_SIZE);
-        _drv->readBlock(calculateBitmapBlockIndex(i), bitmap_buf);
-        _bitmaps.emplace_back(Bitmap{i, bitmap_buf, *count_ptr, false});
+        _bitmaps.emplace_back(Bitmap{i, nullptr, *count_ptr, false, false});
+        _free_space.update(i, guess(_bitmaps.back()));
     }
 }
 
 BitmapAllocator::~BitmapAllocator()
-{ flush(); }
+{
+    // a destructor must not throw, owners call flush() to know whether it failed
+    try {
+        flush();
+    }
+    catch (...) { }
+}
 
 inline void
 BitmapAllocator::flush()
@@ -67,7 +253,8 @@ BitmapAllocator::flush()
         *count_ptr ++ = bitmap.count;
 
         if (bitmap.dirty) {
-            _drv->writeBlock(calculateBitmapBlockIndex(bitmap.index), bitmap.bitmap);
+            _drv->writeBlock(calculateBitmapBlockIndex(bitmap.index), *bitmap.bitmap);
+            bitmap.dirty = false;
         }
     }
 
@@ -79,7 +266,7 @@ BitmapAllocator::flush()
 
 inline BlockIndex
 BitmapAllocator::calculateBitmapBlockIndex(BlockIndex bitmap_index)
-{ return (bitmap_index + 1) * BLOCK_PER_SECTION - BLOCK_PER_UNIT; } // for fast look up
+{ return (bitmap_index + 1) * _block_per_section - BLOCK_PER_UNIT; } // for fast look up
 
 inline BlockIndex
 BitmapAllocator::calculateCountBlockIndex()
@@ -93,6 +280,10 @@ BitmapAllocator::reset()
     if (_bitmaps.size()) {
         _bitmaps.clear();
     }
+    _free_space = FreeSpaceTree(_block_per_section);
+    _stale.clear();
+    _bitmap_policy = LRUReplacementPolicy();
+    _loaded_count = 0;
 
     // append the first section
     appendSection();
@@ -112,27 +303,142 @@ void
 BitmapAllocator::appendSection()
 {
     BlockIndex new_bitmap_index = _bitmaps.size();
-    Buffer new_bitmap_buf(Driver::BLOCK_SIZE);
-    std::fill(new_bitmap_buf.begin(), new_bitmap_buf.end(), 0);
-    _bitmaps.emplace_back(Bitmap{new_bitmap_index, new_bitmap_buf, 0, false});
+    makeRoom();
+    std::unique_ptr<Buffer> new_bitmap_buf(new Buffer(_drv->blockSize()));
+    std::fill(new_bitmap_buf->begin(), new_bitmap_buf->end(), 0);
+    _bitmaps.emplace_back(Bitmap{new_bitmap_index, std::move(new_bitmap_buf), 0, false, false});
+    _bitmap_policy.admit(new_bitmap_index);
+    ++_loaded_count;
+    _free_space.resize(_bitmaps.size());
 
     // reserve for the bitmap itself
     reserve(calculateBitmapBlockIndex(new_bitmap_index));
 
     // modify section count
     Length *count_ptr = reinterpret_cast<Length*>(_count_block.content());
-    count_ptr[MAX_SECTION_COUNT - 1] ++;
+    count_ptr[_max_section_count - 1] ++;
+
+    // let the driver prepare the whole new section
+    _drv->reserveBlocks((new_bitmap_index + 1) * _block_per_section);
 }
 
 void
 BitmapAllocator::reserve(BlockIndex index)
 {
-    BlockIndex bitmap_index = index / BLOCK_PER_SECTION;
-    BlockIndex block_offset = index % BLOCK_PER_SECTION;
-    auto &bitmap = _bitmaps[bitmap_index];
+    BlockIndex bitmap_index = index / _block_per_section;
+    BlockIndex block_offset = index % _block_per_section;
+    auto &bitmap = bitmapAt(bitmap_index);
     setBitmapOn(bitmap, block_offset);
 }
 
+BitmapAllocator::Bitmap &
+BitmapAllocator::bitmapAt(BlockIndex section)
+{
+    auto &bitmap = _bitmaps[section];
+    if (bitmap.bitmap) {
+        _bitmap_policy.touch(section);
+        return bitmap;
+    }
+
+    makeRoom();
+    bitmap.bitmap.reset(new Buffer(_drv->blockSize()));
+    _drv->readBlock(calculateBitmapBlockIndex(section), *bitmap.bitmap);
+    _bitmap_policy.admit(section);
+    ++_loaded_count;
+    markStale(bitmap);
+
+    return bitmap;
+}
+
+void
+BitmapAllocator::makeRoom()
+{
+    BlockIndex victim;
+    while (_loaded_count >= _bitmap_capacity &&
+            _bitmap_policy.victim([](BlockIndex) { return true; }, victim)) {
+        dropBitmap(victim);
+    }
+}
+
+void
+BitmapAllocator::dropBitmap(BlockIndex section)
+{
+    auto &bitmap = _bitmaps[section];
+
+    if (bitmap.stale) {
+        _free_space.update(section, summarize(bitmap));
+        bitmap.stale = false;
+    }
+    if (bitmap.dirty) {
+        _drv->writeBlock(calculateBitmapBlockIndex(section), *bitmap.bitmap);
+        bitmap.dirty = false;
+    }
+
+    bitmap.bitmap.reset();
+    _bitmap_policy.evict(section);
+    --_loaded_count;
+}
+
+void
+BitmapAllocator::setBitmapCapacity(Length capacity)
+{
+    assert(capacity);
+
+    _bitmap_capacity = capacity;
+    BlockIndex victim;
+    while (_loaded_count > _bitmap_capacity &&
+            _bitmap_policy.victim([](BlockIndex) { return true; }, victim)) {
+        dropBitmap(victim);
+    }
+}
+
+bool
+BitmapAllocator::confirm(BlockIndex section)
+{
+    if (_bitmaps[section].bitmap) {
+        return false;
+    }
+
+    auto before = _free_space.at(section);
+    bitmapAt(section);
+    refreshSummaries();
+
+    auto &after = _free_space.at(section);
+    return before.prefix != after.prefix ||
+        before.suffix != after.suffix ||
+        before.best != after.best ||
+        before.unit_max != after.unit_max;
+}
+
+bool
+BitmapAllocator::confirmRange(BlockIndex index, Length length)
+{
+    bool changed = false;
+    for (
+            BlockIndex section = index / _block_per_section;
+            section <= (index + length - 1) / _block_per_section;
+            ++section
+    ) {
+        changed = confirm(section) || changed;
+    }
+    return changed;
+}
+
+FreeSpaceTree::Summary
+BitmapAllocator::guess(const Bitmap &bitmap) const
+{
+    FreeSpaceTree::Summary ret;
+    ret.width = _block_per_section;
+
+    Length free = _block_per_section - bitmap.count;
+    ret.prefix = free;
+    ret.suffix = free;
+    ret.best = free;
+    ret.unit_max = free < BLOCK_PER_UNIT ? free : BLOCK_PER_UNIT;
+
+    return ret;
+}
+
 void
 BitmapAllocator::setBitmapOn(Bitmap &bitmap, BlockIndex offset)
 { setBitmapOnRange(bitmap, offset, 1); }
@@ -140,16 +446,22 @@ BitmapAllocator::setBitmapOn(Bitmap &bitmap, BlockIndex offset)
 void
 BitmapAllocator::setBitmapOnRange(Bitmap &bitmap, BlockIndex offset, Length length)
 {
-    assert(length + (offset % BLOCK_PER_UNIT) <= BLOCK_PER_UNIT);
-
-    OperationUnit *unit_ptr = reinterpret_cast<OperationUnit*>(bitmap.bitmap.content());
-    Length unit_index = offset / BLOCK_PER_UNIT;
-    Length unit_offset = offset % BLOCK_PER_UNIT;
+    assert(offset + length <= _block_per_section);
 
-    Length mask = (~((~(static_cast<OperationUnit>(0))) << length)) << unit_offset;
-    unit_ptr[unit_index] |= mask;
+    OperationUnit *unit_ptr = reinterpret_cast<OperationUnit*>(bitmap.bitmap->content());
     bitmap.dirty = true;
     bitmap.count += length;
+    markStale(bitmap);
+
+    while (length) {
+        Length unit_index = offset / BLOCK_PER_UNIT;
+        Length unit_offset = offset % BLOCK_PER_UNIT;
+        Length unit_length = std::min(length, BLOCK_PER_UNIT - unit_offset);
+
+        unit_ptr[unit_index] |= rangeMask(unit_offset, unit_length);
+        offset += unit_length;
+        length -= unit_length;
+    }
 }
 
 void
@@ -159,24 +471,116 @@ BitmapAllocator::setBitmapOff(Bitmap &bitmap, BlockIndex offset)
 void
 BitmapAllocator::setBitmapOffRange(Bitmap &bitmap, BlockIndex offset, Length length)
 {
-    OperationUnit *unit_ptr = reinterpret_cast<OperationUnit*>(bitmap.bitmap.content());
-    Length unit_index = offset / BLOCK_PER_UNIT;
-    Length unit_offset = offset % BLOCK_PER_UNIT;
+    assert(offset + length <= _block_per_section);
 
-    Length mask = ~((~((~(static_cast<OperationUnit>(0))) << length)) << unit_offset);
-    unit_ptr[unit_index] &= mask;
+    OperationUnit *unit_ptr = reinterpret_cast<OperationUnit*>(bitmap.bitmap->content());
     bitmap.dirty = true;
     bitmap.count -= length;
+    markStale(bitmap);
+
+    while (length) {
+        Length unit_index = offset / BLOCK_PER_UNIT;
+        Length unit_offset = offset % BLOCK_PER_UNIT;
+        Length unit_length = std::min(length, BLOCK_PER_UNIT - unit_offset);
+
+        unit_ptr[unit_index] &= ~rangeMask(unit_offset, unit_length);
+        offset += unit_length;
+        length -= unit_length;
+    }
+}
+
+inline void
+BitmapAllocator::markStale(Bitmap &bitmap)
+{
+    if (!bitmap.stale) {
+        bitmap.stale = true;
+        _stale.push_back(bitmap.index);
+    }
+}
+
+void
+BitmapAllocator::refreshSummaries()
+{
+    for (auto index : _stale) {
+        // summarized already if dropped from memory
+        auto &bitmap = _bitmaps[index];
+        if (bitmap.stale) {
+            _free_space.update(index, summarize(bitmap));
+            bitmap.stale = false;
+        }
+    }
+    _stale.clear();
+}
+
+FreeSpaceTree::Summary
+BitmapAllocator::summarize(const Bitmap &bitmap) const
+{
+    const OperationUnit *units = reinterpret_cast<const OperationUnit*>(bitmap.bitmap->content());
+    FreeSpaceTree::Summary ret;
+    ret.width = _block_per_section;
+
+    Length unit = 0;
+    while (unit < _max_unit_count && !units[unit]) {
+        ++unit;
+    }
+    ret.prefix = unit * BLOCK_PER_UNIT;
+    if (unit < _max_unit_count) {
+        ret.prefix += cdb_count_trailing_zero_32(units[unit]);
+    }
+
+    unit = _max_unit_count;
+    while (unit && !units[unit - 1]) {
+        --unit;
+    }
+    ret.suffix = (_max_unit_count - unit) * BLOCK_PER_UNIT;
+    if (unit) {
+        ret.suffix += cdb_count_leading_zero_32(units[unit - 1]);
+    }
+
+    Length run = 0;
+    for (Length i = 0; i < _max_unit_count; ++i) {
+        Length trailing = cdb_count_trailing_zero_32(units[i]);
+        Length leading = cdb_count_leading_zero_32(units[i]);
+
+        ret.best = std::max(ret.best, run + trailing);
+        ret.unit_max = std::max(ret.unit_max, leading);
+        run = units[i] ? leading : run + BLOCK_PER_UNIT;
+    }
+    ret.best = std::max(ret.best, run);
+
+    return ret;
+}
+
+void
+BitmapAllocator::setBlocks(BlockIndex index, Length length, bool on)
+{
+    while (length) {
+        BlockIndex section = index / _block_per_section;
+        BlockIndex offset = index % _block_per_section;
+        Length section_length = std::min(length, _block_per_section - offset);
+
+        if (on) {
+            setBitmapOnRange(bitmapAt(section), offset, section_length);
+        }
+        else {
+            setBitmapOffRange(bitmapAt(section), offset, section_length);
+        }
+        index += section_length;
+        length -= section_length;
+    }
 }
 
 BlockIndex
 BitmapAllocator::allocateBlocks(Length length, BlockIndex hint)
 {
     assert(length);
-    assert(length <= BLOCK_PER_UNIT);
 
-    BlockIndex hint_section = hint / BLOCK_PER_SECTION;
-    BlockIndex section_hint = hint % BLOCK_PER_SECTION;
+    if (length > BLOCK_PER_UNIT) {
+        return allocateExtent(length, hint);
+    }
+
+    BlockIndex hint_section = hint / _block_per_section;
+    BlockIndex section_hint = hint % _block_per_section;
 
     BlockIndex ret;
 
@@ -184,32 +588,29 @@ BitmapAllocator::allocateBlocks(Length length, BlockIndex hint)
         appendSection();
     }
 
-    // no enough space in the hinting section
-    if (_bitmaps[hint_section].count <= BLOCK_PER_SECTION - length) {
-        if (allocateBlocksInSection(_bitmaps[hint_section], length, section_hint, ret)) {
-            assert((ret + hint_section * BLOCK_PER_SECTION) > _start_at);
-            return ret + hint_section * BLOCK_PER_SECTION;
-        }
-    }
+    Length section;
+    while (true) {
+        refreshSummaries();
 
-    // try to allocate before the hinting section
-    if (hint_section) {
-        BlockIndex section = hint_section - 1;
-        do {
-            if ((_bitmaps[section].count <= BLOCK_PER_SECTION - length) &&
-                    allocateBlocksInSection(_bitmaps[section], length, 0, ret)) {
-                return ret + section * BLOCK_PER_SECTION;
-            }
-        } while(section--);
-    }
+        // a section with a unit long enough always feeds the request, try the hinting
+        // section, then the nearest section before it, then the first after it
+        if (_free_space.at(hint_section).unit_max >= length) {
+            section = hint_section;
+        }
+        else if (!_free_space.lastFit(0, hint_section, length, section) &&
+                !_free_space.firstFit(hint_section + 1, _bitmaps.size(), length, section)) {
+            break;
+        }
 
-    // try to allocate after the hinting section
-    Length section_count = _bitmaps.size();
-    for (BlockIndex section = hint_section + 1; section < section_count; ++section) {
-        if ((_bitmaps[section].count <= BLOCK_PER_SECTION - length) &&
-                allocateBlocksInSection(_bitmaps[section], length, 0, ret)) {
-            return ret + section * BLOCK_PER_SECTION;
+        if (confirm(section)) {
+            continue;
         }
+
+        BlockIndex offset_hint = section == hint_section ? section_hint : 0;
+        bool result = allocateBlocksInSection(bitmapAt(section), length, offset_hint, ret);
+        assert(result);
+        assert((ret + section * _block_per_section) > _start_at);
+        return ret + section * _block_per_section;
     }
 
     // append a new section
@@ -217,7 +618,7 @@ BitmapAllocator::allocateBlocks(Length length, BlockIndex hint)
     bool last_allocation_result = allocateBlocksInSection(_bitmaps.back(), length, 0, ret);
     assert(last_allocation_result);
 
-    return ret + (_bitmaps.size() - 1) * BLOCK_PER_SECTION;
+    return ret + (_bitmaps.size() - 1) * _block_per_section;
 }
 
 bool
@@ -229,51 +630,173 @@ BitmapAllocator::allocateBlocksInSection(
     )
 {
     BlockIndex hint_unit = section_hint / BLOCK_PER_UNIT;
-    OperationUnit *unit_start = reinterpret_cast<OperationUnit*>(bitmap.bitmap.content());
-    OperationUnit *unit_limit = unit_start + MAX_UNIT_COUNT;
-    OperationUnit *unit_hint_ptr = unit_start + hint_unit;
+    const OperationUnit *units = reinterpret_cast<const OperationUnit*>(bitmap.bitmap->content());
 
-    // find begin at hinting point
-    for (
-            OperationUnit *unit_ptr = unit_hint_ptr;
-            unit_ptr != unit_limit;
-            ++unit_ptr
-    ) {
-        Length leading_size = cdb_count_leading_zero_32(*unit_ptr);
+    // units with enough free blocks at their end have none of the top bits set
+    OperationUnit mask = ~static_cast<OperationUnit>(0) << (BLOCK_PER_UNIT - length);
 
-        if (leading_size >= length) {
-            result = ((unit_ptr - unit_start) * BLOCK_PER_UNIT) + (32 - leading_size);
-            setBitmapOnRange(bitmap, result, length);
-            return true;
-        }
+    // find begin at hinting point, then the nearest before it
+    Length unit = findClearUnit(units, hint_unit, _max_unit_count, mask);
+    bool found = unit != _max_unit_count ||
+        (hint_unit && findLastClearUnit(units, 0, hint_unit, mask, unit));
+
+    if (found) {
+        result = unit * BLOCK_PER_UNIT + BLOCK_PER_UNIT - cdb_count_leading_zero_32(units[unit]);
+        setBitmapOnRange(bitmap, result, length);
+        return true;
     }
 
-    // find from start if hinted
-    if (section_hint) {
-        for (
-                OperationUnit *unit_ptr = unit_hint_ptr;
-                unit_ptr >= unit_start;
-                --unit_ptr
-        ) {
-            Length leading_size = cdb_count_leading_zero_32(*unit_ptr);
+    // not found
+    return false;
+}
 
-            if (leading_size >= length) {
-                result = ((unit_ptr - unit_start) * BLOCK_PER_UNIT) + (32 - leading_size);
-                setBitmapOnRange(bitmap, result, length);
-                return true;
+bool
+BitmapAllocator::scanUnits(
+        BlockIndex unit_begin,
+        BlockIndex unit_end,
+        Length length,
+        Length &run,
+        BlockIndex &run_start,
+        BlockIndex &result
+    )
+{
+    assert(length > BLOCK_PER_UNIT);
+
+    Length section = unit_begin / _max_unit_count;
+    BlockIndex base = section * _max_unit_count;
+    assert(_bitmaps[section].bitmap);
+    const OperationUnit *units = reinterpret_cast<const OperationUnit*>(_bitmaps[section].bitmap->content());
+    assert(unit_end <= base + _max_unit_count);
+
+    Length unit = unit_begin - base;
+    Length end = unit_end - base;
+    while (unit < end) {
+        // outside a run, units without free blocks at their end can not start one
+        if (!run) {
+            unit = findClearUnit(units, unit, end, UNIT_TOP_BIT);
+            if (unit == end) {
+                break;
             }
         }
+
+        auto value = units[unit];
+
+        // blocks are allocated from the least important bit of a unit, so the run
+        // continues with the trailing zeros and restarts at the leading zeros
+        if (run + cdb_count_trailing_zero_32(value) >= length) {
+            result = run_start;
+            return true;
+        }
+
+        if (!value) {
+            run += BLOCK_PER_UNIT;
+        }
+        else {
+            run = cdb_count_leading_zero_32(value);
+            run_start = (base + unit + 1) * BLOCK_PER_UNIT - run;
+        }
+        ++unit;
     }
 
-    // not found
     return false;
 }
 
+bool
+BitmapAllocator::findExtent(BlockIndex unit_begin, Length length, BlockIndex &result)
+{
+    refreshSummaries();
+
+    Length section = unit_begin / _max_unit_count;
+    Length run = 0;
+    BlockIndex run_start = unit_begin * BLOCK_PER_UNIT;
+
+    bitmapAt(section);
+    if (scanUnits(unit_begin, (section + 1) * _max_unit_count, length, run, run_start, result)) {
+        return true;
+    }
+
+    // search again if the sections found were guessed wrong
+    Length found;
+    BlockIndex start;
+    do {
+        refreshSummaries();
+        if (!_free_space.firstRun(section + 1, length, run, run_start, found, start)) {
+            return false;
+        }
+    } while (found == _free_space.size() ? confirmRange(start, length) : confirm(found));
+
+    if (found == _free_space.size()) {
+        result = start;
+        return true;
+    }
+
+    // the run lies inside the section
+    section = found;
+    bitmapAt(section);
+    run = 0;
+    run_start = section * _block_per_section;
+    bool scanned = scanUnits(section * _max_unit_count, (section + 1) * _max_unit_count, length, run, run_start, result);
+    assert(scanned);
+    return scanned;
+}
+
+BlockIndex
+BitmapAllocator::allocateExtent(Length length, BlockIndex hint)
+{
+    assert(length < _block_per_section);
+
+    BlockIndex hint_section = hint / _block_per_section;
+    while (_bitmaps.size() <= hint_section) {
+        appendSection();
+    }
+
+    BlockIndex hint_unit = hint / BLOCK_PER_UNIT;
+    BlockIndex ret;
+
+    if (!findExtent(hint_unit, length, ret) && !(hint_unit && findExtent(0, length, ret))) {
+        // a run may start in the last unit of the last section, after its bitmap block
+        BlockIndex last_unit;
+        do {
+            last_unit = _bitmaps.size() * _max_unit_count - 1;
+            appendSection();
+        } while (!findExtent(last_unit, length, ret));
+    }
+
+    assert(ret > _start_at);
+    setBlocks(ret, length, true);
+    return ret;
+}
+
 void
 BitmapAllocator::freeBlocks(BlockIndex index, Length length)
+{ setBlocks(index, length, false); }
+
+
+Length
+BitmapAllocator::trim()
 {
-    BlockIndex section = index / BLOCK_PER_SECTION;
-    BlockIndex offset = index % BLOCK_PER_SECTION;
-    setBitmapOffRange(_bitmaps[section], offset, length);
-}
+    // only the bitmap block is allocated in an empty section
+    Length section_count = _bitmaps.size();
+    while (section_count > 1 && _bitmaps[section_count - 1].count == 1) {
+        --section_count;
+    }
+    if (section_count == _bitmaps.size()) {
+        return 0;
+    }
 
+    refreshSummaries();
+    while (_bitmaps.size() > section_count) {
+        if (_bitmaps.back().bitmap) {
+            _bitmap_policy.evict(_bitmaps.back().index);
+            --_loaded_count;
+        }
+        _bitmaps.pop_back();
+    }
+    _free_space.resize(section_count);
+
+    Length *count_ptr = reinterpret_cast<Length*>(_count_block.content());
+    std::fill(count_ptr + section_count, count_ptr + _max_section_count - 1, 0);
+    count_ptr[_max_section_count - 1] = section_count;
+
+    return section_count * _block_per_section;
+}
@@ -1,10 +1,13 @@
 #ifndef _DB_DRIVER_BITMAP_ALLOCATOR_H_
 #define _DB_DRIVER_BITMAP_ALLOCATOR_H_
 
+#include <memory>
 #include <vector>
 
 #include "driver.hpp"
 #include "block-allocator.hpp"
+#include "free-space-tree.hpp"
+#include "replacement-policy.hpp"
 
 namespace cdb {
     /**
@@ -22,7 +25,8 @@ namespace cdb {
      * block. So there are several bitmap blocks in one bitmap allocator. The bitmap
      * block is located at the first block of the last operation unit of a section. when
      * a block is of 1024 bytes size, a operation unit is of 4 bytes size, then the 
-     * bitmap block is located at the index of (1024 * 8) - (4 * 8) = 8160.
+     * bitmap block is located at the index of (1024 * 8) - (4 * 8) = 8160. Sizes of
+     * sections follow the block size of the driver.
      *
      * When allocating blocks with a hint, the algorithm will start at the hinting 
      * operation unit and check the following one by one, by comparing the leading zero 
@@ -40,19 +44,45 @@ namespace cdb {
      * would be created. Hinting position would be ignored, when searching in sections
      * other than the hinting section.
      *
-     * NOTE: length must not be greater than 8 * sizeof(OperationUnit) in one allocation
+     * Requests longer than an operation unit are allocated as extents. Operation units
+     * of all sections are scanned as one sequence from the hinting unit, then from the
+     * first unit, for the first run of free bits long enough, made of the leading zeros
+     * of a unit, empty units, and the trailing zeros of the last unit. Runs may cross
+     * into the next section, but never over a bitmap block, so an extent is shorter than
+     * a section. New sections are appended if no run is found.
+     *
+     * Free space of each section is summarized in a FreeSpaceTree, so sections which
+     * can not feed a request are skipped without being scanned. Summaries of modified
+     * sections are brought up to date before the next allocation.
+     *
+     * Bitmap blocks are read on demand rather than when constructed. Until a section is
+     * read, its summary is guessed from its count in the count block: a full section
+     * is known to have no free blocks, others may have all their free blocks in a row.
+     * A section found by a guess is read and searched again if the guess was wrong, so
+     * full sections are never read. At most a capacity of bitmaps is kept in memory,
+     * the least recently used ones are written back if dirty and dropped, keeping their
+     * summaries.
+     *
+     * Empty sections at the end can be trimmed once blocks are moved towards the front,
+     * then the driver can be truncated to the end of the last section kept.
      */
     class BitmapAllocator : public BlockAllocator
     {
+    public:
+        /** default number of bitmaps kept in memory */
+        static const Length BITMAP_CAPACITY = 1024;
+
+    private:
         /**
          * internal repersentation of bitmap inside class BitmapAllocator
          */
         struct Bitmap
         {
             BlockIndex index;   /** index of this bitmap */
-            Buffer bitmap;      /** data of this bitmap */
+            std::unique_ptr<Buffer> bitmap;     /** data of this bitmap, null if not read */
             Length count;       /** number blocks allocated in this bitmap */
             bool dirty;         /** ture if this bitmap is dirty */
+            bool stale;         /** true if modified since summarized */
         };
 
         typedef std::vector<Bitmap> BitmapVector;
@@ -63,17 +93,32 @@ namespace cdb {
          */
         typedef std::uint32_t OperationUnit;
 
-        static const Length BLOCK_PER_SECTION = Driver::BLOCK_SIZE * 8;
-        static const Length MAX_SECTION_COUNT = Driver::BLOCK_SIZE / sizeof(Length);
         static const Length BLOCK_PER_UNIT = sizeof(OperationUnit) * 8;
-        static const Length MAX_UNIT_COUNT = Driver::BLOCK_SIZE / sizeof(OperationUnit);
+
+        /** number of blocks in each section, one bit of the bitmap block for each */
+        const Length _block_per_section;
+
+        /** number of Length in the count block */
+        const Length _max_section_count;
+
+        /** number of operation units in a bitmap block */
+        const Length _max_unit_count;
 
         /**
-         * Bitmaps in memory, all bitmaps is read into memory when constructing, and
-         * would be flushed back to disk when flushing
+         * Bitmaps of all sections, read into memory on demand, and would be flushed back
+         * to disk when flushing
          */
         BitmapVector _bitmaps;
 
+        /** maximum number of bitmaps in memory */
+        Length _bitmap_capacity;
+
+        /** number of bitmaps in memory */
+        Length _loaded_count;
+
+        /** chooses the bitmap to drop from memory, by section */
+        LRUReplacementPolicy _bitmap_policy;
+
         /**
          * Interpreted as an array of Length. Last element in the array indicate the 
          * total number of sections in this allocator. Other elements is the allocated 
@@ -85,6 +130,12 @@ namespace cdb {
          */
         Buffer _count_block;
 
+        /** free space of all sections */
+        FreeSpaceTree _free_space;
+
+        /** sections modified since summarized */
+        std::vector<BlockIndex> _stale;
+
         /**
          * Calculate the index of each bitmap block by the index of each bitmap
          *
@@ -105,6 +156,45 @@ namespace cdb {
          */
         inline void appendSection();
 
+        /**
+         * @param section index of a section
+         * @return the bitmap of the section, read into memory if not yet
+         */
+        Bitmap &bitmapAt(BlockIndex section);
+
+        /**
+         * Make room for one more bitmap in memory, dropping the least recently used
+         */
+        void makeRoom();
+
+        /**
+         * Write back a bitmap if dirty and drop it from memory, keeping its summary
+         *
+         * @param section index of the section
+         */
+        void dropBitmap(BlockIndex section);
+
+        /**
+         * Read the bitmap of a section whose summary may be a guess
+         *
+         * @param section index of the section
+         * @return true if the summary changed, so a search has to be repeated
+         */
+        bool confirm(BlockIndex section);
+
+        /**
+         * Read the bitmaps of all sections a range of blocks lies in
+         *
+         * @see confirm
+         */
+        bool confirmRange(BlockIndex index, Length length);
+
+        /**
+         * @param bitmap a bitmap not yet read
+         * @return the most free space its section may have
+         */
+        FreeSpaceTree::Summary guess(const Bitmap &bitmap) const;
+
         /**
          * Reserve a block in the allocator. Used when resetting the allocator and 
          * reserving the blocks before `start_at_`. Also used when reserving the bitmap
@@ -126,8 +216,6 @@ namespace cdb {
         /**
          * Set a range of bits in the bitmap on
          *
-         * NOTE: bits must not cross over the bound of operation units
-         *
          * @param bitmap the bitmap to operate
          * @param offset the offset of the first bit to set on
          * @param length count of bits to set on
@@ -147,8 +235,6 @@ namespace cdb {
         /**
          * Set a range of bits in the bitmap off
          *
-         * NOTE: bits must not cross over the bound of operatioff units
-         *
          * @param bitmap the bitmap to operate
          * @param offset the offset of the first bit to set off
          * @param length count of bits to set off
@@ -174,6 +260,74 @@ namespace cdb {
                 BlockIndex section_hint,
                 BlockIndex &result
             );
+
+        /**
+         * Remember to summarize a modified bitmap before the next allocation
+         *
+         * @param bitmap the bitmap modified
+         */
+        inline void markStale(Bitmap &bitmap);
+
+        /**
+         * Summarize all modified bitmaps into the FreeSpaceTree
+         */
+        void refreshSummaries();
+
+        /**
+         * @param bitmap the bitmap to summarize
+         * @return free space of the section of the bitmap
+         */
+        FreeSpaceTree::Summary summarize(const Bitmap &bitmap) const;
+
+        /**
+         * Set bits of a range of blocks on or off, the range may cross sections
+         *
+         * @param index the index of the first block
+         * @param length the number of blocks
+         * @param on true to set on, false to set off
+         */
+        void setBlocks(BlockIndex index, Length length, bool on);
+
+        /**
+         * Scan a range of operation units in one section for a run of more free blocks
+         * than an operation unit
+         *
+         * @param unit_begin index of the first unit to scan, counted over all sections
+         * @param unit_end index of the unit to stop at, counted over all sections
+         * @param length the length of the run required
+         * @param run [in,out] length of the run ending at the current unit
+         * @param run_start [in,out] index of the first block of that run
+         * @param result [out] index of the first block of the run found
+         * @return true if found
+         */
+        bool scanUnits(
+                BlockIndex unit_begin,
+                BlockIndex unit_end,
+                Length length,
+                Length &run,
+                BlockIndex &run_start,
+                BlockIndex &result
+            );
+
+        /**
+         * Find the first run of free blocks starting at or after an operation unit. The
+         * rest of its section is scanned, later sections are skipped by their summaries.
+         *
+         * @param unit_begin index of the first unit to scan, counted over all sections
+         * @param length the length of the run required
+         * @param result [out] index of the first block of the run
+         * @return true if found
+         */
+        bool findExtent(BlockIndex unit_begin, Length length, BlockIndex &result);
+
+        /**
+         * Allocate blocks longer than an operation unit
+         *
+         * @param length the count of blocks required, shorter than a section
+         * @param hint hint to the allocator
+         * @return the index of first block allocated
+         */
+        BlockIndex allocateExtent(Length length, BlockIndex hint);
     public:
         /**
          * Constructor, read necessery infomation from disk
@@ -184,7 +338,8 @@ namespace cdb {
         BitmapAllocator(Driver *drv, BlockIndex start_at);
 
         /**
-         * Flush the infomation, and free all memory used internal
+         * Flush the infomation, and free all memory used internal. Errors of flushing
+         * are swallowed.
          */
         virtual ~BitmapAllocator();
 
@@ -198,11 +353,23 @@ namespace cdb {
          */
         virtual void flush();
 
+        /**
+         * @param capacity maximum number of bitmaps kept in memory, at least 1
+         */
+        void setBitmapCapacity(Length capacity);
+
+        /**
+         * @return number of bitmaps in memory
+         */
+        inline Length
+        loadedBitmapCount() const
+        { return _loaded_count; }
+
         /**
          * Allocate a series of blocks from the allocator, with of without hint
          *
-         * NOTE: the length must not be greater than sizeof(OperationUnit), which is 32,
-         * currently
+         * NOTE: the length must be less than the number of blocks in a section, which is
+         * 8 times the block size
          *
          * @param length the count of blocks required
          * @param hint hint to the allocator
@@ -220,6 +387,14 @@ namespace cdb {
          * @param length the number of blocks to free
          */
         virtual void freeBlocks(BlockIndex index, Length length);
+
+        /**
+         * Drop trailing sections without any block allocated but their bitmap blocks,
+         * the first section is always kept
+         *
+         * @return number of blocks in the sections kept, 0 if no section is dropped
+         */
+        virtual Length trim();
     };
 }
 
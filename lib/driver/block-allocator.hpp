@@ -43,7 +43,7 @@ namespace cdb {
          * Allocate a series of blocks in the allocator, the blocks will always be 
          * allocated in a row
          *
-         * NOTE: some of allocators have limitation of length, make length less than 32
+         * NOTE: some of allocators have limitation of length, @see BitmapAllocator
          *
          * @param length the count of blocks required
          * @param hint the suggestion to the allocator
@@ -75,6 +75,16 @@ namespace cdb {
          */
         virtual void freeBlocks(BlockIndex index, Length length) = 0;
 
+        /**
+         * Give back the free blocks at the end of the allocator, so the driver can be
+         * truncated after the allocator is flushed. Do nothing by default.
+         *
+         * @return number of blocks the driver has to keep, 0 if nothing is given back
+         * @see Driver::truncateBlocks(Length count)
+         */
+        virtual Length trim()
+        { return 0; }
+
         /**
          * Reset the allocator
          */
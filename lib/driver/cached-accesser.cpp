@@ -1,91 +1,677 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
 #include "cached-accesser.hpp"
 
 using namespace cdb;
 
+/** maximum number of adjacent dirty frames written together when evicting */
+static const Length MAX_WRITE_BACK_RUN = 64;
+
+/** maximum number of frames the flusher writes while holding the mutex of a shard */
+static const Length TRICKLE_BATCH = 64;
+
+CachedAccesser::CachedAccesser(
+        Driver *drv,
+        BlockAllocator *allocator,
+        ReplacementPolicy *policy,
+        Length shard_count
+    )
+    : DriverAccesser(drv, allocator),
+      _capacity(0),
+      _dirty_count(0),
+      _readahead(0),
+      _flusher_running(false),
+      _flusher_stop(false),
+      _high_watermark(HIGH_WATERMARK),
+      _low_watermark(LOW_WATERMARK),
+      _flush_interval(FLUSH_INTERVAL)
+{
+    assert(shard_count);
+
+    std::unique_ptr<ReplacementPolicy> prototype(policy ? policy : new LRUReplacementPolicy());
+    for (Length i = 0; i < shard_count; ++i) {
+        _shards.emplace_back(new Shard());
+        _shards.back()->policy.reset(i + 1 < shard_count ? prototype->create() : prototype.release());
+    }
+
+    setCapacity(CACHE_SIZE / drv->blockSize());
+}
+
+CachedAccesser::~CachedAccesser()
+{
+    stopFlusher();
+
+    // a destructor must not throw, dirty blocks failed to write are lost
+    try {
+        flush();
+    }
+    catch (...) { }
+
+    // frames must outlive the background reads into them
+    for (auto &shard : _shards) {
+        for (auto &frame : shard->frames) {
+            if (frame.pending) {
+                try {
+                    finishRead(*frame.pending);
+                }
+                catch (...) { }
+            }
+        }
+    }
+}
+
 BlockIndex
 CachedAccesser::allocateBlocks(Length length, BlockIndex hint)
-{ return _allocator->allocateBlocks(length, hint); }
+{
+    std::lock_guard<std::mutex> lock(_allocator_mutex);
+    return _allocator->allocateBlocks(length, hint);
+}
 
 void
 CachedAccesser::freeBlocks(BlockIndex index, Length length)
-{ _allocator->freeBlocks(index, length); }
+{
+    std::lock_guard<std::mutex> lock(_allocator_mutex);
+    _allocator->freeBlocks(index, length);
+}
+
+void
+CachedAccesser::setReadahead(Length readahead)
+{ _readahead = std::min<Length>(readahead, _capacity / _shards.size() / 2); }
 
-std::list<CachedAccesser::CacheBlock>::iterator
-CachedAccesser::findRecordByBlockIndexOnly(BlockIndex index)
+void
+CachedAccesser::setCapacity(Length capacity)
 {
-    auto tag = calcTagByBlockIndex(index);
+    _capacity = std::max<Length>(capacity, 1);
+    _readahead = std::min<Length>(_readahead, _capacity / _shards.size() / 2);
 
-    for (auto i = _record.begin(); i != _record.end(); ++i) {
-        if (i->tag == tag) {
-            return i;
+    Length shard_count = _shards.size();
+    for (Length i = 0; i < shard_count; ++i) {
+        Shard &shard = *_shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        shard.capacity = _capacity / shard_count + (i < _capacity % shard_count ? 1 : 0);
+        shard.policy->setCapacity(shard.capacity);
+        shrink(shard);
+    }
+}
+
+Length
+CachedAccesser::size()
+{
+    Length ret = 0;
+    for (auto &shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        ret += shard->frames.size();
+    }
+    return ret;
+}
+
+CachedAccesser::Statistics
+CachedAccesser::statistics()
+{
+    Statistics ret;
+    for (auto &shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        ret.hits += shard->statistics.hits;
+        ret.misses += shard->statistics.misses;
+        ret.evictions += shard->statistics.evictions;
+        ret.dirty_writes += shard->statistics.dirty_writes;
+        ret.overflows += shard->statistics.overflows;
+        ret.prefetches += shard->statistics.prefetches;
+        ret.background_writes += shard->statistics.background_writes;
+    }
+    return ret;
+}
+
+void
+CachedAccesser::resetStatistics()
+{
+    for (auto &shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->statistics = Statistics();
+    }
+}
+
+CachedAccesser::FrameList::iterator
+CachedAccesser::findFrameOnly(Shard &shard, BlockIndex index)
+{
+    auto iter = shard.frame_by_index.find(index);
+    if (iter == shard.frame_by_index.end()) {
+        throw CachedNotFoundException(index);
+    }
+
+    return iter->second;
+}
+
+CachedAccesser::FrameList::iterator
+CachedAccesser::findFrameAndIncCount(Shard &shard, BlockIndex index)
+{
+    FrameList::iterator frame;
+
+    auto found = shard.frame_by_index.find(index);
+    if (found != shard.frame_by_index.end()) {
+        frame = found->second;
+        shard.policy->touch(index);
+
+        // read again if the read failed, threads already waiting for it get the error
+        if (frame->pending && frame->pending->failed) {
+            frame->pending.reset(new Read());
+            frame->pending->indices.push_back(index);
+            frame->pending->dests.push_back(frame->content);
         }
+        ++shard.statistics.hits;
+    }
+    else {
+        frame = readFrames(shard, index);
+        ++shard.statistics.misses;
     }
 
-    throw CachedNotFoundException(index);
+    ++(frame->count);
+    return frame;
 }
 
-std::list<CachedAccesser::CacheBlock>::iterator
-CachedAccesser::findRecordByBlockIndexAndIncCount(BlockIndex index)
+bool
+CachedAccesser::settled(Frame &frame)
 {
-    auto tag = calcTagByBlockIndex(index);
+    if (!frame.pending) {
+        return true;
+    }
 
-    for (auto i = _record.begin(); i != _record.end(); ++i) {
-        if (i->tag == tag) {
-            ++(i->count);
-            ++(i->accessed);
-            if (i == _record.begin()) {
-                return i;
-            }
-            _record.emplace(_record.begin(), std::move(*i));
-            _record.erase(i);
-            return _record.begin();
+    // locked by the thread finishing the read
+    Read &read = *frame.pending;
+    std::unique_lock<std::mutex> lock(read.mutex, std::try_to_lock);
+    if (!lock) {
+        return false;
+    }
+    if (read.failed) {
+        return true;
+    }
+    if (read.indices.size() || (read.handle && !_drv->finished(read.handle))) {
+        return false;
+    }
+
+    if (read.handle) {
+        auto handle = read.handle;
+        read.handle = 0;
+        try {
+            _drv->wait(handle);
+        }
+        catch (...) {
+            read.error = std::current_exception();
+            read.failed = true;
+            return true;
+        }
+    }
+
+    lock.unlock();
+    frame.pending.reset();
+    return true;
+}
+
+void
+CachedAccesser::finishRead(Read &read)
+{
+    std::lock_guard<std::mutex> lock(read.mutex);
+
+    try {
+        if (read.indices.size()) {
+            _drv->readBlocksV(read.indices.data(), read.indices.size(), read.dests.data());
         }
+
+        if (read.handle) {
+            auto handle = read.handle;
+            read.handle = 0;
+            _drv->wait(handle);
+        }
+    }
+    catch (...) {
+        read.error = std::current_exception();
+        read.failed = true;
     }
 
-    if (_record.size() == CACHE_MAX_BLOCK_COUNT) {
-        for (auto i = _record.rbegin(); i != _record.rend(); ++i) {
-            if (i->count == 0) {
-                _record.erase(i.base());
+    // never read into the frames again, they may be reused once the read failed
+    read.indices.clear();
+    read.dests.clear();
+
+    if (read.failed) {
+        std::rethrow_exception(read.error);
+    }
+}
+
+bool
+CachedAccesser::findVictim(Shard &shard, FrameList::iterator &frame)
+{
+    BlockIndex victim;
+    bool found = shard.policy->victim(
+            [this, &shard](BlockIndex index)
+            {
+                auto &frame = *shard.frame_by_index.find(index)->second;
+                return !frame.count && settled(frame);
+            },
+            victim
+        );
+    if (found) {
+        frame = shard.frame_by_index.find(victim)->second;
+    }
+    return found;
+}
+
+void
+CachedAccesser::evictFrame(Shard &shard, FrameList::iterator frame)
+{
+    if (frame->dirty) {
+        // write the unpinned dirty neighbours together with the victim
+        auto writable = [&shard](BlockIndex index)
+        {
+            auto neighbour = shard.frame_by_index.find(index);
+            return neighbour != shard.frame_by_index.end() &&
+                neighbour->second->dirty &&
+                !neighbour->second->count;
+        };
+
+        std::vector<Frame*> run{ &*frame };
+        for (BlockIndex index = frame->index; index-- > 0 && run.size() < MAX_WRITE_BACK_RUN; ) {
+            if (!writable(index)) {
                 break;
             }
+            run.push_back(&*shard.frame_by_index.find(index)->second);
         }
+        for (BlockIndex index = frame->index + 1; run.size() < MAX_WRITE_BACK_RUN; ++index) {
+            if (!writable(index)) {
+                break;
+            }
+            run.push_back(&*shard.frame_by_index.find(index)->second);
+        }
+        writeBack(shard, run);
     }
 
-    assert(_record.size() != CACHE_MAX_BLOCK_COUNT);
+    shard.policy->evict(frame->index);
+    shard.frame_by_index.erase(frame->index);
+    ++shard.statistics.evictions;
+}
 
-    _record.emplace(_record.begin(), CacheBlock{1, 1, tag, Buffer(CACHE_BLOCK_SIZE)});
-    _drv->readBlocks(calcIndexByTag(tag), BLOCK_PER_CACHE, _record.begin()->content);
-    return _record.begin();
+void
+CachedAccesser::shrink(Shard &shard)
+{
+    FrameList::iterator frame;
+    while (shard.frames.size() > shard.capacity && findVictim(shard, frame)) {
+        evictFrame(shard, frame);
+        shard.frames.erase(frame);
+    }
+}
+
+bool
+CachedAccesser::obtainFrame(Shard &shard, FrameList::iterator &frame, bool overflow)
+{
+    // give back frames created while the shard was pinned, or left by shrinking
+    shrink(shard);
+
+    if (shard.frames.size() < shard.capacity) {
+        shard.frames.emplace_front(0, Buffer::Aligned(blockSize(), _drv->ioAlignment()));
+        frame = shard.frames.begin();
+        return true;
+    }
+
+    if (findVictim(shard, frame)) {
+        evictFrame(shard, frame);
+        return true;
+    }
+
+    if (!overflow) {
+        return false;
+    }
+
+    ++shard.statistics.overflows;
+    shard.frames.emplace_front(0, Buffer::Aligned(blockSize(), _drv->ioAlignment()));
+    frame = shard.frames.begin();
+    return true;
 }
 
 void
-CachedAccesser::release(BlockIndex block, bool dirty)
+CachedAccesser::assignFrames(
+        Shard &shard,
+        BlockIndex index,
+        bool overflow,
+        std::vector<BlockIndex> &indices,
+        std::vector<Slice> &dests,
+        std::vector<FrameList::iterator> &frames
+    )
 {
-    auto iter = findRecordByBlockIndexOnly(block);
+    Length readahead = _readahead;
+    Length count = (readahead > 1 && index == shard.sequential_next) ? readahead : 1;
+
+    for (Length i = 0; i < count; ++i) {
+        BlockIndex block = index + i;
+        if (i && (&shardOf(block) != &shard || shard.frame_by_index.count(block))) {
+            break;
+        }
+
+        // only the block required may overflow the shard
+        FrameList::iterator frame;
+        if (!obtainFrame(shard, frame, overflow && !i)) {
+            break;
+        }
+
+        // pinned until read, so following blocks do not evict it
+        frame->index = block;
+        frame->count = 1;
+        frame->dirty = false;
+        shard.frame_by_index.emplace(block, frame);
+        shard.policy->admit(block);
+
+        indices.push_back(block);
+        dests.push_back(frame->content);
+        frames.push_back(frame);
+    }
+
+    shard.sequential_next = index + indices.size();
+}
+
+CachedAccesser::FrameList::iterator
+CachedAccesser::readFrames(Shard &shard, BlockIndex index)
+{
+    std::shared_ptr<Read> read(new Read());
+    std::vector<FrameList::iterator> frames;
+
+    assignFrames(shard, index, true, read->indices, read->dests, frames);
+    assert(read->indices.size());
+
+    // not evicted until the read is finished
+    for (auto frame : frames) {
+        frame->pending = read;
+        frame->count = 0;
+    }
+    return frames.front();
+}
+
+void
+CachedAccesser::prefetch(BlockIndex index)
+{
+    Shard &shard = shardOf(index);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (shard.frame_by_index.count(index)) {
+        return;
+    }
+
+    std::vector<BlockIndex> indices;
+    std::vector<Slice> dests;
+    std::vector<FrameList::iterator> frames;
+
+    assignFrames(shard, index, false, indices, dests, frames);
+    if (!indices.size()) {
+        return;
+    }
+
+    // a hint, failures are left to the aquire
+    std::shared_ptr<Read> read(new Read());
+    try {
+        read->handle = _drv->readBlocksAsync(indices.data(), indices.size(), dests.data());
+    }
+    catch (...) {
+        read->error = std::current_exception();
+        read->failed = true;
+    }
+
+    for (auto frame : frames) {
+        frame->pending = read;
+        frame->count = 0;
+    }
+    shard.statistics.prefetches += indices.size();
+}
+
+Length
+CachedAccesser::writeBack(Shard &shard, std::vector<Frame*> &frames)
+{
+    std::vector<BlockIndex> indices;
+    std::vector<ConstSlice> srcs;
+
+    for (auto *frame : frames) {
+        if (!frame->dirty) {
+            continue;
+        }
+        indices.push_back(frame->index);
+        srcs.push_back(const_cast<const Buffer &>(frame->content));
+        frame->dirty = false;
+    }
+    shard.statistics.dirty_writes += indices.size();
+    _dirty_count -= indices.size();
+
+    if (indices.size()) {
+        _drv->writeBlocksV(indices.data(), indices.size(), srcs.data());
+    }
+    return indices.size();
+}
+
+void
+CachedAccesser::writeLatched(Shard &shard, std::vector<Frame*> &frames)
+{
+    std::vector<BlockIndex> indices;
+    std::vector<ConstSlice> srcs;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto *frame : frames) {
+            if (!frame->dirty) {
+                continue;
+            }
+            indices.push_back(frame->index);
+            srcs.push_back(const_cast<const Buffer &>(frame->content));
+            frame->dirty = false;
+        }
+        shard.statistics.dirty_writes += indices.size();
+        _dirty_count -= indices.size();
+    }
+
+    if (indices.size()) {
+        _drv->writeBlocksV(indices.data(), indices.size(), srcs.data());
+    }
+
+    for (auto *frame : frames) {
+        frame->latch.unlockShared();
+    }
+}
+
+void
+CachedAccesser::release(BlockIndex block, bool dirty, Latch::Mode latch)
+{
+    Shard &shard = shardOf(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto iter = findFrameOnly(shard, block);
     assert(iter->count);
+
+    iter->latch.unlock(latch);
     iter->count--;
 
-    if (dirty) {
-        _drv->writeBlock(
-                block,
-                ConstSlice(
-                    const_cast<const Buffer &>(iter->content).content() + calcOffsetByBlockIndex(block),
-                    Driver::BLOCK_SIZE
-                )
-        );
+    // written back when evicted or flushed
+    if (dirty && !iter->dirty) {
+        iter->dirty = true;
+        ++_dirty_count;
+
+        if (_flusher_running && dirtyAbove(_high_watermark)) {
+            std::lock_guard<std::mutex> flusher_lock(_flusher_mutex);
+            _flusher_cond.notify_one();
+        }
     }
 }
 
 Slice
-CachedAccesser::access(BlockIndex index)
+CachedAccesser::access(BlockIndex index, Latch::Mode latch)
 {
-    auto iter = findRecordByBlockIndexAndIncCount(index);
-    return Slice(
-            iter->content.content() + calcOffsetByBlockIndex(index),
-            Driver::BLOCK_SIZE
-        );
+    Shard &shard = shardOf(index);
+    FrameList::iterator frame;
+    std::shared_ptr<Read> read;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        frame = findFrameAndIncCount(shard, index);
+        read = frame->pending;
+    }
+
+    // pinned, so the frame stays while its read finishes and while waiting for the latch
+    if (read) {
+        try {
+            finishRead(*read);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            --(frame->count);
+            throw;
+        }
+    }
+    frame->latch.lock(latch);
+    return frame->content;
 }
 
 void
 CachedAccesser::flush()
-{ }
+{
+    for (auto &shard : _shards) {
+        // pinned, so the frames stay while their latches are taken without the mutex
+        std::vector<Frame*> dirty_frames;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (auto &frame : shard->frames) {
+                if (frame.dirty) {
+                    ++frame.count;
+                    dirty_frames.push_back(&frame);
+                }
+            }
+        }
+
+        // frames latched exclusively are being modified, each is written alone once its
+        // writer is done, so no latch is waited for while holding another
+        std::vector<Frame*> latched;
+        std::vector<Frame*> busy;
+        for (auto *frame : dirty_frames) {
+            (frame->latch.tryLockShared() ? latched : busy).push_back(frame);
+        }
+
+        writeLatched(*shard, latched);
+        for (auto *frame : busy) {
+            frame->latch.lockShared();
+            std::vector<Frame*> single{ frame };
+            writeLatched(*shard, single);
+        }
+
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (auto *frame : dirty_frames) {
+            --(frame->count);
+        }
+    }
+    _drv->flush();
+}
+
+void
+CachedAccesser::trickle(Length percentage)
+{
+    bool progress = true;
+    while (progress && dirtyAbove(percentage)) {
+        progress = false;
+
+        for (auto &shard : _shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+
+            // pinned frames may be in the middle of modification
+            std::vector<Frame*> dirty_frames;
+            for (auto &frame : shard->frames) {
+                if (frame.dirty && !frame.count) {
+                    dirty_frames.push_back(&frame);
+                    if (dirty_frames.size() == TRICKLE_BATCH) {
+                        break;
+                    }
+                }
+            }
+
+            Length written = writeBack(*shard, dirty_frames);
+            shard->statistics.background_writes += written;
+            progress = progress || written;
+        }
+    }
+}
+
+void
+CachedAccesser::runFlusher()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::unique_lock<std::mutex> lock(_flusher_mutex);
+    auto last_flush = Clock::now();
+
+    while (!_flusher_stop) {
+        auto wakeup = [this]() { return _flusher_stop || dirtyAbove(_high_watermark); };
+        if (_flush_interval) {
+            _flusher_cond.wait_until(lock, last_flush + std::chrono::milliseconds(_flush_interval), wakeup);
+        }
+        else {
+            _flusher_cond.wait(lock, wakeup);
+        }
+
+        if (_flusher_stop) {
+            break;
+        }
+
+        bool periodic = _flush_interval &&
+            Clock::now() >= last_flush + std::chrono::milliseconds(_flush_interval);
+
+        // pinned frames may be in the middle of modification, and syncing the driver is
+        // left to flush()
+        lock.unlock();
+        trickle(periodic ? 0 : _low_watermark.load());
+        lock.lock();
+
+        if (periodic) {
+            last_flush = Clock::now();
+        }
+    }
+}
+
+void
+CachedAccesser::startFlusher()
+{
+    std::lock_guard<std::mutex> lock(_flusher_mutex);
+    if (_flusher_running) {
+        return;
+    }
+
+    _flusher_stop = false;
+    _flusher = std::thread(&CachedAccesser::runFlusher, this);
+    _flusher_running = true;
+}
+
+void
+CachedAccesser::stopFlusher()
+{
+    {
+        std::lock_guard<std::mutex> lock(_flusher_mutex);
+        if (!_flusher_running) {
+            return;
+        }
+
+        _flusher_stop = true;
+        _flusher_running = false;
+    }
+
+    _flusher_cond.notify_one();
+    _flusher.join();
+}
+
+void
+CachedAccesser::setDirtyWatermarks(Length high, Length low)
+{
+    assert(low <= high && high <= 100);
+
+    std::lock_guard<std::mutex> lock(_flusher_mutex);
+    _high_watermark = high;
+    _low_watermark = low;
+    _flusher_cond.notify_one();
+}
+
+void
+CachedAccesser::setFlushInterval(Length milliseconds)
+{
+    std::lock_guard<std::mutex> lock(_flusher_mutex);
+    _flush_interval = milliseconds;
+    _flusher_cond.notify_one();
+}
@@ -1,9 +1,18 @@
 #ifndef _DB_DRIVER_CACHED_ACCESSER_H_
 #define _DB_DRIVER_CACHED_ACCESSER_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <exception>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "driver-accesser.hpp"
+#include "replacement-policy.hpp"
 
 namespace cdb {
     struct CachedNotFoundException : public std::exception
@@ -18,59 +27,402 @@ namespace cdb {
         { return ("Cached for " + std::to_string(index) + " not found").c_str(); }
     };
 
+    /**
+     * Thread safe buffer pool caching blocks in frames of the block size of the driver.
+     *
+     * The pool is partitioned into shards by block index, each with its own mutex, page
+     * table and ReplacementPolicy, so threads working on different shards do not contend.
+     * Frames carry a pin count and a Latch, which a Block holds in the mode it is aquired
+     * with.
+     *
+     * Dirty frames are written back when evicted or flushed, adjacent dirty frames are
+     * written together. If every frame of a shard is pinned, extra frames are created
+     * beyond the capacity, and are released again once they are unpinned. Reading ahead
+     * on sequential misses is off by default.
+     *
+     * A background flusher may be started to write dirty frames when they exceed a high
+     * watermark of the capacity, until they drop below a low watermark, and to write all
+     * dirty frames periodically. It only writes unpinned frames and never flushes the
+     * driver. Victims are then rarely dirty when a miss needs a frame.
+     */
     class CachedAccesser : public DriverAccesser
     {
-        constexpr static Length CACHE_BLOCK_SIZE = 1024 * 1024; // 1MB
-        constexpr static Length CACHE_MAX_BLOCK_COUNT = 100;    // 100MB cache
-        constexpr static Length TOTAL_CACHED = CACHE_BLOCK_SIZE * CACHE_MAX_BLOCK_COUNT;
-        constexpr static Length BLOCK_PER_CACHE = CACHE_BLOCK_SIZE / Driver::BLOCK_SIZE;
+    public:
+        constexpr static Length CACHE_SIZE = 100 * 1024 * 1024;   // 100MB cache
+
+        /** default number of shards */
+        constexpr static Length SHARD_COUNT = 16;
+
+        /** number of consecutive blocks in the same shard, so runs can be read and written at once */
+        constexpr static Length SHARD_STRIDE = 1024;
+
+        /** default percentage of dirty frames waking the flusher */
+        constexpr static Length HIGH_WATERMARK = 50;
 
-        static constexpr BlockIndex calcTagByBlockIndex(BlockIndex index)
-        { return index / BLOCK_PER_CACHE; }
+        /** default percentage of dirty frames the flusher writes down to */
+        constexpr static Length LOW_WATERMARK = 25;
 
-        static constexpr BlockIndex calcOffsetByBlockIndex(BlockIndex index)
-        { return Driver::BLOCK_SIZE * (index % BLOCK_PER_CACHE); }
+        /** default milliseconds between periodic flushes */
+        constexpr static Length FLUSH_INTERVAL = 1000;
 
-        static constexpr BlockIndex calcIndexByTag(BlockIndex tag)
-        { return tag * BLOCK_PER_CACHE; }
+        /**
+         * Counters of the pool since created or last reset
+         */
+        struct Statistics
+        {
+            std::uint64_t hits = 0;         /** accesses found in the pool */
+            std::uint64_t misses = 0;       /** accesses read from the driver */
+            std::uint64_t evictions = 0;    /** blocks evicted to make room */
+            std::uint64_t dirty_writes = 0; /** dirty blocks written to the driver */
+            std::uint64_t overflows = 0;    /** frames created because all were pinned */
+            std::uint64_t prefetches = 0;   /** blocks read in the background */
+            std::uint64_t background_writes = 0;    /** dirty blocks written by the flusher */
+        };
 
-        struct CacheBlock
+    private:
+        /**
+         * A read filling frames, shared by all frames read together. It is finished
+         * without the mutex of the shard, by whichever thread first needs one of the
+         * frames, holding the mutex of the read so other threads wait for it. A failed
+         * read stays failed, every thread finishing it gets the error and its frames
+         * are read again when next aquired.
+         */
+        struct Read
         {
-            Length count;
-            Length accessed;
-            BlockIndex tag;
-            Buffer content;
+            std::mutex mutex;
 
-            CacheBlock(Length count, Length accessed, BlockIndex tag, Buffer &&content)
-                : count(count), accessed(accessed), tag(tag), content(std::move(content))
-            { }
+            /** request to wait, 0 if none */
+            Driver::RequestHandle handle = 0;
+
+            /** blocks still to read with readBlocksV, empty if none */
+            std::vector<BlockIndex> indices;
+            std::vector<Slice> dests;
 
-            CacheBlock(CacheBlock &&cache_block)
-                : count(cache_block.count),
-                  accessed(cache_block.accessed),
-                  tag(cache_block.tag),
-                  content(std::move(cache_block.content))
+            /** set with error once the read failed, checked without the mutex */
+            std::atomic<bool> failed{false};
+            std::exception_ptr error;
+        };
+
+        struct Frame
+        {
+            BlockIndex index;   /** index of the block cached */
+            Length count;       /** number of Blocks referring to this frame */
+            bool dirty;         /** true if modified since read */
+            Latch latch;        /** held by Blocks aquired with a latch mode */
+            Buffer content;     /** data of the block */
+
+            /** read still filling content, nullptr if none */
+            std::shared_ptr<Read> pending;
+
+            Frame(BlockIndex index, Buffer &&content)
+                : index(index), count(0), dirty(false), content(std::move(content))
             { }
         };
 
-        std::list<CacheBlock> _record;
+        typedef std::list<Frame> FrameList;
+
+        /**
+         * A partition of the pool, everything in it is guarded by its mutex except the
+         * content of frames, which is guarded by their latches
+         */
+        struct Shard
+        {
+            std::mutex mutex;
+
+            /** number of frames in the shard, may be exceeded when all are pinned */
+            Length capacity = 0;
+
+            /** the block index which would make the next miss sequential */
+            BlockIndex sequential_next = 0;
+
+            /** all frames, in no particular order */
+            FrameList frames;
+
+            /** look up frames in frames by block index */
+            std::unordered_map<BlockIndex, FrameList::iterator> frame_by_index;
+
+            /** decides which frame to evict */
+            std::unique_ptr<ReplacementPolicy> policy;
+
+            Statistics statistics;
+        };
+
+        /** number of frames in the pool */
+        std::atomic<Length> _capacity;
+
+        /** number of dirty frames in all shards */
+        std::atomic<Length> _dirty_count;
+
+        /** number of blocks to read at once on sequential misses, 0 to disable */
+        std::atomic<Length> _readahead;
+
+        std::vector<std::unique_ptr<Shard> > _shards;
+
+        /** serialize calls to the allocator */
+        std::mutex _allocator_mutex;
+
+        std::thread _flusher;
+
+        /** wakes the flusher, guards _flusher_stop and _flush_interval */
+        std::mutex _flusher_mutex;
+        std::condition_variable _flusher_cond;
+        std::atomic<bool> _flusher_running;
+        bool _flusher_stop;
+        std::atomic<Length> _high_watermark;
+        std::atomic<Length> _low_watermark;
+        Length _flush_interval;
+
+        inline Shard &shardOf(BlockIndex index)
+        { return *_shards[(index / SHARD_STRIDE) % _shards.size()]; }
 
-        std::list<CacheBlock>::iterator findRecordByBlockIndexAndIncCount(BlockIndex index);
-        std::list<CacheBlock>::iterator findRecordByBlockIndexOnly(BlockIndex index);
+        FrameList::iterator findFrameAndIncCount(Shard &shard, BlockIndex index);
+        FrameList::iterator findFrameOnly(Shard &shard, BlockIndex index);
+
+        /**
+         * Check the read filling a frame without blocking, forgetting it once finished.
+         * Frames of a failed read are settled but keep the read, so they are not served.
+         *
+         * @param frame the frame, its shard locked
+         * @return true if no read is filling the frame
+         */
+        bool settled(Frame &frame);
+
+        /**
+         * Finish a read, waiting for it if another thread is finishing it. Must be
+         * called without the mutex of the shard.
+         *
+         * @param read the read
+         * @throw the error of the driver if the read failed, now or before
+         */
+        void finishRead(Read &read);
+
+        /**
+         * Find an unpinned frame to evict, chosen by the replacement policy
+         *
+         * @param shard the shard to search, locked
+         * @param frame [out] the frame found
+         * @return false if all frames are pinned or still being read
+         */
+        bool findVictim(Shard &shard, FrameList::iterator &frame);
+
+        /**
+         * Write back a frame if dirty, and forget the block it holds
+         *
+         * @param shard the shard of the frame, locked
+         * @param frame the frame to evict
+         */
+        void evictFrame(Shard &shard, FrameList::iterator frame);
+
+        /**
+         * Evict and free unpinned frames until the shard is no larger than its capacity
+         *
+         * @param shard the shard to shrink, locked
+         */
+        void shrink(Shard &shard);
+
+        /**
+         * Get a frame not holding any block, evicting an unpinned frame chosen by the
+         * replacement policy if the shard is full.
+         *
+         * @param shard the shard to get from, locked
+         * @param frame [out] the frame got
+         * @param overflow create a frame beyond the capacity if all frames are pinned
+         * @return false if all frames are pinned and overflow is false
+         */
+        bool obtainFrame(Shard &shard, FrameList::iterator &frame, bool overflow);
+
+        /**
+         * Assign frames to a missing block, together with following blocks of the same
+         * shard if the miss is sequential. The frames are returned pinned.
+         *
+         * @param shard the shard of the block, locked
+         * @param index index of the missing block
+         * @param overflow let the missing block overflow the shard
+         * @param indices [out] blocks assigned
+         * @param dests [out] content of the frames
+         * @param frames [out] frames assigned, the first holds the missing block
+         */
+        void assignFrames(
+                Shard &shard,
+                BlockIndex index,
+                bool overflow,
+                std::vector<BlockIndex> &indices,
+                std::vector<Slice> &dests,
+                std::vector<FrameList::iterator> &frames
+            );
+
+        /**
+         * Assign frames to a missing block, together with following blocks of the same
+         * shard if the miss is sequential. The frames share a pending read, which the
+         * caller finishes after unlocking the shard.
+         *
+         * @param shard the shard of the block, locked
+         * @param index index of the missing block
+         * @return the frame holding the block
+         */
+        FrameList::iterator readFrames(Shard &shard, BlockIndex index);
+
+        /**
+         * Write dirty frames to the driver, adjacent blocks are written with one
+         * writeBlocksV
+         *
+         * @param shard the shard of the frames, locked
+         * @param frames frames to write back
+         * @return number of blocks written
+         */
+        Length writeBack(Shard &shard, std::vector<Frame*> &frames);
+
+        /**
+         * Write dirty frames to the driver without the mutex of the shard, then give
+         * back their latches
+         *
+         * @param shard the shard of the frames, unlocked
+         * @param frames frames to write back, pinned and latched in shared mode
+         */
+        void writeLatched(Shard &shard, std::vector<Frame*> &frames);
+
+        /**
+         * @param percentage watermark in percentage of the capacity
+         * @return true if dirty frames exceed the watermark
+         */
+        inline bool dirtyAbove(Length percentage) const
+        { return static_cast<std::uint64_t>(_dirty_count) * 100 > static_cast<std::uint64_t>(_capacity) * percentage; }
+
+        /**
+         * Write back unpinned dirty frames in all shards until below a watermark
+         *
+         * @param percentage watermark in percentage of the capacity, 0 to write all
+         */
+        void trickle(Length percentage);
+
+        /** Body of the flusher thread */
+        void runFlusher();
 
     protected:
-        virtual void release(BlockIndex block, bool dirty = true);
-        virtual Slice access(BlockIndex index);
+        virtual void release(BlockIndex block, bool dirty, Latch::Mode latch);
+        virtual Slice access(BlockIndex index, Latch::Mode latch);
 
     public:
-        CachedAccesser(Driver *drv, BlockAllocator *allocator)
-            : DriverAccesser(drv, allocator)
-        { }
+        /**
+         * @param drv the driver to read from and write to, must be thread safe
+         * @param allocator the allocator
+         * @param policy replacement policy, owned by the accesser. LRU if nullptr.
+         *      Each shard gets a policy of the same kind.
+         * @param shard_count number of shards
+         */
+        CachedAccesser(
+                Driver *drv,
+                BlockAllocator *allocator,
+                ReplacementPolicy *policy = nullptr,
+                Length shard_count = SHARD_COUNT
+            );
+
+        /**
+         * Write back all dirty blocks, errors are swallowed. Owners that need to know
+         * whether the blocks reached the driver must call flush() before.
+         */
+        virtual ~CachedAccesser();
 
-        virtual ~CachedAccesser() = default;
+        /**
+         * Set the number of blocks read at once when a miss follows the previous miss
+         * in the same shard, such as scanning the leaves of a B+ tree allocated in order
+         *
+         * @param readahead number of blocks, 0 or 1 to disable
+         */
+        void setReadahead(Length readahead);
+
+        /**
+         * @return number of blocks read on sequential misses
+         */
+        inline Length readahead() const
+        { return _readahead; }
+
+        /**
+         * @return number of frames in the pool
+         */
+        inline Length capacity() const
+        { return _capacity; }
+
+        /**
+         * Resize the pool, unpinned frames beyond the new capacity are evicted at once,
+         * pinned ones once they are released. The capacity is divided among shards.
+         *
+         * @param capacity number of frames, at least 1
+         */
+        void setCapacity(Length capacity);
+
+        /**
+         * @return number of shards
+         */
+        inline Length shardCount() const
+        { return _shards.size(); }
+
+        /**
+         * @return number of frames currently allocated
+         */
+        Length size();
+
+        /**
+         * @return counters summed over all shards
+         */
+        Statistics statistics();
+
+        void resetStatistics();
+
+        /**
+         * @return number of dirty frames
+         */
+        inline Length dirtyCount() const
+        { return _dirty_count; }
+
+        /**
+         * Start the background flusher, does nothing if already running
+         */
+        void startFlusher();
+
+        /**
+         * Stop the background flusher and wait for it, does nothing if not running
+         */
+        void stopFlusher();
+
+        inline bool flusherRunning() const
+        { return _flusher_running; }
+
+        /**
+         * Set when the flusher writes dirty frames, effective at once
+         *
+         * @param high percentage of dirty frames in the capacity waking the flusher
+         * @param low percentage of dirty frames the flusher writes down to
+         */
+        void setDirtyWatermarks(Length high, Length low);
+
+        /**
+         * Set the period of writing back all unpinned dirty frames by the flusher,
+         * effective at once
+         *
+         * @param milliseconds time between writes, 0 to disable
+         */
+        void setFlushInterval(Length milliseconds);
 
         virtual BlockIndex allocateBlocks(Length length, BlockIndex hint = 0);
         virtual void freeBlocks(BlockIndex index, Length length);
+
+        /**
+         * Start reading a missing block with readBlocksAsync of the driver, together with
+         * following blocks if the readahead is set and the hint is sequential. A later
+         * aquire only waits for the read to finish. Never evicts pinned frames or
+         * overflows the pool.
+         *
+         * @param index index of the block
+         */
+        virtual void prefetch(BlockIndex index);
+
+        /**
+         * Write back all dirty blocks, then flush the driver. Dirty blocks latched
+         * exclusively are written once their writer releases them, so a Block modified
+         * while another thread flushes must be aquired with Latch::Mode::EXCLUSIVE. Must
+         * not be called while holding a latch.
+         */
         virtual void flush();
     };
 
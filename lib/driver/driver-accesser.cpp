@@ -19,12 +19,13 @@ Block::operator = (Block &&block)
     assert(this != &block);
 
     if (_index != std::numeric_limits<BlockIndex>::max()) {
-        _owner->release(_index, _dirty);
+        _owner->release(_index, _dirty, _latch);
     }
 
     _owner = block._owner;
     _index = block._index;
     _slice = block._slice;
+    _latch = block._latch;
     _dirty = block._dirty;
     block._index = std::numeric_limits<BlockIndex>::max();
     return *this;
@@ -33,7 +34,7 @@ Block::operator = (Block &&block)
 Block::~Block()
 {
     if (_index != std::numeric_limits<BlockIndex>::max()) {
-        _owner->release(_index, _dirty);
+        _owner->release(_index, _dirty, _latch);
     }
 }
 
@@ -2,6 +2,7 @@
 #define _DB_DRIVER_DRIVER_ACCESSER_H_
 
 #include "lib/utils/slice.hpp"
+#include "lib/utils/latch.hpp"
 
 #include <limits>
 #include "driver.hpp"
@@ -11,26 +12,34 @@ namespace cdb {
 
     class DriverAccesser;
 
+    /**
+     * A block pinned in a DriverAccesser, released when destructed.
+     *
+     * A Block may hold the latch of its page in shared or exclusive mode, given when
+     * aquired and given back when released.
+     */
     class Block
     {
         DriverAccesser *_owner;
         BlockIndex _index;
         Slice _slice;
+        Latch::Mode _latch;
         mutable bool _dirty = false;
 
-        Block(DriverAccesser *owner, BlockIndex index, Slice slice)
-            : _owner(owner), _index(index), _slice(slice)
+        Block(DriverAccesser *owner, BlockIndex index, Slice slice, Latch::Mode latch)
+            : _owner(owner), _index(index), _slice(slice), _latch(latch)
         { }
 
         friend class DriverAccesser;
     public:
         Block(Block &&block)
-            : _owner(block._owner), _index(block._index), _slice(block._slice), _dirty(block._dirty)
+            : _owner(block._owner), _index(block._index), _slice(block._slice), _latch(block._latch),
+              _dirty(block._dirty)
         { block._index = std::numeric_limits<BlockIndex>::max(); }
 
         Block &operator = (Block &&block);
 
-        // copying means aquire again
+        // copying means aquire again, without taking the latch
         Block(const Block &block);
         Block &operator = (const Block &block);
 
@@ -40,6 +49,10 @@ namespace cdb {
         index() const
         { return _index; }
 
+        inline Latch::Mode
+        latch() const
+        { return _latch; }
+
         inline ConstSlice
         constSlice() const
         { return _slice; }
@@ -106,8 +119,23 @@ namespace cdb {
         Driver *_drv;
         BlockAllocator *_allocator;
 
-        virtual void release(BlockIndex block, bool dirty = true) = 0;
-        virtual Slice access(BlockIndex index) = 0;
+        /**
+         * Unpin a block, giving back its latch
+         *
+         * @param block index of the block
+         * @param dirty true if the block is modified
+         * @param latch mode the latch was taken in access
+         */
+        virtual void release(BlockIndex block, bool dirty, Latch::Mode latch) = 0;
+
+        /**
+         * Pin a block, then take its latch
+         *
+         * @param index index of the block
+         * @param latch mode to take the latch in
+         * @return content of the block
+         */
+        virtual Slice access(BlockIndex index, Latch::Mode latch) = 0;
 
         friend class Block;
 
@@ -116,8 +144,18 @@ namespace cdb {
 
         virtual ~DriverAccesser() = default;
 
-        inline Block aquire(BlockIndex index)
-        { return Block(this, index, access(index)); }
+        /**
+         * Pin a block until the Block returned is destructed
+         *
+         * @param index index of the block
+         * @param latch mode to latch the block in, only CachedAccesser supports latches
+         * @return the Block
+         */
+        inline Block aquire(BlockIndex index, Latch::Mode latch = Latch::Mode::NONE)
+        { return Block(this, index, access(index, latch), latch); }
+
+        inline Length blockSize() const
+        { return _drv->blockSize(); }
 
         virtual BlockIndex allocateBlock(BlockIndex hint = 0);
         virtual BlockIndex allocateBlocks(Length length, BlockIndex hint = 0) = 0;
@@ -125,6 +163,15 @@ namespace cdb {
         virtual void freeBlock(BlockIndex index);
         virtual void freeBlocks(BlockIndex index, Length length) = 0;
 
+        /**
+         * Hint that a block is going to be aquired soon, so it may be read in the
+         * background. Does nothing by default.
+         *
+         * @param index index of the block
+         */
+        virtual void prefetch(BlockIndex)
+        { }
+
         virtual void flush() = 0;
     };
 
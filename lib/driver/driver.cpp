@@ -1,19 +1,31 @@
+#include <algorithm>
 #include <cassert>
+#include <type_traits>
+#include <vector>
 
 #include "driver.hpp"
 
 using namespace cdb;
 
+void
+Driver::setBlockSize(Length block_size)
+{
+    assert(block_size >= BLOCK_SIZE && block_size <= MAX_BLOCK_SIZE);
+    assert(!(block_size & (block_size - 1)));
+
+    _block_size = block_size;
+}
+
 void
 Driver::readBlocks(BlockIndex index, Length count, Slice dest)
 {
     while (count) {
-        assert(dest.length() >= BLOCK_SIZE);
+        assert(dest.length() >= _block_size);
 
         readBlock(index, dest);
         ++index;
         --count;
-        dest = dest.subSlice(BLOCK_SIZE);
+        dest = dest.subSlice(_block_size);
     }
 }
 
@@ -21,11 +33,112 @@ void
 Driver::writeBlocks(BlockIndex index, Length count, ConstSlice dest)
 {
     while (count) {
-        assert(dest.length() >= BLOCK_SIZE);
+        assert(dest.length() >= _block_size);
 
         writeBlock(index, dest);
         ++index;
         --count;
-        dest = dest.subSlice(BLOCK_SIZE);
+        dest = dest.subSlice(_block_size);
+    }
+}
+
+/**
+ * Sort a batch of block requests by index and call `run' on each run of contiguous
+ * indices, along with the slices belonging to the run, in the same order
+ */
+template <typename T, typename Func>
+static void
+forEachRun(const BlockIndex *indices, Length count, T *slices, Func run)
+{
+    if (!count) {
+        return;
+    }
+
+    std::vector<Length> order(count);
+    for (Length i = 0; i < count; ++i) {
+        order[i] = i;
     }
+
+    if (!std::is_sorted(indices, indices + count)) {
+        std::stable_sort(order.begin(), order.end(),
+                [&](Length a, Length b)
+                {
+                    return indices[a] < indices[b];
+                }
+            );
+    }
+
+    std::vector<typename std::remove_const<T>::type> sorted;
+    sorted.reserve(count);
+    for (auto i : order) {
+        sorted.push_back(slices[i]);
+    }
+
+    Length start = 0;
+    for (Length i = 1; i <= count; ++i) {
+        if (i == count || indices[order[i]] != indices[order[i - 1]] + 1) {
+            run(indices[order[start]], i - start, sorted.data() + start);
+            start = i;
+        }
+    }
+}
+
+void
+Driver::readBlocksV(const BlockIndex *indices, Length count, Slice *dests)
+{
+    forEachRun(indices, count, dests,
+            [this](BlockIndex index, Length run, Slice *run_dests)
+            {
+                readBlocksScattered(index, run, run_dests);
+            }
+        );
+}
+
+void
+Driver::writeBlocksV(const BlockIndex *indices, Length count, const ConstSlice *srcs)
+{
+    forEachRun(indices, count, srcs,
+            [this](BlockIndex index, Length run, const ConstSlice *run_srcs)
+            {
+                writeBlocksGathered(index, run, run_srcs);
+            }
+        );
+}
+
+void
+Driver::readBlocksScattered(BlockIndex index, Length count, Slice *dests)
+{
+    Length start = 0;
+    for (Length i = 1; i <= count; ++i) {
+        if (i == count || dests[i].content() != dests[i - 1].content() + _block_size) {
+            readBlocks(index + start, i - start, Slice(dests[start].content(), (i - start) * _block_size));
+            start = i;
+        }
+    }
+}
+
+void
+Driver::writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+{
+    Length start = 0;
+    for (Length i = 1; i <= count; ++i) {
+        if (i == count || srcs[i].content() != srcs[i - 1].content() + _block_size) {
+            writeBlocks(index + start, i - start, ConstSlice(srcs[start].content(), (i - start) * _block_size));
+            start = i;
+        }
+    }
+}
+
+Driver::RequestHandle
+Driver::readBlocksAsync(const BlockIndex *indices, Length count, Slice *dests)
+{
+    readBlocksV(indices, count, dests);
+    return 0;
+}
+
+Driver::RequestHandle
+Driver::writeBlocksAsync(const BlockIndex *indices, Length count, const ConstSlice *srcs)
+{
+    writeBlocksV(indices, count, srcs);
+    return 0;
 }
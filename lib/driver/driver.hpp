@@ -15,12 +15,41 @@ namespace cdb {
     {
     public:
         /**
-         * Minimum unit to operate with
+         * Default size of the minimum unit to operate with
+         *
+         * @see blockSize()
          */
         static const Length BLOCK_SIZE = 1024;
 
+        /** Largest block size supported */
+        static const Length MAX_BLOCK_SIZE = 64 * 1024;
+
+        /**
+         * Handle of an asynchronous request, 0 means the request is already finished
+         *
+         * @see readBlocksAsync
+         * @see writeBlocksAsync
+         */
+        typedef std::uint64_t RequestHandle;
+
         virtual ~Driver() = default;
 
+        /**
+         * Size of the minimum unit to operate with, BLOCK_SIZE unless changed
+         *
+         * @return size of each block in bytes
+         */
+        Length blockSize() const
+        { return _block_size; }
+
+        /**
+         * Change the size of blocks, should be called before any block is accessed
+         *
+         * @param block_size new size of each block, a power of 2 between BLOCK_SIZE and
+         *                   MAX_BLOCK_SIZE
+         */
+        virtual void setBlockSize(Length block_size);
+
         /**
          * read a single block from external storage
          *
@@ -59,10 +88,142 @@ namespace cdb {
          */
         virtual void writeBlocks(BlockIndex index, Length count, ConstSlice src);
 
+        /**
+         * read a set of blocks, indices are not necessarily contiguous or sorted
+         *
+         * Indices are sorted and adjacent ones are coalesced, each run of contiguous blocks
+         * is then read with readBlocksScattered.
+         *
+         * @param indices indices of blocks to read
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         * @see readBlocksScattered(BlockIndex index, Length count, Slice *dests)
+         */
+        virtual void readBlocksV(const BlockIndex *indices, Length count, Slice *dests);
+
+        /**
+         * write a set of blocks, indices are not necessarily contiguous or sorted
+         *
+         * Indices are sorted and adjacent ones are coalesced, each run of contiguous blocks
+         * is then written with writeBlocksGathered.
+         *
+         * @param indices indices of blocks to write to
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         * @see writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+         */
+        virtual void writeBlocksV(const BlockIndex *indices, Length count, const ConstSlice *srcs);
+
+        /**
+         * Alignment required for memory address, offset and length of efficient I/O
+         *
+         * Buffers used for large reads and writes should be allocated with this alignment,
+         * @see Buffer::Aligned(Length length, Length alignment)
+         *
+         * @return the alignment, 1 means no requirement
+         */
+        virtual Length ioAlignment() const
+        { return 1; }
+
+        /**
+         * Hint the driver that the first `count' blocks are going to be used, so it can
+         * prepare the space in one step. Do nothing by default.
+         *
+         * @param count number of blocks to be used
+         */
+        virtual void reserveBlocks(Length)
+        { }
+
+        /**
+         * Cut the storage down to its first `count' blocks, the blocks after them are
+         * discarded. Do nothing by default.
+         *
+         * @param count number of blocks to keep
+         */
+        virtual void truncateBlocks(Length)
+        { }
+
+        /**
+         * Start reading a batch of blocks, indices are not necessarily contiguous
+         *
+         * Each dest must be kept valid until the request is finished. Drivers which
+         * cannot perform asynchronous I/O read all blocks before returning, which is
+         * the default behavior.
+         *
+         * @param indices indices of blocks to read
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         * @return handle of the request
+         * @see wait(RequestHandle handle)
+         */
+        virtual RequestHandle readBlocksAsync(const BlockIndex *indices, Length count, Slice *dests);
+
+        /**
+         * Start writing a batch of blocks, indices are not necessarily contiguous
+         *
+         * Each src must be kept valid until the request is finished. Drivers which
+         * cannot perform asynchronous I/O write all blocks before returning, which is
+         * the default behavior.
+         *
+         * @param indices indices of blocks to write to
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         * @return handle of the request
+         * @see wait(RequestHandle handle)
+         */
+        virtual RequestHandle writeBlocksAsync(const BlockIndex *indices, Length count, const ConstSlice *srcs);
+
+        /**
+         * Check whether an asynchronous request is finished, without blocking
+         *
+         * @param handle the handle of request
+         * @return true if finished
+         */
+        virtual bool finished(RequestHandle)
+        { return true; }
+
+        /**
+         * Block until an asynchronous request is finished
+         *
+         * Every handle returned must be waited exactly once.
+         *
+         * @param handle the handle of request
+         */
+        virtual void wait(RequestHandle)
+        { }
+
         /**
          * Flush content to disk, immediately
          */
         virtual void flush() = 0;
+
+    protected:
+        /** size of each block, @see blockSize() */
+        Length _block_size = BLOCK_SIZE;
+
+        /**
+         * read a run of contiguous blocks into separate pieces of memory
+         *
+         * By default, blocks whose dests are also contiguous in memory are read with a
+         * single readBlocks.
+         *
+         * @param index the index of first block to read
+         * @param count the count of blocks to read
+         * @param dests where each block reads to
+         */
+        virtual void readBlocksScattered(BlockIndex index, Length count, Slice *dests);
+
+        /**
+         * write a run of contiguous blocks from separate pieces of memory
+         *
+         * By default, blocks whose srcs are also contiguous in memory are written with a
+         * single writeBlocks.
+         *
+         * @param index the index of first block to write to
+         * @param count the count of blocks to write
+         * @param srcs data of each block
+         */
+        virtual void writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs);
     };
 }
 
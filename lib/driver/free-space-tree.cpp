@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cassert>
+
+#include "free-space-tree.hpp"
+
+using namespace cdb;
+
+FreeSpaceTree::Summary
+FreeSpaceTree::Summary::combine(const Summary &left, const Summary &right)
+{
+    Summary ret;
+    ret.width = left.width + right.width;
+    ret.prefix = left.prefix == left.width ? left.width + right.prefix : left.prefix;
+    ret.suffix = right.suffix == right.width ? right.width + left.suffix : right.suffix;
+    ret.best = std::max(std::max(left.best, right.best), left.suffix + right.prefix);
+    ret.unit_max = std::max(left.unit_max, right.unit_max);
+    return ret;
+}
+
+FreeSpaceTree::FreeSpaceTree(Length section_width)
+    : _section_width(section_width), _size(0), _capacity(1)
+{ _nodes.assign(_capacity * 2, full()); }
+
+FreeSpaceTree::Summary
+FreeSpaceTree::full() const
+{
+    Summary ret;
+    ret.width = _section_width;
+    return ret;
+}
+
+void
+FreeSpaceTree::resize(Length size)
+{
+    if (size < _size) {
+        for (Length section = size; section < _size; ++section) {
+            update(section, full());
+        }
+        _size = size;
+        return;
+    }
+
+    if (size <= _capacity) {
+        _size = size;
+        return;
+    }
+
+    Length old_capacity = _capacity;
+    while (_capacity < size) {
+        _capacity *= 2;
+    }
+
+    // keep the summaries of existing sections
+    std::vector<Summary> leaves(_nodes.begin() + old_capacity, _nodes.begin() + old_capacity + _size);
+    _size = size;
+    _nodes.assign(_capacity * 2, full());
+    std::copy(leaves.begin(), leaves.end(), _nodes.begin() + _capacity);
+
+    for (Length i = _capacity - 1; i; --i) {
+        _nodes[i] = Summary::combine(_nodes[i * 2], _nodes[i * 2 + 1]);
+    }
+}
+
+void
+FreeSpaceTree::update(Length section, const Summary &summary)
+{
+    assert(section < _size);
+
+    Length node = _capacity + section;
+    _nodes[node] = summary;
+    for (node /= 2; node; node /= 2) {
+        _nodes[node] = Summary::combine(_nodes[node * 2], _nodes[node * 2 + 1]);
+    }
+}
+
+bool
+FreeSpaceTree::firstFit(Length node, Length lo, Length hi, Length from, Length to, Length length, Length &section) const
+{
+    if (hi <= from || lo >= to || _nodes[node].unit_max < length) {
+        return false;
+    }
+    if (hi - lo == 1) {
+        section = lo;
+        return true;
+    }
+
+    Length mid = (lo + hi) / 2;
+    return firstFit(node * 2, lo, mid, from, to, length, section) ||
+        firstFit(node * 2 + 1, mid, hi, from, to, length, section);
+}
+
+bool
+FreeSpaceTree::firstFit(Length from, Length to, Length length, Length &section) const
+{ return firstFit(1, 0, _capacity, from, std::min(to, _size), length, section); }
+
+bool
+FreeSpaceTree::lastFit(Length node, Length lo, Length hi, Length from, Length to, Length length, Length &section) const
+{
+    if (hi <= from || lo >= to || _nodes[node].unit_max < length) {
+        return false;
+    }
+    if (hi - lo == 1) {
+        section = lo;
+        return true;
+    }
+
+    Length mid = (lo + hi) / 2;
+    return lastFit(node * 2 + 1, mid, hi, from, to, length, section) ||
+        lastFit(node * 2, lo, mid, from, to, length, section);
+}
+
+bool
+FreeSpaceTree::lastFit(Length from, Length to, Length length, Length &section) const
+{ return lastFit(1, 0, _capacity, from, std::min(to, _size), length, section); }
+
+bool
+FreeSpaceTree::firstRun(
+        Length node,
+        Length lo,
+        Length hi,
+        Length from,
+        Length to,
+        Length length,
+        Length &carry,
+        BlockIndex &carry_start,
+        Length &section,
+        BlockIndex &start
+    ) const
+{
+    if (hi <= from || lo >= to) {
+        return false;
+    }
+
+    auto &summary = _nodes[node];
+    if (from <= lo && hi <= to) {
+        if (!carry) {
+            carry_start = lo * _section_width;
+        }
+
+        if (carry + summary.prefix >= length) {
+            section = _size;
+            start = carry_start;
+            return true;
+        }
+
+        if (summary.best < length) {
+            // nothing here, only the run at the end may continue
+            if (summary.prefix == summary.width) {
+                carry += summary.width;
+            }
+            else {
+                carry = summary.suffix;
+                carry_start = hi * _section_width - summary.suffix;
+            }
+            return false;
+        }
+
+        if (hi - lo == 1) {
+            section = lo;
+            return true;
+        }
+    }
+
+    Length mid = (lo + hi) / 2;
+    return firstRun(node * 2, lo, mid, from, to, length, carry, carry_start, section, start) ||
+        firstRun(node * 2 + 1, mid, hi, from, to, length, carry, carry_start, section, start);
+}
+
+bool
+FreeSpaceTree::firstRun(
+        Length from,
+        Length length,
+        Length carry,
+        BlockIndex carry_start,
+        Length &section,
+        BlockIndex &start
+    ) const
+{ return firstRun(1, 0, _capacity, from, _size, length, carry, carry_start, section, start); }
@@ -0,0 +1,152 @@
+#ifndef _DB_DRIVER_FREE_SPACE_TREE_H_
+#define _DB_DRIVER_FREE_SPACE_TREE_H_
+
+#include <vector>
+
+#include "driver.hpp"
+
+namespace cdb {
+    /**
+     * Segment tree summarizing free blocks of equally sized sections, so an allocator
+     * can jump to a section able to satisfy a request in O(log n) instead of trying
+     * every section.
+     *
+     * Free blocks are counted in runs as BitmapAllocator allocates them: a run is made
+     * of the leading free bits of an operation unit, following empty units, and the
+     * trailing free bits of the next unit. Free bits in the middle of a unit are not
+     * counted. Each node keeps the runs at both of its ends, so runs crossing sections
+     * are found as well.
+     */
+    class FreeSpaceTree
+    {
+    public:
+        /**
+         * Free space of a section, or of a range of sections
+         */
+        struct Summary
+        {
+            Length width = 0;       /** number of blocks covered */
+            Length prefix = 0;      /** free blocks at the beginning */
+            Length suffix = 0;      /** free blocks at the end */
+            Length best = 0;        /** longest run of free blocks */
+            Length unit_max = 0;    /** most free blocks at the end of one operation unit */
+
+            /**
+             * @param left summary of a range
+             * @param right summary of the range right after
+             * @return summary of both ranges
+             */
+            static Summary combine(const Summary &left, const Summary &right);
+        };
+
+    private:
+        /** number of blocks in a section */
+        Length _section_width;
+
+        /** number of sections */
+        Length _size;
+
+        /** number of leaves, a power of 2 */
+        Length _capacity;
+
+        /** nodes of a complete binary tree, the root at 1, leaves from _capacity */
+        std::vector<Summary> _nodes;
+
+        /** summary of a section without free blocks */
+        Summary full() const;
+
+        bool firstFit(Length node, Length lo, Length hi, Length from, Length to, Length length, Length &section) const;
+        bool lastFit(Length node, Length lo, Length hi, Length from, Length to, Length length, Length &section) const;
+
+        bool firstRun(
+                Length node,
+                Length lo,
+                Length hi,
+                Length from,
+                Length to,
+                Length length,
+                Length &carry,
+                BlockIndex &carry_start,
+                Length &section,
+                BlockIndex &start
+            ) const;
+
+    public:
+        /**
+         * @param section_width number of blocks in a section
+         */
+        FreeSpaceTree(Length section_width);
+
+        /**
+         * Set the number of sections, new sections have no free blocks until updated,
+         * sections dropped are no longer found
+         *
+         * @param size number of sections
+         */
+        void resize(Length size);
+
+        inline Length size() const
+        { return _size; }
+
+        /**
+         * @param section index of the section
+         * @param summary free space of the section
+         */
+        void update(Length section, const Summary &summary);
+
+        /**
+         * @param section index of the section
+         * @return free space of the section
+         */
+        inline const Summary &at(Length section) const
+        { return _nodes[_capacity + section]; }
+
+        /**
+         * @return free space of all sections
+         */
+        inline const Summary &root() const
+        { return _nodes[1]; }
+
+        /**
+         * Find the first section with an operation unit ending in enough free blocks
+         *
+         * @param from index of the first section to search
+         * @param to index of the section to stop at
+         * @param length number of free blocks required
+         * @param section [out] the section found
+         * @return false if not found
+         */
+        bool firstFit(Length from, Length to, Length length, Length &section) const;
+
+        /**
+         * Find the last section with an operation unit ending in enough free blocks
+         *
+         * @see firstFit
+         */
+        bool lastFit(Length from, Length to, Length length, Length &section) const;
+
+        /**
+         * Find the first run of enough free blocks starting at or after a section. The run
+         * may continue a run of free blocks ending right before the section.
+         *
+         * @param from index of the first section to search
+         * @param length number of free blocks required
+         * @param carry length of the run ending right before section from
+         * @param carry_start index of the first block of that run
+         * @param section [out] size() if the start of the run is known, otherwise the
+         *      run lies inside this section, which has to be searched from its beginning
+         * @param start [out] index of the first block of the run, if known
+         * @return false if not found
+         */
+        bool firstRun(
+                Length from,
+                Length length,
+                Length carry,
+                BlockIndex carry_start,
+                Length &section,
+                BlockIndex &start
+            ) const;
+    };
+}
+
+#endif // _DB_DRIVER_FREE_SPACE_TREE_H_
@@ -0,0 +1,29 @@
+#include "mmap-accesser.hpp"
+
+using namespace cdb;
+
+using cdb::BlockIndex;
+
+MmapAccesser::MmapAccesser(MmapDriver *drv, BlockAllocator *allocator)
+    : DriverAccesser(drv, allocator), _mmap(drv)
+{ }
+
+Slice
+MmapAccesser::access(BlockIndex index, Latch::Mode)
+{ return _mmap->mapBlock(index); }
+
+void
+MmapAccesser::release(BlockIndex, bool, Latch::Mode)
+{ }
+
+BlockIndex
+MmapAccesser::allocateBlocks(Length length, BlockIndex hint)
+{ return _allocator->allocateBlocks(length, hint); }
+
+void
+MmapAccesser::freeBlocks(BlockIndex index, Length length)
+{ _allocator->freeBlocks(index, length); }
+
+void
+MmapAccesser::flush()
+{ _mmap->flush(); }
@@ -0,0 +1,34 @@
+#ifndef _DB_DRIVER_MMAP_ACCESSER_H_
+#define _DB_DRIVER_MMAP_ACCESSER_H_
+
+#include "driver-accesser.hpp"
+#include "mmap-driver.hpp"
+
+namespace cdb {
+
+    /**
+     * Accesser on top of a MmapDriver.
+     *
+     * Blocks are handed out as Slices directly into the mapping, so no Buffer is 
+     * allocated and nothing is copied when aquiring or releasing a block. Caching is 
+     * left to the page cache of the OS. Latches are not supported.
+     */
+    class MmapAccesser : public DriverAccesser
+    {
+        MmapDriver *_mmap;
+
+        virtual Slice access(BlockIndex index, Latch::Mode);
+        virtual void release(BlockIndex index, bool, Latch::Mode);
+    public:
+        MmapAccesser(MmapDriver *drv, BlockAllocator *allocator);
+
+        virtual ~MmapAccesser() = default;
+
+        virtual BlockIndex allocateBlocks(Length length, BlockIndex hint = 0);
+        virtual void freeBlocks(BlockIndex index, Length length);
+
+        virtual void flush();
+    };
+}
+
+#endif // _DB_DRIVER_MMAP_ACCESSER_H_
@@ -0,0 +1,179 @@
+#include <cassert>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mmap-driver.hpp"
+
+using namespace cdb;
+
+using cdb::Byte;
+using cdb::Length;
+
+constexpr std::size_t MmapDriver::MAX_MAPPING_SIZE;
+constexpr std::size_t MmapDriver::GROW_CHUNK;
+
+MmapDriver::MmapDriver(const char *path)
+    : _fd(::open(path, O_RDWR | O_CREAT, 0644)),
+      _base(nullptr),
+      _mapped(0)
+{
+    if (_fd < 0) {
+        throw MmapDriverIOException();
+    }
+
+    // reserve the address space only, nothing is accessible before mapping the file
+    void *reserved = ::mmap(
+            nullptr,
+            MAX_MAPPING_SIZE,
+            PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+            -1,
+            0
+        );
+    if (reserved == MAP_FAILED) {
+        ::close(_fd);
+        throw MmapDriverIOException();
+    }
+    _base = reinterpret_cast<Byte*>(reserved);
+
+    struct stat st;
+    if (::fstat(_fd, &st) == 0 && st.st_size) {
+        ensureMapped(static_cast<std::size_t>(st.st_size));
+    }
+}
+
+MmapDriver::~MmapDriver()
+{
+    ::munmap(_base, MAX_MAPPING_SIZE);
+    ::close(_fd);
+}
+
+void
+MmapDriver::ensureMapped(std::size_t limit)
+{
+    if (limit <= _mapped.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(_grow_mutex);
+
+    std::size_t mapped = _mapped.load(std::memory_order_relaxed);
+    if (limit <= mapped) {
+        return;
+    }
+    if (limit > MAX_MAPPING_SIZE) {
+        throw MmapDriverIOException();
+    }
+
+    std::size_t new_size = (limit + GROW_CHUNK - 1) / GROW_CHUNK * GROW_CHUNK;
+    new_size = std::min(new_size, MAX_MAPPING_SIZE);
+
+    struct stat st;
+    if (::fstat(_fd, &st) != 0) {
+        throw MmapDriverIOException();
+    }
+    if (static_cast<std::size_t>(st.st_size) < new_size &&
+            ::ftruncate(_fd, static_cast<off_t>(new_size)) != 0) {
+        throw MmapDriverIOException();
+    }
+
+    void *ret = ::mmap(
+            _base + mapped,
+            new_size - mapped,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED,
+            _fd,
+            static_cast<off_t>(mapped)
+        );
+    if (ret == MAP_FAILED) {
+        throw MmapDriverIOException();
+    }
+
+    _mapped.store(new_size, std::memory_order_release);
+}
+
+void
+MmapDriver::readBlocks(BlockIndex index, Length count, Slice dest)
+{
+    assert(dest.length() >= _block_size * count);
+
+    std::size_t offset = static_cast<std::size_t>(index) * _block_size;
+    std::size_t length = static_cast<std::size_t>(count) * _block_size;
+    std::size_t mapped = _mapped.load(std::memory_order_acquire);
+    std::size_t available = offset < mapped ? std::min(length, mapped - offset) : 0;
+
+    if (available) {
+        std::memcpy(dest.content(), _base + offset, available);
+    }
+    if (available < length) {
+        std::fill(dest.content() + available, dest.content() + length, 0);
+    }
+}
+
+void
+MmapDriver::writeBlocks(BlockIndex index, Length count, ConstSlice src)
+{
+    assert(src.length() >= _block_size * count);
+
+    std::size_t offset = static_cast<std::size_t>(index) * _block_size;
+    std::size_t length = static_cast<std::size_t>(count) * _block_size;
+
+    ensureMapped(offset + length);
+    std::memcpy(_base + offset, src.content(), length);
+}
+
+void
+MmapDriver::reserveBlocks(Length count)
+{ ensureMapped(static_cast<std::size_t>(count) * _block_size); }
+
+void
+MmapDriver::truncateBlocks(Length count)
+{
+    std::lock_guard<std::mutex> guard(_grow_mutex);
+
+    std::size_t mapped = _mapped.load(std::memory_order_relaxed);
+    std::size_t limit = static_cast<std::size_t>(count) * _block_size;
+    std::size_t new_size = (limit + GROW_CHUNK - 1) / GROW_CHUNK * GROW_CHUNK;
+    if (new_size >= mapped) {
+        return;
+    }
+
+    // put the reservation back in place of the discarded part of the mapping
+    void *ret = ::mmap(
+            _base + new_size,
+            mapped - new_size,
+            PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+            -1,
+            0
+        );
+    if (ret == MAP_FAILED) {
+        throw MmapDriverIOException();
+    }
+    _mapped.store(new_size, std::memory_order_release);
+
+    if (::ftruncate(_fd, static_cast<off_t>(new_size)) != 0) {
+        throw MmapDriverIOException();
+    }
+}
+
+void
+MmapDriver::flush()
+{
+    std::size_t mapped = _mapped.load(std::memory_order_acquire);
+    if (mapped && ::msync(_base, mapped, MS_SYNC) != 0) {
+        throw MmapDriverIOException();
+    }
+}
+
+Slice
+MmapDriver::mapBlock(BlockIndex index)
+{
+    std::size_t offset = static_cast<std::size_t>(index) * _block_size;
+    ensureMapped(offset + _block_size);
+    return Slice(_base + offset, _block_size);
+}
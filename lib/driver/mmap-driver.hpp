@@ -0,0 +1,150 @@
+#ifndef _DB_DRIVER_MMAP_DRIVER_H_
+#define _DB_DRIVER_MMAP_DRIVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+
+#include "driver.hpp"
+
+namespace cdb {
+    struct MmapDriverIOException : public std::exception
+    {
+        const char *what() const noexcept
+        { return "I/O error in MmapDriver"; }
+    };
+
+    /**
+     * Single file driver which maps the whole file into memory.
+     *
+     * A large range of address space is reserved when constructing, and the file is 
+     * mapped into the front of it. When a block beyond the mapping is written or 
+     * mapped, the file is extended and the mapping grows by GROW_CHUNK at a time. Since 
+     * the reserved range never moves, a pointer into the mapping stays valid until the
+     * driver is destructed, so `mapBlock' can hand out Slices directly into the file.
+     *
+     * readBlock/writeBlock are served by memcpy from/to the mapping.
+     */
+    class MmapDriver : public Driver
+    {
+        /** size of address space reserved for the mapping */
+        static constexpr std::size_t MAX_MAPPING_SIZE =
+            sizeof(void*) >= 8 ? (static_cast<std::size_t>(1) << 40) : (1u << 30);
+
+        /** the mapping always grows by this many bytes */
+        static constexpr std::size_t GROW_CHUNK = 16 * 1024 * 1024;     // 16MB
+
+        /** internal file descriptor */
+        int _fd;
+
+        /** start of the reserved address range */
+        Byte *_base;
+
+        /** bytes of the file currently mapped, always a multiple of GROW_CHUNK */
+        std::atomic<std::size_t> _mapped;
+
+        /** held when growing the mapping */
+        std::mutex _grow_mutex;
+
+        // not copiable
+        MmapDriver(const MmapDriver &) = delete;
+        MmapDriver &operator = (const MmapDriver &) = delete;
+
+        /**
+         * Make sure the first `limit' bytes of the file are mapped, extending the file
+         * if necessary
+         *
+         * @param limit number of bytes required
+         */
+        void ensureMapped(std::size_t limit);
+
+    public:
+        /**
+         * Construct a MmapDriver with file path.
+         *
+         * If the file exists, open it and map it. If the file doesn't exists, create it.
+         *
+         * @param path path of the single file
+         */
+        MmapDriver(const char *path);
+
+        /** Unmap and close the file when destructing. */
+        virtual ~MmapDriver();
+
+        /**
+         * Read a block by copying from the mapping
+         *
+         * @param index index of block
+         * @param dest a piece of memory where the driver reads to
+         * @see readBlocks(BlockIndex index, Length count, Slice dest)
+         */
+        virtual void readBlock(BlockIndex index, Slice dest)
+        { readBlocks(index, 1, dest); }
+
+        /**
+         * Read a series of blocks by copying from the mapping
+         *
+         * Blocks beyond the mapping are filled with zero.
+         *
+         * @param index index of first block
+         * @param count number of blocks to read
+         * @param dest a piece of memory where the driver reads to
+         * @see readBlock(BlockIndex index, Slice dest)
+         */
+        virtual void readBlocks(BlockIndex index, Length count, Slice dest);
+
+        /**
+         * Write a block by copying into the mapping
+         *
+         * @param index index of block
+         * @param src a piece of memory which the driver write to disk
+         * @see writeBlocks(BlockIndex index, Length length, ConstSlice src)
+         */
+        virtual void writeBlock(BlockIndex index, ConstSlice src)
+        { writeBlocks(index, 1, src); }
+
+        /**
+         * Write a series of blocks by copying into the mapping, the mapping grows if
+         * necessary
+         *
+         * @param index index of first block
+         * @param count number of blocks to write
+         * @param src a piece of memory which the driver write to disk
+         * @see writeBlock(BlockIndex index, ConstSlice src)
+         */
+        virtual void writeBlocks(BlockIndex index, Length count, ConstSlice src);
+
+        /**
+         * Grow the mapping to contain the first `count' blocks, in one step
+         *
+         * @param count number of blocks to be contained
+         */
+        virtual void reserveBlocks(Length count);
+
+        /** Sync the whole mapping to disk, throws MmapDriverIOException on failure. */
+        virtual void flush();
+
+        /**
+         * Shrink the file and the mapping to whole GROW_CHUNKs containing `count' blocks.
+         * The address space given back stays reserved, so Slices of blocks kept remain
+         * valid, Slices of blocks discarded must not be used any more.
+         *
+         * @param count number of blocks to keep
+         */
+        virtual void truncateBlocks(Length count);
+
+        /**
+         * Get a Slice pointing directly into the mapping, the mapping grows if necessary
+         *
+         * Writing to the Slice modifies the file. The Slice is valid until the driver is
+         * destructed.
+         *
+         * @param index index of block
+         * @return the Slice of the block
+         */
+        Slice mapBlock(BlockIndex index);
+    };
+}
+
+#endif // _DB_DRIVER_MMAP_DRIVER_H_
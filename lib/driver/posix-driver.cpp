@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "posix-driver.hpp"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+using namespace cdb;
+
+using cdb::Byte;
+using cdb::Length;
+
+/**
+ * Open the file, falling back to buffered I/O if direct I/O is not supported
+ *
+ * @param path path of the file
+ * @param direct whether to open in direct mode, cleared if not supported
+ * @return file descriptor
+ */
+static int
+openFile(const char *path, bool &direct)
+{
+#if defined O_DIRECT
+    if (direct) {
+        int fd = ::open(path, O_RDWR | O_CREAT | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        direct = false;
+    }
+#elif defined __APPLE__
+    if (direct) {
+        int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd >= 0 && ::fcntl(fd, F_NOCACHE, 1) < 0) {
+            direct = false;
+        }
+        return fd;
+    }
+#else
+    direct = false;
+#endif
+
+    return ::open(path, O_RDWR | O_CREAT, 0644);
+}
+
+PosixDriver::PosixDriver(const char *path, bool direct)
+    : _direct(direct),
+      _fd(openFile(path, _direct))
+{
+    if (_fd < 0) {
+        throw PosixDriverIOException();
+    }
+}
+
+PosixDriver::~PosixDriver()
+{ ::close(_fd); }
+
+bool
+PosixDriver::isAligned(const Byte *buf, std::size_t length, off_t offset) const
+{
+    if (!_direct) {
+        return true;
+    }
+
+    return !(reinterpret_cast<std::uintptr_t>(buf) % DIRECT_IO_ALIGNMENT)
+        && !(length % DIRECT_IO_ALIGNMENT)
+        && !(offset % DIRECT_IO_ALIGNMENT);
+}
+
+void
+PosixDriver::readFully(Byte *buf, std::size_t length, off_t offset)
+{
+    while (length) {
+        auto ret = ::pread(_fd, buf, length, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        if (ret == 0 || (_direct && ret % DIRECT_IO_ALIGNMENT)) {
+            // reading beyond the end of file, in direct mode the file may end in the
+            // middle of an aligned page
+            std::fill(buf + ret, buf + length, 0);
+            break;
+        }
+        buf += ret;
+        offset += ret;
+        length -= ret;
+    }
+}
+
+void
+PosixDriver::writeFully(const Byte *buf, std::size_t length, off_t offset)
+{
+    while (length) {
+        auto ret = ::pwrite(_fd, buf, length, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        buf += ret;
+        offset += ret;
+        length -= ret;
+    }
+}
+
+void
+PosixDriver::readBlocks(BlockIndex index, Length count, Slice dest)
+{
+    assert(dest.length() >= _block_size * count);
+
+    std::size_t length = static_cast<std::size_t>(count) * _block_size;
+    off_t offset = static_cast<off_t>(index) * _block_size;
+
+    if (isAligned(dest.content(), length, offset)) {
+        readFully(dest.content(), length, offset);
+        return;
+    }
+
+    off_t begin = offset / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    off_t end = (offset + length + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    Buffer bounce = Buffer::Aligned(static_cast<Length>(end - begin), DIRECT_IO_ALIGNMENT);
+
+    readFully(bounce.content(), end - begin, begin);
+    std::copy(bounce.content() + (offset - begin), bounce.content() + (offset - begin) + length, dest.content());
+}
+
+void
+PosixDriver::writeBlocks(BlockIndex index, Length count, ConstSlice src)
+{
+    assert(src.length() >= _block_size * count);
+
+    std::size_t length = static_cast<std::size_t>(count) * _block_size;
+    off_t offset = static_cast<off_t>(index) * _block_size;
+
+    if (!_direct) {
+        writeFully(src.content(), length, offset);
+        return;
+    }
+
+    // partial pages are only written when pages are smaller than the alignment
+    std::unique_lock<std::mutex> lock(_direct_mutex, std::defer_lock);
+    if (_block_size < DIRECT_IO_ALIGNMENT) {
+        lock.lock();
+    }
+
+    if (isAligned(src.content(), length, offset)) {
+        writeFully(src.content(), length, offset);
+        return;
+    }
+
+    off_t begin = offset / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    off_t end = (offset + length + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    Buffer bounce = Buffer::Aligned(static_cast<Length>(end - begin), DIRECT_IO_ALIGNMENT);
+    Byte *bounce_content = bounce.content();
+
+    // read the partial pages at both ends before overwriting the middle
+    if (begin != offset) {
+        readFully(bounce_content, DIRECT_IO_ALIGNMENT, begin);
+    }
+    if (end != static_cast<off_t>(offset + length) && (end - DIRECT_IO_ALIGNMENT != begin || begin == offset)) {
+        readFully(bounce_content + (end - begin) - DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT, end - DIRECT_IO_ALIGNMENT);
+    }
+
+    std::copy(src.content(), src.content() + length, bounce_content + (offset - begin));
+    writeFully(bounce_content, end - begin, begin);
+}
+
+/**
+ * Skip `done' bytes of an iovec array after a partial transfer
+ *
+ * @param iov current iovec, updated
+ * @param remain number of iovecs left, updated
+ * @param done number of bytes transferred
+ */
+static void
+advanceIOVec(struct iovec *&iov, int &remain, std::size_t done)
+{
+    while (remain && done >= iov->iov_len) {
+        done -= iov->iov_len;
+        ++iov;
+        --remain;
+    }
+    if (done) {
+        iov->iov_base = reinterpret_cast<Byte*>(iov->iov_base) + done;
+        iov->iov_len -= done;
+    }
+}
+
+void
+PosixDriver::readBlocksScattered(BlockIndex index, Length count, Slice *dests)
+{
+    if (_direct) {
+        // pieces of memory are hardly aligned, coalesce what can be coalesced
+        Driver::readBlocksScattered(index, count, dests);
+        return;
+    }
+
+    std::vector<struct iovec> iovs(count);
+    for (Length i = 0; i < count; ++i) {
+        assert(dests[i].length() >= _block_size);
+        iovs[i].iov_base = dests[i].content();
+        iovs[i].iov_len = _block_size;
+    }
+
+    struct iovec *iov = iovs.data();
+    int remain = static_cast<int>(count);
+    off_t offset = static_cast<off_t>(index) * _block_size;
+
+    while (remain) {
+        auto ret = ::preadv(_fd, iov, std::min(remain, IOV_MAX), offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        if (ret == 0) {
+            // reading beyond the end of file
+            for (; remain; ++iov, --remain) {
+                std::fill_n(reinterpret_cast<Byte*>(iov->iov_base), iov->iov_len, 0);
+            }
+            break;
+        }
+        offset += ret;
+        advanceIOVec(iov, remain, static_cast<std::size_t>(ret));
+    }
+}
+
+void
+PosixDriver::writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+{
+    if (_direct) {
+        Driver::writeBlocksGathered(index, count, srcs);
+        return;
+    }
+
+    std::vector<struct iovec> iovs(count);
+    for (Length i = 0; i < count; ++i) {
+        assert(srcs[i].length() >= _block_size);
+        iovs[i].iov_base = const_cast<Byte*>(srcs[i].content());
+        iovs[i].iov_len = _block_size;
+    }
+
+    struct iovec *iov = iovs.data();
+    int remain = static_cast<int>(count);
+    off_t offset = static_cast<off_t>(index) * _block_size;
+
+    while (remain) {
+        auto ret = ::pwritev(_fd, iov, std::min(remain, IOV_MAX), offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        offset += ret;
+        advanceIOVec(iov, remain, static_cast<std::size_t>(ret));
+    }
+}
+
+void
+PosixDriver::flush()
+{
+#if defined __APPLE__
+    if (::fsync(_fd) < 0) {
+#else
+    if (::fdatasync(_fd) < 0) {
+#endif
+        throw PosixDriverIOException();
+    }
+}
+
+void
+PosixDriver::truncateBlocks(Length count)
+{
+    struct stat st;
+    if (::fstat(_fd, &st) != 0) {
+        throw PosixDriverIOException();
+    }
+
+    off_t size = static_cast<off_t>(count) * _block_size;
+    if (st.st_size > size && ::ftruncate(_fd, size) != 0) {
+        throw PosixDriverIOException();
+    }
+}
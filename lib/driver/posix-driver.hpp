@@ -0,0 +1,182 @@
+#ifndef _DB_DRIVER_POSIX_DRIVER_H_
+#define _DB_DRIVER_POSIX_DRIVER_H_
+
+#include <exception>
+#include <mutex>
+
+#include <sys/types.h>
+
+#include "driver.hpp"
+
+namespace cdb {
+    struct PosixDriverIOException : public std::exception
+    {
+        const char *what() const noexcept
+        { return "I/O error in PosixDriver"; }
+    };
+
+    /**
+     * Single file driver using positional I/O on a raw file descriptor.
+     *
+     * Unlike BasicDriver, no stdio buffer and no shared file position is involved: each
+     * request is served by a single pread/pwrite on the descriptor, so blocks are copied
+     * only once and the driver can be used by several callers at the same time.
+     *
+     * In direct mode the file is opened with O_DIRECT, bypassing the page cache of the
+     * OS, so that the cache of the accesser is the only copy of data in memory. Requests
+     * not aligned to DIRECT_IO_ALIGNMENT go through an aligned bounce buffer, writes of
+     * partial pages become read-modify-write.
+     */
+    class PosixDriver : public Driver
+    {
+    public:
+        /** alignment of memory, offset and length required by O_DIRECT */
+        static const Length DIRECT_IO_ALIGNMENT = 4096;
+
+    protected:
+        /** whether the file is opened with O_DIRECT */
+        bool _direct;
+
+        /** internal file descriptor */
+        int _fd;
+
+        /**
+         * serializes writes in direct mode when blocks are smaller than
+         * DIRECT_IO_ALIGNMENT, partial pages are read-modify-write
+         */
+        std::mutex _direct_mutex;
+
+        /**
+         * pread until all `length' bytes are read, filling zero beyond the end of file
+         *
+         * @param buf where to read to
+         * @param length number of bytes to read
+         * @param offset offset in file
+         */
+        void readFully(Byte *buf, std::size_t length, off_t offset);
+
+        /**
+         * pwrite until all `length' bytes are written
+         *
+         * @param buf data to write
+         * @param length number of bytes to write
+         * @param offset offset in file
+         */
+        void writeFully(const Byte *buf, std::size_t length, off_t offset);
+
+        /**
+         * Check whether a request can be passed to the file without a bounce buffer
+         *
+         * @param buf memory of the request
+         * @param length number of bytes
+         * @param offset offset in file
+         * @return true if no bounce buffer is needed
+         */
+        bool isAligned(const Byte *buf, std::size_t length, off_t offset) const;
+
+        // not copiable
+        PosixDriver(const PosixDriver &) = delete;
+        PosixDriver &operator = (const PosixDriver &) = delete;
+
+    public:
+        /**
+         * Construct a PosixDriver with file path.
+         *
+         * If the file exists, open it and update it. If the file doesn't exists, create it and update it.
+         * If the file system does not support O_DIRECT, direct mode is turned off silently.
+         *
+         * @param path path of the single file
+         * @param direct whether to bypass the page cache of the OS
+         * @see isDirect()
+         */
+        PosixDriver(const char *path, bool direct = false);
+
+        /** Close the file when destructing. */
+        virtual ~PosixDriver();
+
+        /**
+         * Whether the file is actually opened in direct mode
+         *
+         * @return true if bypassing the page cache
+         */
+        bool isDirect() const
+        { return _direct; }
+
+        /**
+         * Alignment required to avoid bounce buffers
+         *
+         * @return DIRECT_IO_ALIGNMENT in direct mode, otherwise 1
+         */
+        virtual Length ioAlignment() const
+        { return _direct ? DIRECT_IO_ALIGNMENT : 1; }
+
+        /**
+         * Read a block from disk, directly.
+         *
+         * @param index index of block
+         * @param dest a piece of memory where the driver reads to
+         * @see readBlocks(BlockIndex index, Length count, Slice dest)
+         */
+        virtual void readBlock(BlockIndex index, Slice dest)
+        { readBlocks(index, 1, dest); }
+
+        /**
+         * Read a series of blocks from disk with a single pread when aligned.
+         *
+         * Blocks beyond the end of file are filled with zero.
+         *
+         * @param index index of first block
+         * @param count number of blocks to read
+         * @param dest a piece of memory where the driver reads to
+         * @see readBlock(BlockIndex index, Slice dest)
+         */
+        virtual void readBlocks(BlockIndex index, Length count, Slice dest);
+
+        /**
+         * Write a block to disk, directly.
+         *
+         * @param index index of block
+         * @param src a piece of memory which the driver write to disk
+         * @see writeBlocks(BlockIndex index, Length length, ConstSlice src)
+         */
+        virtual void writeBlock(BlockIndex index, ConstSlice src)
+        { writeBlocks(index, 1, src); }
+
+        /**
+         * Write a series of blocks to disk with a single pwrite when aligned.
+         *
+         * @param index index of first block
+         * @param count number of blocks to write
+         * @param src a piece of memory which the driver write to disk
+         * @see writeBlock(BlockIndex index, ConstSlice src)
+         */
+        virtual void writeBlocks(BlockIndex index, Length count, ConstSlice src);
+
+        /** Sync all written data to the disk, throws PosixDriverIOException on failure. */
+        virtual void flush();
+
+        /** Shrink the file with ftruncate, never extends it. */
+        virtual void truncateBlocks(Length count);
+
+    protected:
+        /**
+         * Read a run of contiguous blocks into separate pieces of memory with preadv.
+         *
+         * @param index index of first block
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         */
+        virtual void readBlocksScattered(BlockIndex index, Length count, Slice *dests);
+
+        /**
+         * Write a run of contiguous blocks from separate pieces of memory with pwritev.
+         *
+         * @param index index of first block
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         */
+        virtual void writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs);
+    };
+}
+
+#endif // _DB_DRIVER_POSIX_DRIVER_H_
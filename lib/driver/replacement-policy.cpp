@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cassert>
+
+#include "replacement-policy.hpp"
+
+using namespace cdb;
+
+void
+LRUReplacementPolicy::admit(BlockIndex index)
+{
+    assert(!_position.count(index));
+
+    _list.push_front(index);
+    _position.emplace(index, _list.begin());
+}
+
+void
+LRUReplacementPolicy::touch(BlockIndex index)
+{
+    auto iter = _position.find(index);
+    assert(iter != _position.end());
+
+    _list.splice(_list.begin(), _list, iter->second);
+}
+
+void
+LRUReplacementPolicy::evict(BlockIndex index)
+{
+    auto iter = _position.find(index);
+    if (iter == _position.end()) {
+        return;
+    }
+
+    _list.erase(iter->second);
+    _position.erase(iter);
+}
+
+bool
+LRUReplacementPolicy::victim(const Evictable &evictable, BlockIndex &result)
+{
+    for (auto i = _list.rbegin(); i != _list.rend(); ++i) {
+        if (evictable(*i)) {
+            result = *i;
+            return true;
+        }
+    }
+    return false;
+}
+
+TwoQueueReplacementPolicy::TwoQueueReplacementPolicy(Length capacity)
+    : _in_limit(0), _out_limit(0)
+{ setCapacity(capacity); }
+
+void
+TwoQueueReplacementPolicy::setCapacity(Length capacity)
+{
+    _in_limit = std::max<Length>(capacity / IN_RATIO, 1);
+    _out_limit = std::max<Length>(capacity / OUT_RATIO, 1);
+
+    while (_out.size() > _out_limit) {
+        _position.erase(_out.back());
+        _out.pop_back();
+    }
+}
+
+void
+TwoQueueReplacementPolicy::admit(BlockIndex index)
+{
+    auto iter = _position.find(index);
+
+    if (iter != _position.end()) {
+        // remembered in A1out, so it is hot
+        assert(iter->second.queue == Queue::OUT);
+
+        _out.erase(iter->second.iter);
+        _main.push_front(index);
+        iter->second = Position{Queue::MAIN, _main.begin()};
+        return;
+    }
+
+    _in.push_front(index);
+    _position.emplace(index, Position{Queue::IN, _in.begin()});
+}
+
+void
+TwoQueueReplacementPolicy::touch(BlockIndex index)
+{
+    auto iter = _position.find(index);
+    assert(iter != _position.end() && iter->second.queue != Queue::OUT);
+
+    // accesses in A1in are considered correlated and do not change its order
+    if (iter->second.queue == Queue::MAIN) {
+        _main.splice(_main.begin(), _main, iter->second.iter);
+    }
+}
+
+void
+TwoQueueReplacementPolicy::evict(BlockIndex index)
+{
+    auto iter = _position.find(index);
+    if (iter == _position.end() || iter->second.queue == Queue::OUT) {
+        return;
+    }
+
+    if (iter->second.queue == Queue::MAIN) {
+        _main.erase(iter->second.iter);
+        _position.erase(iter);
+        return;
+    }
+
+    // remember blocks evicted from A1in
+    _in.erase(iter->second.iter);
+    _out.push_front(index);
+    iter->second = Position{Queue::OUT, _out.begin()};
+
+    if (_out.size() > _out_limit) {
+        _position.erase(_out.back());
+        _out.pop_back();
+    }
+}
+
+bool
+TwoQueueReplacementPolicy::oldestEvictable(const BlockList &list, const Evictable &evictable, BlockIndex &result)
+{
+    for (auto i = list.rbegin(); i != list.rend(); ++i) {
+        if (evictable(*i)) {
+            result = *i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+TwoQueueReplacementPolicy::victim(const Evictable &evictable, BlockIndex &result)
+{
+    if (_in.size() > _in_limit || _main.empty()) {
+        return oldestEvictable(_in, evictable, result) || oldestEvictable(_main, evictable, result);
+    }
+    return oldestEvictable(_main, evictable, result) || oldestEvictable(_in, evictable, result);
+}
@@ -0,0 +1,165 @@
+#ifndef _DB_DRIVER_REPLACEMENT_POLICY_H_
+#define _DB_DRIVER_REPLACEMENT_POLICY_H_
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+#include "driver.hpp"
+
+namespace cdb {
+    /**
+     * Decides which cached block to evict when a buffer pool is full.
+     *
+     * The pool tells the policy about every block brought in, accessed again and evicted,
+     * and asks it for a victim. Blocks which can not be evicted at the moment (e.g.
+     * pinned) are filtered by the pool through a predicate.
+     */
+    class ReplacementPolicy
+    {
+    public:
+        typedef std::function<bool(BlockIndex)> Evictable;
+
+        virtual ~ReplacementPolicy() = default;
+
+        /**
+         * @return a new policy of the same kind, tracking no block
+         */
+        virtual ReplacementPolicy *create() const = 0;
+
+        /**
+         * Set the number of blocks the pool holds
+         *
+         * @param capacity number of frames in the pool
+         */
+        virtual void setCapacity(Length capacity) = 0;
+
+        /**
+         * A block missing from the pool is brought in
+         *
+         * @param index index of the block
+         */
+        virtual void admit(BlockIndex index) = 0;
+
+        /**
+         * A block in the pool is accessed again
+         *
+         * @param index index of the block
+         */
+        virtual void touch(BlockIndex index) = 0;
+
+        /**
+         * A block leaves the pool
+         *
+         * @param index index of the block
+         */
+        virtual void evict(BlockIndex index) = 0;
+
+        /**
+         * Choose a block to evict, the block is not removed until evict is called
+         *
+         * @param evictable predicate telling whether a block can be evicted now
+         * @param result [out] the block chosen
+         * @return false if no block can be evicted
+         */
+        virtual bool victim(const Evictable &evictable, BlockIndex &result) = 0;
+    };
+
+    /**
+     * Evict the least recently used block.
+     */
+    class LRUReplacementPolicy : public ReplacementPolicy
+    {
+        typedef std::list<BlockIndex> BlockList;
+
+        /** most recently used first */
+        BlockList _list;
+        std::unordered_map<BlockIndex, BlockList::iterator> _position;
+
+    public:
+        virtual ReplacementPolicy *create() const
+        { return new LRUReplacementPolicy(); }
+
+        virtual void setCapacity(Length)
+        { }
+
+        virtual void admit(BlockIndex index);
+        virtual void touch(BlockIndex index);
+        virtual void evict(BlockIndex index);
+        virtual bool victim(const Evictable &evictable, BlockIndex &result);
+    };
+
+    /**
+     * Scan resistant 2Q policy (Johnson & Shasha, 1994).
+     *
+     * Blocks brought in for the first time enter a FIFO queue A1in. If they are evicted
+     * from A1in, only their indices are remembered in the ghost queue A1out. Blocks
+     * accessed again while in A1out are considered hot and enter the LRU queue Am. So a
+     * long scan touching each block once only cycles through A1in, without flushing the
+     * hot blocks in Am.
+     */
+    class TwoQueueReplacementPolicy : public ReplacementPolicy
+    {
+    public:
+        /** A1in holds 1 / IN_RATIO of the capacity */
+        static const Length IN_RATIO = 4;
+
+        /** A1out remembers 1 / OUT_RATIO of the capacity */
+        static const Length OUT_RATIO = 2;
+
+    private:
+        typedef std::list<BlockIndex> BlockList;
+
+        enum class Queue
+        {
+            IN,         /** in A1in, cached */
+            OUT,        /** in A1out, not cached */
+            MAIN        /** in Am, cached */
+        };
+
+        struct Position
+        {
+            Queue queue;
+            BlockList::iterator iter;
+        };
+
+        Length _in_limit;
+        Length _out_limit;
+
+        /** newest first */
+        BlockList _in;
+        BlockList _out;
+
+        /** most recently used first */
+        BlockList _main;
+
+        std::unordered_map<BlockIndex, Position> _position;
+
+        /**
+         * Find the oldest evictable block in a queue
+         *
+         * @param list the queue to search
+         * @param evictable predicate telling whether a block can be evicted now
+         * @param result [out] the block found
+         * @return false if not found
+         */
+        static bool oldestEvictable(const BlockList &list, const Evictable &evictable, BlockIndex &result);
+
+    public:
+        /**
+         * @param capacity number of frames in the pool
+         */
+        TwoQueueReplacementPolicy(Length capacity = 0);
+
+        virtual ReplacementPolicy *create() const
+        { return new TwoQueueReplacementPolicy(); }
+
+        virtual void setCapacity(Length capacity);
+        virtual void admit(BlockIndex index);
+        virtual void touch(BlockIndex index);
+        virtual void evict(BlockIndex index);
+        virtual bool victim(const Evictable &evictable, BlockIndex &result);
+    };
+}
+
+#endif // _DB_DRIVER_REPLACEMENT_POLICY_H_
@@ -0,0 +1,470 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// defined by <linux/fs.h>, clashes with Driver::BLOCK_SIZE
+#undef BLOCK_SIZE
+#endif
+
+#include "uring-driver.hpp"
+
+using namespace cdb;
+
+using cdb::Byte;
+using cdb::Length;
+
+/** one block of a request */
+struct UringDriver::Operation
+{
+    RequestHandle handle;
+    bool write;
+    off_t offset;
+    struct iovec iov;
+};
+
+#if defined __linux__
+
+/** mapped submission queue and completion queue of an io_uring instance */
+struct UringDriver::Ring
+{
+    int fd = -1;
+
+    void *sq_ptr = MAP_FAILED;
+    std::size_t sq_size = 0;
+    void *cq_ptr = MAP_FAILED;
+    std::size_t cq_size = 0;
+    void *sqes_ptr = MAP_FAILED;
+    std::size_t sqes_size = 0;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    unsigned cq_entries;
+    struct io_uring_cqe *cqes;
+
+    ~Ring()
+    {
+        if (sqes_ptr != MAP_FAILED) { ::munmap(sqes_ptr, sqes_size); }
+        if (cq_ptr != MAP_FAILED) { ::munmap(cq_ptr, cq_size); }
+        if (sq_ptr != MAP_FAILED) { ::munmap(sq_ptr, sq_size); }
+        if (fd >= 0) { ::close(fd); }
+    }
+
+    /**
+     * Set up an io_uring instance and map its rings
+     *
+     * @param entries number of submission queue entries
+     * @return true if succeed
+     */
+    bool
+    setup(unsigned entries)
+    {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            return false;
+        }
+
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        cq_ptr = ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            return false;
+        }
+
+        sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ptr = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQES);
+        if (sqes_ptr == MAP_FAILED) {
+            return false;
+        }
+
+        Byte *sq = reinterpret_cast<Byte*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqes = reinterpret_cast<struct io_uring_sqe*>(sqes_ptr);
+
+        Byte *cq = reinterpret_cast<Byte*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cq_entries = params.cq_entries;
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+};
+
+#else
+
+struct UringDriver::Ring
+{
+    bool
+    setup(unsigned)
+    { return false; }
+};
+
+#endif
+
+UringDriver::UringDriver(const char *path, unsigned queue_depth)
+    : PosixDriver(path),
+      _ring(new Ring()),
+      _next_handle(1),
+      _in_flight(0)
+{
+    if (!_ring->setup(queue_depth)) {
+        _ring.reset();
+    }
+}
+
+UringDriver::~UringDriver()
+{
+    if (_ring) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        drain();
+    }
+}
+
+void
+UringDriver::readBlocksV(const BlockIndex *indices, Length count, Slice *dests)
+{
+    if (!_ring) {
+        PosixDriver::readBlocksV(indices, count, dests);
+        return;
+    }
+    wait(readBlocksAsync(indices, count, dests));
+}
+
+void
+UringDriver::writeBlocksV(const BlockIndex *indices, Length count, const ConstSlice *srcs)
+{
+    if (!_ring) {
+        PosixDriver::writeBlocksV(indices, count, srcs);
+        return;
+    }
+    wait(writeBlocksAsync(indices, count, srcs));
+}
+
+Driver::RequestHandle
+UringDriver::readBlocksAsync(const BlockIndex *indices, Length count, Slice *dests)
+{
+    if (!_ring || !count) {
+        return PosixDriver::readBlocksAsync(indices, count, dests);
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    RequestHandle handle = _next_handle++;
+    _requests[handle] = Request{count, false, false};
+
+    try {
+        unsigned queued = 0;
+        for (Length i = 0; i < count; ++i) {
+            assert(dests[i].length() >= _block_size);
+
+            // owned by the ring once queued
+            std::unique_ptr<Operation> op(new Operation());
+            op->handle = handle;
+            op->write = false;
+            op->offset = static_cast<off_t>(indices[i]) * _block_size;
+            op->iov.iov_base = dests[i].content();
+            op->iov.iov_len = _block_size;
+            queue(op.get(), queued);
+            op.release();
+        }
+        enter(queued, 0);
+    }
+    catch (const PosixDriverIOException &) {
+        abandon(handle);
+        throw;
+    }
+
+    return handle;
+}
+
+Driver::RequestHandle
+UringDriver::writeBlocksAsync(const BlockIndex *indices, Length count, const ConstSlice *srcs)
+{
+    if (!_ring || !count) {
+        return PosixDriver::writeBlocksAsync(indices, count, srcs);
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    RequestHandle handle = _next_handle++;
+    _requests[handle] = Request{count, false, false};
+
+    try {
+        unsigned queued = 0;
+        for (Length i = 0; i < count; ++i) {
+            assert(srcs[i].length() >= _block_size);
+
+            // owned by the ring once queued
+            std::unique_ptr<Operation> op(new Operation());
+            op->handle = handle;
+            op->write = true;
+            op->offset = static_cast<off_t>(indices[i]) * _block_size;
+            op->iov.iov_base = const_cast<Byte*>(srcs[i].content());
+            op->iov.iov_len = _block_size;
+            queue(op.get(), queued);
+            op.release();
+        }
+        enter(queued, 0);
+    }
+    catch (const PosixDriverIOException &) {
+        abandon(handle);
+        throw;
+    }
+
+    return handle;
+}
+
+bool
+UringDriver::finished(RequestHandle handle)
+{
+    if (!handle) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    reap();
+
+    auto iter = _requests.find(handle);
+    return iter == _requests.end() || iter->second.pending == 0;
+}
+
+void
+UringDriver::wait(RequestHandle handle)
+{
+    if (!handle) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    auto iter = _requests.find(handle);
+    if (iter == _requests.end()) {
+        return;
+    }
+
+    reap();
+    while (iter->second.pending) {
+        enter(0, 1);
+        reap();
+    }
+
+    bool failed = iter->second.failed;
+    _requests.erase(iter);
+
+    if (failed) {
+        throw PosixDriverIOException();
+    }
+}
+
+void
+UringDriver::flush()
+{
+    if (_ring) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        drain();
+    }
+    PosixDriver::flush();
+}
+
+void
+UringDriver::complete(Operation *op)
+{
+    auto &request = _requests[op->handle];
+
+    try {
+        Byte *buf = reinterpret_cast<Byte*>(op->iov.iov_base);
+        BlockIndex index = static_cast<BlockIndex>(op->offset / _block_size);
+        if (op->write) {
+            PosixDriver::writeBlocks(index, 1, ConstSlice(buf, _block_size));
+        }
+        else {
+            PosixDriver::readBlocks(index, 1, Slice(buf, _block_size));
+        }
+    }
+    catch (const PosixDriverIOException &) {
+        request.failed = true;
+    }
+}
+
+void
+UringDriver::drain()
+{
+    reap();
+    while (_in_flight) {
+        enter(0, 1);
+        reap();
+    }
+}
+
+#if defined __linux__
+
+void
+UringDriver::queue(Operation *op, unsigned &queued)
+{
+    // never let completions overflow the completion queue
+    while (_in_flight >= _ring->cq_entries || queued >= _ring->sq_entries) {
+        enter(queued, queued ? 0 : 1);
+        queued = 0;
+        reap();
+    }
+
+    unsigned tail = *_ring->sq_tail;
+    unsigned slot = tail & _ring->sq_mask;
+    struct io_uring_sqe *sqe = &_ring->sqes[slot];
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = _fd;
+    sqe->off = static_cast<std::uint64_t>(op->offset);
+    sqe->addr = reinterpret_cast<std::uint64_t>(&op->iov);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+
+    _ring->sq_array[slot] = slot;
+    __atomic_store_n(_ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ++queued;
+    ++_in_flight;
+}
+
+void
+UringDriver::enter(unsigned to_submit, unsigned min_complete)
+{
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+    while (to_submit || min_complete) {
+        auto ret = ::syscall(__NR_io_uring_enter, _ring->fd, to_submit, min_complete, flags, nullptr, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        to_submit -= static_cast<unsigned>(ret);
+        break;
+    }
+
+    // the kernel may consume fewer entries than requested, keep submitting the rest
+    while (to_submit) {
+        auto ret = ::syscall(__NR_io_uring_enter, _ring->fd, to_submit, 0, 0, nullptr, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            throw PosixDriverIOException();
+        }
+        to_submit -= static_cast<unsigned>(ret);
+    }
+}
+
+void
+UringDriver::reap()
+{
+    unsigned head = *_ring->cq_head;
+    unsigned tail = __atomic_load_n(_ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &_ring->cqes[head & _ring->cq_mask];
+        auto *op = reinterpret_cast<Operation*>(cqe->user_data);
+
+        // short transfers (e.g. reading beyond the end of file) and errors are
+        // finished synchronously, which zero-fills or reports the failure
+        if (cqe->res != static_cast<std::int32_t>(_block_size)) {
+            complete(op);
+        }
+
+        auto request = _requests.find(op->handle);
+        if (!--request->second.pending && request->second.abandoned) {
+            _requests.erase(request);
+        }
+        --_in_flight;
+        delete op;
+
+        ++head;
+    }
+
+    __atomic_store_n(_ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+void
+UringDriver::abandon(RequestHandle handle)
+{
+    auto &request = _requests.at(handle);
+
+    // without SQPOLL, the kernel only consumes entries in io_uring_enter, and entries
+    // of any other request are submitted before its call returns
+    unsigned head = __atomic_load_n(_ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *_ring->sq_tail;
+    for (unsigned position = head; position != tail; ++position) {
+        auto *op = reinterpret_cast<Operation*>(_ring->sqes[position & _ring->sq_mask].user_data);
+        assert(op->handle == handle);
+
+        --request.pending;
+        --_in_flight;
+        delete op;
+    }
+    __atomic_store_n(_ring->sq_tail, head, __ATOMIC_RELEASE);
+
+    if (request.pending) {
+        request.abandoned = true;
+    }
+    else {
+        _requests.erase(handle);
+    }
+}
+
+#else
+
+void
+UringDriver::queue(Operation *op, unsigned &)
+{
+    complete(op);
+    --_requests[op->handle].pending;
+    delete op;
+}
+
+void
+UringDriver::enter(unsigned, unsigned)
+{ }
+
+void
+UringDriver::reap()
+{ }
+
+void
+UringDriver::abandon(RequestHandle handle)
+{ _requests.erase(handle); }
+
+#endif
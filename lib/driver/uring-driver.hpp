@@ -0,0 +1,169 @@
+#ifndef _DB_DRIVER_URING_DRIVER_H_
+#define _DB_DRIVER_URING_DRIVER_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "posix-driver.hpp"
+
+namespace cdb {
+    /**
+     * Single file driver performing asynchronous I/O through io_uring.
+     *
+     * Every block of an asynchronous request becomes one submission queue entry, and all
+     * entries of a request are handed to the kernel with a single io_uring_enter, so a
+     * batch of non-contiguous blocks costs one system call instead of one per block.
+     *
+     * If io_uring is not available (not Linux, too old a kernel, or forbidden by the
+     * sandbox), the driver falls back to the synchronous behavior of PosixDriver.
+     */
+    class UringDriver : public PosixDriver
+    {
+    public:
+        static const unsigned DEFAULT_QUEUE_DEPTH = 64;
+
+    private:
+        struct Ring;
+        struct Operation;
+
+        /** state of an request not waited yet */
+        struct Request
+        {
+            Length pending;
+            bool failed;
+            bool abandoned;     /** submission failed, erased once nothing is pending */
+        };
+
+        std::unique_ptr<Ring> _ring;
+        std::map<RequestHandle, Request> _requests;
+        RequestHandle _next_handle;
+        Length _in_flight;
+        std::mutex _mutex;
+
+        // not copiable
+        UringDriver(const UringDriver &) = delete;
+        UringDriver &operator = (const UringDriver &) = delete;
+
+        /**
+         * Queue an operation to the submission queue, submitting and reaping when the
+         * rings are full
+         *
+         * @param op operation to queue
+         * @param queued number of entries queued but not submitted yet, updated
+         */
+        void queue(Operation *op, unsigned &queued);
+
+        /**
+         * Submit queued entries and optionally wait for completions
+         *
+         * @param to_submit number of entries to submit
+         * @param min_complete number of completions to wait for
+         */
+        void enter(unsigned to_submit, unsigned min_complete);
+
+        /** Handle every completion on the completion queue */
+        void reap();
+
+        /**
+         * Roll back a request whose submission failed. Entries not consumed by the
+         * kernel are taken back from the submission queue, the request is forgotten
+         * once the operations already submitted are reaped.
+         *
+         * @param handle the handle of request
+         */
+        void abandon(RequestHandle handle);
+
+        /**
+         * Finish an operation which can not be completed asynchronously with positional I/O
+         *
+         * @param op operation to finish
+         */
+        void complete(Operation *op);
+
+        /** Wait until all operations in flight are finished */
+        void drain();
+
+    public:
+        /**
+         * Construct a UringDriver with file path.
+         *
+         * @param path path of the single file
+         * @param queue_depth number of submission queue entries
+         */
+        UringDriver(const char *path, unsigned queue_depth = DEFAULT_QUEUE_DEPTH);
+
+        /** Wait for all operations in flight and close the file. */
+        virtual ~UringDriver();
+
+        /**
+         * Whether io_uring is actually used
+         *
+         * @return false if falling back to synchronous I/O
+         */
+        bool isAsync() const
+        { return static_cast<bool>(_ring); }
+
+        /**
+         * Read a set of blocks with a single submission, then wait for all of them.
+         *
+         * @param indices indices of blocks to read
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         */
+        virtual void readBlocksV(const BlockIndex *indices, Length count, Slice *dests);
+
+        /**
+         * Write a set of blocks with a single submission, then wait for all of them.
+         *
+         * @param indices indices of blocks to write to
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         */
+        virtual void writeBlocksV(const BlockIndex *indices, Length count, const ConstSlice *srcs);
+
+        /**
+         * Submit a batch of block reads with a single io_uring_enter.
+         *
+         * Blocks beyond the end of file are filled with zero.
+         *
+         * @param indices indices of blocks to read
+         * @param count number of blocks to read
+         * @param dests where each block reads to
+         * @return handle of the request
+         */
+        virtual RequestHandle readBlocksAsync(const BlockIndex *indices, Length count, Slice *dests);
+
+        /**
+         * Submit a batch of block writes with a single io_uring_enter.
+         *
+         * @param indices indices of blocks to write to
+         * @param count number of blocks to write
+         * @param srcs data of each block
+         * @return handle of the request
+         */
+        virtual RequestHandle writeBlocksAsync(const BlockIndex *indices, Length count, const ConstSlice *srcs);
+
+        /**
+         * Check whether a request is finished, without blocking
+         *
+         * @param handle the handle of request
+         * @return true if finished
+         */
+        virtual bool finished(RequestHandle handle);
+
+        /**
+         * Block until a request is finished
+         *
+         * Throws PosixDriverIOException if any block of the request failed.
+         *
+         * @param handle the handle of request
+         */
+        virtual void wait(RequestHandle handle);
+
+        /** Wait for all operations in flight and sync written data to the disk. */
+        virtual void flush();
+    };
+}
+
+#endif // _DB_DRIVER_URING_DRIVER_H_
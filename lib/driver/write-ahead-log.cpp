@@ -0,0 +1,679 @@
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "write-ahead-log.hpp"
+
+using namespace cdb;
+
+using cdb::Byte;
+using cdb::Length;
+
+static const std::uint32_t RECORD_MAGIC = 0x4C415743;   // "CWAL"
+static const std::uint32_t RECORD_PAGE = 1;
+static const std::uint32_t RECORD_COMMIT = 2;
+
+/** maximum number of images copied to the data driver with one writeBlocksV */
+static const Length COPY_BATCH = 64;
+
+struct WriteAheadLog::RecordHeader
+{
+    std::uint32_t magic;
+    std::uint32_t type;         /** RECORD_PAGE or RECORD_COMMIT */
+    std::uint32_t index;        /** block of a page record */
+    std::uint32_t length;       /** length of the content following */
+    std::uint64_t lsn;          /** one more than the previous record */
+    std::uint32_t checksum;     /** of the header with this field 0, and the content */
+    std::uint32_t reserved;
+};
+
+/**
+ * 32-bit FNV-1a over a range of bytes
+ *
+ * @param data start of the range
+ * @param length length of the range
+ * @param hash hash of the bytes before the range
+ * @return hash of the bytes including the range
+ */
+static std::uint32_t
+checksum(const Byte *data, std::size_t length, std::uint32_t hash = 2166136261u)
+{
+    while (length--) {
+        hash ^= static_cast<std::uint8_t>(*data++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static std::uint32_t
+checksumRecord(WriteAheadLog::RecordHeader header, const Byte *content)
+{
+    header.checksum = 0;
+    auto hash = checksum(reinterpret_cast<const Byte*>(&header), sizeof(header));
+    return checksum(content, header.length, hash);
+}
+
+static bool
+isValidBlockSize(std::uint32_t length)
+{
+    return length >= Driver::BLOCK_SIZE && length <= Driver::MAX_BLOCK_SIZE && !(length & (length - 1));
+}
+
+static void
+readFully(int fd, Byte *buf, std::size_t length, std::uint64_t offset)
+{
+    while (length) {
+        auto ret = ::pread(fd, buf, length, static_cast<off_t>(offset));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw WriteAheadLogIOException();
+        }
+        if (ret == 0) {
+            throw WriteAheadLogIOException();
+        }
+        buf += ret;
+        offset += ret;
+        length -= ret;
+    }
+}
+
+static void
+writeFully(int fd, const Byte *buf, std::size_t length, std::uint64_t offset)
+{
+    while (length) {
+        auto ret = ::pwrite(fd, buf, length, static_cast<off_t>(offset));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw WriteAheadLogIOException();
+        }
+        buf += ret;
+        offset += ret;
+        length -= ret;
+    }
+}
+
+static int
+syncFile(int fd)
+{
+#if defined __APPLE__
+    return ::fsync(fd);
+#else
+    return ::fdatasync(fd);
+#endif
+}
+
+WriteAheadLog::WriteAheadLog(Driver *data, const char *path)
+    : _data(data),
+      _path(path),
+      _position(0),
+      _synced(0),
+      _syncing(false),
+      _next_lsn(1),
+      _checkpoint_position(0),
+      _checkpoint_size(CHECKPOINT_SIZE),
+      _segment_size(SEGMENT_SIZE),
+      _sync_count(0),
+      _checkpoint_count(0),
+      _checkpointer_stop(false),
+      _checkpoint_wanted(false)
+{
+    recover();
+    _checkpointer = std::thread(&WriteAheadLog::runCheckpointer, this);
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(_checkpointer_mutex);
+        _checkpointer_stop = true;
+    }
+    _checkpointer_cond.notify_one();
+    _checkpointer.join();
+
+    try {
+        if (_pending.empty()) {
+            checkpoint();
+        }
+    }
+    catch (const std::exception &) {
+        // committed pages are still in the log and replayed when opened again, also
+        // when the data driver failed to sync
+    }
+
+    for (auto &segment : _segments) {
+        ::close(segment.second.fd);
+        if (!segment.second.size) {
+            ::unlink(segmentPath(segment.first).c_str());
+        }
+    }
+}
+
+std::string
+WriteAheadLog::segmentPath(std::uint64_t segment) const
+{ return _path + "." + std::to_string(segment); }
+
+std::uint64_t
+WriteAheadLog::rotateLocked()
+{
+    std::uint64_t segment = 1;
+
+    if (!_segments.empty()) {
+        // segments before the last one are always durable
+        auto &current = _segments.rbegin()->second;
+        if (current.size) {
+            if (syncFile(current.fd) < 0) {
+                throw WriteAheadLogIOException();
+            }
+            _synced = std::max(_synced, _position);
+        }
+        segment = _segments.rbegin()->first + 1;
+    }
+
+    int fd = ::open(segmentPath(segment).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw WriteAheadLogIOException();
+    }
+    _segments.emplace(segment, Segment{fd, 0});
+
+    return segment;
+}
+
+void
+WriteAheadLog::dropSegmentsLocked(std::uint64_t boundary)
+{
+    while (!_segments.empty() && _segments.begin()->first < boundary) {
+        ::close(_segments.begin()->second.fd);
+        ::unlink(segmentPath(_segments.begin()->first).c_str());
+        _segments.erase(_segments.begin());
+    }
+}
+
+void
+WriteAheadLog::encode(std::vector<Byte> &buf, std::uint32_t type, BlockIndex index, ConstSlice payload)
+{
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.type = type;
+    header.index = index;
+    header.length = payload.length();
+    header.lsn = _next_lsn++;
+    header.checksum = 0;
+    header.reserved = 0;
+    header.checksum = checksumRecord(header, payload.content());
+
+    auto header_bytes = reinterpret_cast<const Byte*>(&header);
+    buf.insert(buf.end(), header_bytes, header_bytes + sizeof(header));
+    buf.insert(buf.end(), payload.content(), payload.content() + payload.length());
+}
+
+std::uint64_t
+WriteAheadLog::appendLocked(const std::vector<Byte> &buf)
+{
+    auto *segment = &_segments.rbegin()->second;
+    if (segment->size && segment->size + buf.size() > _segment_size) {
+        rotateLocked();
+        segment = &_segments.rbegin()->second;
+    }
+
+    auto offset = segment->size;
+    writeFully(segment->fd, buf.data(), buf.size(), offset);
+    segment->size += buf.size();
+    _position += buf.size();
+
+    return offset;
+}
+
+void
+WriteAheadLog::appendPages(BlockIndex index, Length count, const ConstSlice *srcs)
+{
+    std::vector<Byte> buf;
+    buf.reserve(static_cast<std::size_t>(count) * (sizeof(RecordHeader) + _block_size));
+
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    for (Length i = 0; i < count; ++i) {
+        assert(srcs[i].length() >= _block_size);
+        encode(buf, RECORD_PAGE, index + i, ConstSlice(srcs[i].content(), _block_size));
+    }
+
+    auto offset = appendLocked(buf);
+    auto segment = _segments.rbegin()->first;
+
+    for (Length i = 0; i < count; ++i) {
+        auto image_offset = offset + i * (sizeof(RecordHeader) + _block_size) + sizeof(RecordHeader);
+        _pending[index + i] = Image{segment, image_offset, _block_size};
+    }
+}
+
+void
+WriteAheadLog::recover()
+{
+    std::string dir = ".";
+    std::string base = _path;
+    auto slash = _path.rfind('/');
+    if (slash != std::string::npos) {
+        dir = slash ? _path.substr(0, slash) : "/";
+        base = _path.substr(slash + 1);
+    }
+
+    // segments are files named "<base>.<n>"
+    DIR *dirp = ::opendir(dir.c_str());
+    if (dirp) {
+        while (auto *entry = ::readdir(dirp)) {
+            std::string name = entry->d_name;
+            if (name.size() <= base.size() + 1 || name.compare(0, base.size(), base) ||
+                    name[base.size()] != '.' ||
+                    !std::all_of(name.begin() + base.size() + 1, name.end(),
+                        [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+                continue;
+            }
+
+            auto segment = std::stoull(name.substr(base.size() + 1));
+            int fd = ::open(segmentPath(segment).c_str(), O_RDWR);
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) < 0) {
+                ::closedir(dirp);
+                throw WriteAheadLogIOException();
+            }
+            _segments.emplace(segment, Segment{fd, static_cast<std::uint64_t>(st.st_size)});
+        }
+        ::closedir(dirp);
+    }
+
+    ImageMap committed;
+    ImageMap pending;
+    std::vector<Byte> content;
+    bool first = true;
+    bool valid = true;
+
+    // records are valid until the first torn or stale one, segments after it were
+    // never synced
+    for (auto &segment : _segments) {
+        std::uint64_t offset = 0;
+        std::uint64_t size = segment.second.size;
+
+        while (offset + sizeof(RecordHeader) <= size) {
+            RecordHeader header;
+            readFully(segment.second.fd, reinterpret_cast<Byte*>(&header), sizeof(header), offset);
+
+            if (header.magic != RECORD_MAGIC || (!first && header.lsn != _next_lsn)) {
+                break;
+            }
+            if (header.type == RECORD_PAGE && !isValidBlockSize(header.length)) {
+                break;
+            }
+            if (header.type != RECORD_PAGE && (header.type != RECORD_COMMIT || header.length)) {
+                break;
+            }
+            if (offset + sizeof(header) + header.length > size) {
+                break;
+            }
+
+            content.resize(header.length);
+            readFully(segment.second.fd, content.data(), header.length, offset + sizeof(header));
+            if (checksumRecord(header, content.data()) != header.checksum) {
+                break;
+            }
+
+            if (header.type == RECORD_PAGE) {
+                pending[header.index] = Image{segment.first, offset + sizeof(header), header.length};
+            }
+            else {
+                for (auto &image : pending) {
+                    committed[image.first] = image.second;
+                }
+                pending.clear();
+            }
+
+            first = false;
+            _next_lsn = header.lsn + 1;
+            offset += sizeof(header) + header.length;
+        }
+
+        if (offset != size) {
+            valid = false;
+        }
+        if (!valid) {
+            break;
+        }
+    }
+
+    // pages not followed by a commit record are discarded
+    if (!committed.empty()) {
+        std::map<std::uint64_t, int> fds;
+        for (auto &segment : _segments) {
+            fds.emplace(segment.first, segment.second.fd);
+        }
+        copyImages(committed, fds);
+    }
+
+    dropSegmentsLocked(rotateLocked());
+}
+
+void
+WriteAheadLog::copyImages(const ImageMap &images, const std::map<std::uint64_t, int> &fds)
+{
+    std::vector<std::pair<BlockIndex, Image> > sorted(images.begin(), images.end());
+    std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<BlockIndex, Image> &a, const std::pair<BlockIndex, Image> &b)
+            {
+                return a.first < b.first;
+            }
+        );
+
+    // images are only of another block size when replayed, before anything else
+    // accesses the data driver
+    Length block_size = _data->blockSize();
+    std::vector<Byte> content;
+    std::vector<BlockIndex> indices;
+    std::vector<ConstSlice> srcs;
+
+    std::size_t i = 0;
+    while (i < sorted.size()) {
+        Length length = sorted[i].second.length;
+        if (length != _data->blockSize()) {
+            _data->setBlockSize(length);
+        }
+
+        content.resize(static_cast<std::size_t>(COPY_BATCH) * length);
+        indices.clear();
+        srcs.clear();
+        for (; i < sorted.size() && indices.size() < COPY_BATCH && sorted[i].second.length == length; ++i) {
+            auto &image = sorted[i].second;
+            Byte *dest = content.data() + indices.size() * length;
+
+            readFully(fds.at(image.segment), dest, length, image.offset);
+            indices.push_back(sorted[i].first);
+            srcs.emplace_back(dest, length);
+        }
+
+        _data->writeBlocksV(indices.data(), indices.size(), srcs.data());
+    }
+
+    if (block_size != _data->blockSize()) {
+        _data->setBlockSize(block_size);
+    }
+    _data->flush();
+}
+
+void
+WriteAheadLog::setBlockSize(Length block_size)
+{
+    Driver::setBlockSize(block_size);
+    _data->setBlockSize(block_size);
+}
+
+void
+WriteAheadLog::readBlockLocked(BlockIndex index, Slice dest)
+{
+    auto iter = _pending.find(index);
+    if (iter == _pending.end()) {
+        iter = _committed.find(index);
+        if (iter == _committed.end()) {
+            _data->readBlock(index, dest);
+            return;
+        }
+    }
+
+    assert(iter->second.length == _block_size);
+    readFully(_segments.at(iter->second.segment).fd, dest.content(), _block_size, iter->second.offset);
+}
+
+void
+WriteAheadLog::readBlocks(BlockIndex index, Length count, Slice dest)
+{
+    assert(dest.length() >= _block_size * count);
+
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    bool logged = false;
+    for (Length i = 0; i < count && !logged; ++i) {
+        logged = _pending.count(index + i) || _committed.count(index + i);
+    }
+
+    if (!logged) {
+        _data->readBlocks(index, count, dest);
+        return;
+    }
+
+    for (Length i = 0; i < count; ++i) {
+        readBlockLocked(index + i, Slice(dest.content() + i * _block_size, _block_size));
+    }
+}
+
+void
+WriteAheadLog::readBlocksScattered(BlockIndex index, Length count, Slice *dests)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    for (Length i = 0; i < count; ++i) {
+        readBlockLocked(index + i, dests[i]);
+    }
+}
+
+void
+WriteAheadLog::writeBlocks(BlockIndex index, Length count, ConstSlice src)
+{
+    assert(src.length() >= _block_size * count);
+
+    std::vector<ConstSlice> srcs;
+    srcs.reserve(count);
+    for (Length i = 0; i < count; ++i) {
+        srcs.emplace_back(src.content() + i * _block_size, _block_size);
+    }
+    appendPages(index, count, srcs.data());
+}
+
+void
+WriteAheadLog::writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+{ appendPages(index, count, srcs); }
+
+void
+WriteAheadLog::commit()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (!_pending.empty()) {
+        std::vector<Byte> buf;
+        encode(buf, RECORD_COMMIT, 0, ConstSlice(nullptr, 0));
+        appendLocked(buf);
+
+        for (auto &image : _pending) {
+            _committed[image.first] = image.second;
+        }
+        _pending.clear();
+    }
+
+    // whoever syncs first syncs the records of everyone waiting
+    auto target = _position;
+    while (_synced < target) {
+        if (_syncing) {
+            _synced_cond.wait(lock);
+            continue;
+        }
+
+        _syncing = true;
+        auto end = _position;
+        int fd = _segments.rbegin()->second.fd;
+        lock.unlock();
+
+        int ret = syncFile(fd);
+
+        lock.lock();
+        _syncing = false;
+        _synced_cond.notify_all();
+        if (ret < 0) {
+            throw WriteAheadLogIOException();
+        }
+        _synced = std::max(_synced, end);
+        ++_sync_count;
+    }
+
+    bool wanted = _checkpoint_size && _position - _checkpoint_position >= _checkpoint_size;
+    lock.unlock();
+
+    if (wanted) {
+        {
+            std::lock_guard<std::mutex> checkpointer_lock(_checkpointer_mutex);
+            _checkpoint_wanted = true;
+        }
+        _checkpointer_cond.notify_one();
+    }
+}
+
+void
+WriteAheadLog::truncateBlocks(Length count)
+{
+    commit();
+    checkpoint();
+    _data->truncateBlocks(count);
+}
+
+void
+WriteAheadLog::checkpoint()
+{
+    std::lock_guard<std::mutex> checkpoint_guard(_checkpoint_mutex);
+
+    ImageMap images;
+    std::map<std::uint64_t, int> fds;
+    std::uint64_t boundary;
+
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (_committed.empty()) {
+            return;
+        }
+
+        // everything before the new segment is durable once switched
+        boundary = rotateLocked();
+        _checkpoint_position = _position;
+
+        // uncommitted pages are logged again, so older segments can be deleted
+        if (!_pending.empty()) {
+            std::vector<Byte> buf;
+            std::vector<std::pair<BlockIndex, std::uint64_t> > offsets;
+            Buffer content(Driver::MAX_BLOCK_SIZE);
+
+            for (auto &image : _pending) {
+                readFully(_segments.at(image.second.segment).fd, content.content(),
+                        image.second.length, image.second.offset);
+                offsets.emplace_back(image.first, buf.size() + sizeof(RecordHeader));
+                encode(buf, RECORD_PAGE, image.first, ConstSlice(content.content(), image.second.length));
+            }
+
+            auto offset = appendLocked(buf);
+            for (auto &relogged : offsets) {
+                _pending[relogged.first].segment = boundary;
+                _pending[relogged.first].offset = offset + relogged.second;
+            }
+        }
+
+        images = _committed;
+        for (auto &segment : _segments) {
+            if (segment.first < boundary) {
+                fds.emplace(segment.first, segment.second.fd);
+            }
+        }
+    }
+
+    // older segments are no longer written, copy their images without the mutex
+    copyImages(images, fds);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // a sync started before the switch may still use an older segment
+    while (_syncing) {
+        _synced_cond.wait(lock);
+    }
+
+    for (auto iter = _committed.begin(); iter != _committed.end(); ) {
+        if (iter->second.segment < boundary) {
+            iter = _committed.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+    dropSegmentsLocked(boundary);
+    ++_checkpoint_count;
+}
+
+void
+WriteAheadLog::runCheckpointer()
+{
+    std::unique_lock<std::mutex> lock(_checkpointer_mutex);
+
+    while (true) {
+        _checkpointer_cond.wait(lock, [this]() { return _checkpointer_stop || _checkpoint_wanted; });
+        if (_checkpointer_stop) {
+            break;
+        }
+        _checkpoint_wanted = false;
+
+        lock.unlock();
+        try {
+            checkpoint();
+        }
+        catch (const std::exception &) {
+            // the segments are kept, tried again when the log grows further
+        }
+        lock.lock();
+    }
+}
+
+void
+WriteAheadLog::setCheckpointSize(std::uint64_t size)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _checkpoint_size = size;
+}
+
+void
+WriteAheadLog::setSegmentSize(std::uint64_t size)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _segment_size = size;
+}
+
+std::uint64_t
+WriteAheadLog::size()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    std::uint64_t size = 0;
+    for (auto &segment : _segments) {
+        size += segment.second.size;
+    }
+    return size;
+}
+
+Length
+WriteAheadLog::segmentCount()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _segments.size();
+}
+
+std::uint64_t
+WriteAheadLog::syncCount()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _sync_count;
+}
+
+std::uint64_t
+WriteAheadLog::checkpointCount()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _checkpoint_count;
+}
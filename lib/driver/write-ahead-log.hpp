@@ -0,0 +1,296 @@
+#ifndef _DB_DRIVER_WRITE_AHEAD_LOG_H_
+#define _DB_DRIVER_WRITE_AHEAD_LOG_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "driver.hpp"
+
+namespace cdb {
+    struct WriteAheadLogIOException : public std::exception
+    {
+        const char *what() const noexcept
+        { return "I/O error in WriteAheadLog"; }
+    };
+
+    /**
+     * Driver logging page writes ahead of the data file.
+     *
+     * Blocks written to this driver are appended to the log as page images instead of
+     * being written to the data driver, and blocks read are served from their latest
+     * image in the log if there is one. commit() appends a commit record and syncs the
+     * log, so everything written since the previous commit becomes durable at once.
+     * Threads committing at the same time share a single sync. flush() does not commit,
+     * so writing back a cache never makes a half done change durable.
+     *
+     * The log is a sequence of segment files named "<path>.<n>". Pages reach the data
+     * driver only when the log is checkpointed, which is done in a background thread
+     * once the log grows by the checkpoint size. A checkpoint is fuzzy: it switches to a
+     * new segment, then copies the latest committed images of older segments to the data
+     * driver while writers and committers go on, and deletes those segments once the
+     * data driver is flushed. Uncommitted pages of older segments are logged again in
+     * the new segment first.
+     *
+     * So the segments left always start after the last completed checkpoint, and only
+     * they are replayed when constructed. Pages not followed by a commit record are
+     * discarded.
+     */
+    class WriteAheadLog : public Driver
+    {
+    public:
+        /** default growth of the log starting a checkpoint */
+        static const std::uint64_t CHECKPOINT_SIZE = 64 * 1024 * 1024;
+
+        /** default size of a segment before switching to the next one */
+        static const std::uint64_t SEGMENT_SIZE = 16 * 1024 * 1024;
+
+        struct RecordHeader;
+
+    private:
+        /** where the image of a block is in the log */
+        struct Image
+        {
+            std::uint64_t segment;  /** number of the segment */
+            std::uint64_t offset;   /** offset of the content in the segment */
+            Length length;          /** block size when logged */
+        };
+
+        typedef std::unordered_map<BlockIndex, Image> ImageMap;
+
+        struct Segment
+        {
+            int fd;                 /** file descriptor of the segment */
+            std::uint64_t size;     /** bytes appended to the segment */
+        };
+
+        std::unique_ptr<Driver> _data;
+
+        /** segments are named by appending their number to it */
+        std::string _path;
+
+        /** guards everything below, except the checkpointer */
+        std::mutex _mutex;
+        std::condition_variable _synced_cond;
+
+        /** live segments by number, the last one is appended to */
+        std::map<std::uint64_t, Segment> _segments;
+
+        /** bytes ever appended, the position of the next record */
+        std::uint64_t _position;
+
+        /** log before this position is durable */
+        std::uint64_t _synced;
+
+        /** true while a thread is syncing the log for the others */
+        bool _syncing;
+
+        /** sequence number of the next record */
+        std::uint64_t _next_lsn;
+
+        /** latest images written since the last commit record */
+        ImageMap _pending;
+
+        /** latest committed images not yet copied to the data driver */
+        ImageMap _committed;
+
+        /** position when the last checkpoint started */
+        std::uint64_t _checkpoint_position;
+
+        std::uint64_t _checkpoint_size;
+        std::uint64_t _segment_size;
+
+        /** number of syncs of the log */
+        std::uint64_t _sync_count;
+
+        /** number of checkpoints completed */
+        std::uint64_t _checkpoint_count;
+
+        /** only one checkpoint at a time */
+        std::mutex _checkpoint_mutex;
+
+        std::thread _checkpointer;
+
+        /** wakes the checkpointer, guards the flags below */
+        std::mutex _checkpointer_mutex;
+        std::condition_variable _checkpointer_cond;
+        bool _checkpointer_stop;
+        bool _checkpoint_wanted;
+
+        // not copiable
+        WriteAheadLog(const WriteAheadLog &) = delete;
+        WriteAheadLog &operator = (const WriteAheadLog &) = delete;
+
+        /**
+         * @param segment number of a segment
+         * @return path of the segment
+         */
+        std::string segmentPath(std::uint64_t segment) const;
+
+        /**
+         * Create an empty segment and append to it from now on, syncing the current one
+         *
+         * @return number of the new segment
+         */
+        std::uint64_t rotateLocked();
+
+        /**
+         * Close and delete segments before a given one
+         *
+         * @param boundary number of the first segment to keep
+         */
+        void dropSegmentsLocked(std::uint64_t boundary);
+
+        /**
+         * Append a record to a buffer
+         *
+         * @param buf the buffer
+         * @param type type of the record
+         * @param index block of a page record
+         * @param payload content of a page record
+         */
+        void encode(std::vector<Byte> &buf, std::uint32_t type, BlockIndex index, ConstSlice payload);
+
+        /**
+         * Write encoded records at the end of the log, switching to a new segment if the
+         * current one is full
+         *
+         * @param buf the records
+         * @return offset of the records in the last segment
+         */
+        std::uint64_t appendLocked(const std::vector<Byte> &buf);
+
+        /**
+         * Append page records at the end of the log with one write, without syncing
+         *
+         * @param index index of the first block
+         * @param count number of blocks
+         * @param srcs content of each block
+         */
+        void appendPages(BlockIndex index, Length count, const ConstSlice *srcs);
+
+        /**
+         * Read one block from its latest image, or from the data driver
+         *
+         * @param index index of the block
+         * @param dest where to read to
+         */
+        void readBlockLocked(BlockIndex index, Slice dest);
+
+        /**
+         * Copy images to the data driver and flush it
+         *
+         * @param images the images to copy
+         * @param fds file descriptor of the segment of each image
+         */
+        void copyImages(const ImageMap &images, const std::map<std::uint64_t, int> &fds);
+
+        /**
+         * Replay committed records of existing segments into the data driver, then
+         * delete them
+         */
+        void recover();
+
+        /** Body of the checkpointer thread */
+        void runCheckpointer();
+
+    public:
+        /**
+         * Open the log, replaying committed records of existing segments into the data
+         * driver, and start the checkpointer
+         *
+         * @param data driver of the data file, owned by the log
+         * @param path path of the log, segments are named by appending their number
+         */
+        WriteAheadLog(Driver *data, const char *path);
+
+        /** Stop the checkpointer, and checkpoint if everything is committed */
+        virtual ~WriteAheadLog();
+
+        virtual void setBlockSize(Length block_size);
+
+        virtual void readBlock(BlockIndex index, Slice dest)
+        { readBlocks(index, 1, dest); }
+
+        virtual void readBlocks(BlockIndex index, Length count, Slice dest);
+
+        virtual void writeBlock(BlockIndex index, ConstSlice src)
+        { writeBlocks(index, 1, src); }
+
+        virtual void writeBlocks(BlockIndex index, Length count, ConstSlice src);
+
+        virtual Length ioAlignment() const
+        { return _data->ioAlignment(); }
+
+        virtual void reserveBlocks(Length count)
+        { _data->reserveBlocks(count); }
+
+        /**
+         * Commit and checkpoint, so no image of a discarded block is copied to the data
+         * driver later, then truncate the data driver
+         *
+         * @param count number of blocks to keep
+         */
+        virtual void truncateBlocks(Length count);
+
+        /**
+         * Commit everything written so far, returns when it is durable
+         */
+        void commit();
+
+        /** Nothing to do, pages written are in the log and only commit() makes them durable */
+        virtual void flush()
+        { }
+
+        /**
+         * Copy committed pages to the data driver and delete the segments they are in.
+         * Writes and commits are not blocked while pages are copied. If the data driver
+         * fails to flush, its exception is thrown and no segment is deleted.
+         */
+        void checkpoint();
+
+        /**
+         * @param size growth of the log in bytes starting a checkpoint in the
+         *      background, 0 to disable
+         */
+        void setCheckpointSize(std::uint64_t size);
+
+        /**
+         * @param size size of a segment in bytes, segments may exceed it by one write
+         */
+        void setSegmentSize(std::uint64_t size);
+
+        /**
+         * @return bytes in live segments, which are replayed if opened again
+         */
+        std::uint64_t size();
+
+        /**
+         * @return number of live segments
+         */
+        Length segmentCount();
+
+        /**
+         * @return number of times the log is synced on commit
+         */
+        std::uint64_t syncCount();
+
+        /**
+         * @return number of checkpoints completed
+         */
+        std::uint64_t checkpointCount();
+
+    protected:
+        virtual void readBlocksScattered(BlockIndex index, Length count, Slice *dests);
+        virtual void writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs);
+    };
+}
+
+#endif // _DB_DRIVER_WRITE_AHEAD_LOG_H_
@@ -29,237 +29,11 @@ namespace cdb {
 
     struct BTree::LeafMark
     { NodeHeader header; };
-
-    struct BTree::NodeEntryIterator : public std::iterator<std::random_access_iterator_tag, Key>
-    {
-        Slice::SliceIterator entry;
-        BTree *owner = nullptr;
-
-        NodeEntryIterator(Slice::SliceIterator entry, BTree *owner)
-                : entry(entry), owner(owner)
-        { }
-
-        inline bool
-        operator == (const NodeEntryIterator &i) const
-        { return owner == i.owner && entry == i.entry; }
-
-        inline bool
-        operator != (const NodeEntryIterator &i) const
-        { return !this->operator==(i); }
-
-        inline bool
-        operator < (const NodeEntryIterator &i) const
-        { return entry < i.entry; }
-
-        inline bool
-        operator <= (const NodeEntryIterator &i) const
-        { return entry <= i.entry; }
-
-        inline bool
-        operator > (const NodeEntryIterator &i) const
-        { return entry > i.entry; }
-
-        inline bool
-        operator >= (const NodeEntryIterator &i) const
-        { return entry >= i.entry; }
-
-        inline Key operator* () const;
-
-        inline NodeEntryIterator &operator +=(int);
-        inline NodeEntryIterator &operator -=(int);
-
-        inline NodeEntryIterator
-        operator ++(int)
-        {
-            auto ret = *this;
-            this->operator+=(1);
-            return ret;
-        };
-
-        inline NodeEntryIterator &
-        operator ++()
-        { return this->operator+=(1); }
-
-        inline NodeEntryIterator
-        operator --(int)
-        {
-            auto ret = *this;
-            this->operator-=(1);
-            return ret;
-        }
-
-        inline NodeEntryIterator &
-        operator --()
-        { return this->operator-=(1); }
-
-        inline int operator -(const NodeEntryIterator &b) const;
-
-        inline NodeEntryIterator
-        operator +(int n) const
-        {
-            auto ret = *this;
-            return ret += n;
-        }
-
-        inline NodeEntryIterator
-        operator -(int n) const
-        {
-            auto ret = *this;
-            return ret -= n;
-        }
-
-        inline Key
-        operator[] (int offset) const
-        {
-            auto tmp = *this;
-            return *(tmp += offset);
-        }
-    };
-
-    struct BTree::LeafEntryIterator : public std::iterator<std::random_access_iterator_tag, Key>
-    {
-        Slice::SliceIterator entry;
-        BTree *owner = nullptr;
-
-        LeafEntryIterator(Slice::SliceIterator entry, BTree *owner)
-                : entry(entry), owner(owner)
-        { }
-
-        inline bool
-        operator == (const LeafEntryIterator &i) const
-        { return owner == i.owner && entry == i.entry; }
-
-        inline bool
-        operator != (const LeafEntryIterator &i) const
-        { return !this->operator==(i); }
-
-        inline bool
-        operator < (const LeafEntryIterator &i) const
-        { return entry < i.entry; }
-
-        inline bool
-        operator <= (const LeafEntryIterator &i) const
-        { return entry <= i.entry; }
-
-        inline bool
-        operator > (const LeafEntryIterator &i) const
-        { return entry > i.entry; }
-
-        inline bool
-        operator >= (const LeafEntryIterator &i) const
-        { return entry >= i.entry; }
-
-        inline Key operator* () const;
-
-        inline LeafEntryIterator &operator +=(int);
-        inline LeafEntryIterator &operator -=(int);
-
-        inline LeafEntryIterator
-        operator ++(int)
-        {
-            auto ret = *this;
-            this->operator+=(1);
-            return ret;
-        };
-
-        inline LeafEntryIterator &
-        operator ++()
-        { return this->operator+=(1); }
-
-        inline LeafEntryIterator
-        operator --(int)
-        {
-            auto ret = *this;
-            this->operator-=(1);
-            return ret;
-        }
-
-        inline LeafEntryIterator &
-        operator --()
-        { return this->operator-=(1); }
-
-        inline int operator -(const LeafEntryIterator &b) const;
-
-        inline LeafEntryIterator
-        operator +(int n) const
-        {
-            auto ret = *this;
-            return ret += n;
-        }
-
-        inline LeafEntryIterator
-        operator -(int n) const
-        {
-            auto ret = *this;
-            return ret -= n;
-        }
-
-        inline Key
-        operator[] (int offset) const
-        {
-            auto tmp = *this;
-            return *(tmp += offset);
-        }
-    };
-}
-
-BTree::Key
-BTree::NodeEntryIterator::operator * () const
-{
-    return owner->makeKey(
-            owner->getKeyFromNodeEntry(entry).start(),
-            owner->_key_size
-        );
-}
-
-BTree::NodeEntryIterator &
-BTree::NodeEntryIterator::operator += (int offset)
-{
-    entry += owner->nodeEntrySize() * offset;
-    return *this;
-}
-
-BTree::NodeEntryIterator &
-BTree::NodeEntryIterator::operator -= (int offset)
-{
-    entry -= owner->nodeEntrySize() * offset;
-    return *this;
-}
-
-int
-BTree::NodeEntryIterator::operator - (const NodeEntryIterator &b) const
-{ return (entry - b.entry) / owner->nodeEntrySize(); }
-
-BTree::Key
-BTree::LeafEntryIterator::operator * () const
-{
-    return owner->makeKey(
-            owner->getKeyFromLeafEntry(entry).start(),
-            owner->_key_size
-        );
 }
 
-BTree::LeafEntryIterator &
-BTree::LeafEntryIterator::operator += (int offset)
-{
-    entry += owner->leafEntrySize() * offset;
-    return *this;
-}
-
-BTree::LeafEntryIterator &
-BTree::LeafEntryIterator::operator -= (int offset)
-{
-    entry -= owner->leafEntrySize() * offset;
-    return *this;
-}
-
-int
-BTree::LeafEntryIterator::operator - (const LeafEntryIterator &b) const
-{ return (entry - b.entry) / owner->leafEntrySize(); }
-
 Length
 BTree::maximumEntryPerNode() const
-{ return (Driver::BLOCK_SIZE - sizeof(NodeMark)) / nodeEntrySize(); }
+{ return (_accesser->blockSize() - sizeof(NodeMark)) / nodeEntrySize(); }
 
 Length
 BTree::nodeEntrySize() const
@@ -267,7 +41,7 @@ BTree::nodeEntrySize() const
 
 Length
 BTree::maximumEntryPerLeaf() const
-{ return (Driver::BLOCK_SIZE - sizeof(LeafMark)) / leafEntrySize(); }
+{ return (_accesser->blockSize() - sizeof(LeafMark)) / leafEntrySize(); }
 
 Length
 BTree::leafEntrySize() const
@@ -344,30 +118,70 @@ Slice::SliceIterator
 BTree::getEntryInNodeByIndex(Block &node, Length index)
 { return getFirstEntryInNode(node) + index * nodeEntrySize(); }
 
+Length
+BTree::countKeysBefore(
+        Slice::SliceIterator first,
+        Length count,
+        Length stride,
+        Key key,
+        bool inclusive
+    )
+{
+    if (_key_functions) {
+        return _key_functions->count_before(
+                first.start(),
+                count,
+                stride,
+                getPointerOfKey(key),
+                _key_layout.length,
+                inclusive
+            );
+    }
+
+    Length low = 0;
+    Length high = count;
+    while (low < high) {
+        Length middle = low + (high - low) / 2;
+        auto *entry_key = (first + middle * stride).start();
+
+        bool before = inclusive ?
+            !_less(getPointerOfKey(key), entry_key) :
+            _less(entry_key, getPointerOfKey(key));
+        if (before) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+bool
+BTree::lessKey(const Byte *a, const Byte *b)
+{ return _key_functions ? _key_functions->less(a, b, _key_layout.length) : _less(a, b); }
+
+bool
+BTree::equalKey(const Byte *a, const Byte *b)
+{ return _key_functions ? _key_functions->equal(a, b, _key_layout.length) : _equal(a, b); }
+
 BlockIndex
 BTree::findInNode(Block &node, Key key)
 {
     assert(getHeaderFromNode(node)->prev ^ getMarkFromNode(node)->before);
 
-    auto entry_limit = getLimitEntryInNode(node);
     auto entry = getFirstEntryInNode(node);
-
-    if (_less(getPointerOfKey(key), getKeyFromNodeEntry(entry).start())) {
-        return getMarkFromNode(node)->before;
-    }
-
-    auto iter = std::upper_bound(
-            NodeEntryIterator(entry, this),
-            NodeEntryIterator(entry_limit, this),
+    auto count = countKeysBefore(
+            entry,
+            getHeaderFromNode(node)->entry_count,
+            nodeEntrySize(),
             key,
-            [&] (const Key &a, const Key &b) {
-                return _less(getPointerOfKey(a), getPointerOfKey(b));
-            }
+            true
         );
 
-    --iter;
-
-    return *getIndexFromNodeEntry(iter.entry);
+    return count ?
+        *getIndexFromNodeEntry(entry + (count - 1) * nodeEntrySize()) :
+        getMarkFromNode(node)->before;
 }
 
 BTree::Iterator
@@ -376,16 +190,15 @@ BTree::findInLeaf(Block &leaf, Key key)
     auto entry_limit = getLimitEntryInLeaf(leaf);
     auto entry = getFirstEntryInLeaf(leaf);
 
-    auto iter = std::lower_bound(
-            LeafEntryIterator(entry, this),
-            LeafEntryIterator(entry_limit, this),
+    entry += countKeysBefore(
+            entry,
+            getHeaderFromNode(leaf)->entry_count,
+            leafEntrySize(),
             key,
-            [&] (const Key &a, const Key &b) {
-                return _less(getPointerOfKey(a), getPointerOfKey(b));
-            }
-        );
+            false
+        ) * leafEntrySize();
 
-    if (iter.entry == entry_limit) {
+    if (entry == entry_limit) {
         if (getHeaderFromNode(leaf)->next) {
             return Iterator(
                     this,
@@ -398,7 +211,7 @@ BTree::findInLeaf(Block &leaf, Key key)
         }
     }
     else {
-        return Iterator(this, leaf, iter.entry - leaf.begin());
+        return Iterator(this, leaf, entry - leaf.begin());
     }
 }
 
@@ -421,7 +234,7 @@ Block
 BTree::splitLeaf(Block &old_leaf, Length split_offset)
 {
     // TODO to handle large record
-    Block new_leaf              = _accesser->aquire(_accesser->allocateBlock(old_leaf.index()));
+    Block new_leaf              = _accesser->aquire(allocateNode(old_leaf.index()));
     auto *new_header            = getHeaderFromNode(new_leaf);
     auto *old_header            = getHeaderFromNode(old_leaf);
 
@@ -457,7 +270,7 @@ BTree::splitNode(Block &old_node, Length split_offset)
 {
     assert(split_offset);
 
-    Block new_node = _accesser->aquire(_accesser->allocateBlock(old_node.index()));
+    Block new_node = _accesser->aquire(allocateNode(old_node.index()));
     auto *new_header = getHeaderFromNode(new_node);
     auto *old_header = getHeaderFromNode(old_node);
 
@@ -498,22 +311,21 @@ BTree::insertInLeaf(Block &leaf, Key key)
     auto entry_start = getFirstEntryInLeaf(leaf);
     auto entry_limit = getLimitEntryInLeaf(leaf);
 
-    auto iter = std::lower_bound(
-            LeafEntryIterator(entry_start, this),
-            LeafEntryIterator(entry_limit, this),
+    auto entry = entry_start + countKeysBefore(
+            entry_start,
+            header->entry_count,
+            leafEntrySize(),
             key,
-            [&] (const Key &a, const Key &b) {
-                return _less(getPointerOfKey(a), getPointerOfKey(b));
-            }
-        );
+            false
+        ) * leafEntrySize();
 
-    if (iter.entry != entry_limit && 
-            _equal(getKeyFromLeafEntry(iter.entry).start(), getPointerOfKey(key))) {
+    if (entry != entry_limit && 
+            equalKey(getKeyFromLeafEntry(entry).start(), getPointerOfKey(key))) {
         throw BTreeDuplicateKeyException();
     }
 
     std::copy_backward(
-            iter.entry,
+            entry,
             entry_limit,
             nextEntryInLeaf(entry_limit)
         );
@@ -523,10 +335,10 @@ BTree::insertInLeaf(Block &leaf, Key key)
     std::copy(
             getPointerOfKey(key),
             getPointerOfKey(key) + _key_size,
-            getKeyFromLeafEntry(iter.entry)
+            getKeyFromLeafEntry(entry)
         );
 
-    return Iterator(this, leaf, iter.entry - leaf.begin());
+    return Iterator(this, leaf, entry - leaf.begin());
 }
 
 void
@@ -536,17 +348,16 @@ BTree::insertInNode(Block &node, Key key, BlockIndex index)
     auto entry_start = getFirstEntryInNode(node);
     auto entry_limit = getLimitEntryInNode(node);
 
-    auto iter = std::lower_bound(
-            NodeEntryIterator(entry_start, this),
-            NodeEntryIterator(entry_limit, this),
+    auto entry = entry_start + countKeysBefore(
+            entry_start,
+            header->entry_count,
+            nodeEntrySize(),
             key,
-            [&] (const Key &a, const Key &b) {
-                return _less(getPointerOfKey(a), getPointerOfKey(b));
-            }
-        );
+            false
+        ) * nodeEntrySize();
 
     std::copy_backward(
-            iter.entry,
+            entry,
             entry_limit,
             nextEntryInNode(entry_limit)
         );
@@ -554,10 +365,10 @@ BTree::insertInNode(Block &node, Key key, BlockIndex index)
     std::copy(
             getPointerOfKey(key),
             getPointerOfKey(key) + _key_size,
-            getKeyFromNodeEntry(iter.entry)
+            getKeyFromNodeEntry(entry)
         );
 
-    *getIndexFromNodeEntry(iter.entry) = index;
+    *getIndexFromNodeEntry(entry) = index;
 
     ++header->entry_count;
 }
@@ -565,7 +376,7 @@ BTree::insertInNode(Block &node, Key key, BlockIndex index)
 Block
 BTree::newRoot(Key split_key, Block &before, Block &after)
 {
-    Block ret = _accesser->aquire(_accesser->allocateBlock(_root.index()));
+    Block ret = _accesser->aquire(allocateNode(_root.index()));
     auto *mark = getMarkFromNode(ret);
 
     mark->header.next = mark->header.prev = 0;
@@ -602,6 +413,11 @@ BTree::nextIterator(Iterator iter)
         auto *header = getHeaderFromNode(iter._block);
         iter._block = _accesser->aquire(header->next);
         iter._offset = getFirstEntryOffset();
+
+        // read the following leaf while this one is scanned
+        if (iter._block.index() != _last_leaf) {
+            _accesser->prefetch(getHeaderFromNode(iter._block)->next);
+        }
     }
 
     return iter;
@@ -621,6 +437,10 @@ BTree::prevIterator(Iterator iter)
         auto *header = getHeaderFromNode(iter._block);
         iter._block = _accesser->aquire(header->prev);
         iter._offset = getLimitEntryOffset(iter._block) - leafEntrySize();
+
+        if (iter._block.index() != _first_leaf) {
+            _accesser->prefetch(getHeaderFromNode(iter._block)->prev);
+        }
     }
 
     return iter;
@@ -629,24 +449,17 @@ BTree::prevIterator(Iterator iter)
 void
 BTree::eraseInLeaf(Block &leaf, Key key)
 {
+    auto *header = getHeaderFromNode(leaf);
     auto entry_limit = getLimitEntryInLeaf(leaf);
     auto entry = getFirstEntryInLeaf(leaf);
 
-    for (;
-            entry < entry_limit;
-            entry = nextEntryInLeaf(entry)
-    ) {
-        if (!_less(getKeyFromLeafEntry(entry).start(), getPointerOfKey(key))) {
-            break;
-        }
-    }
+    entry += countKeysBefore(entry, header->entry_count, leafEntrySize(), key, false) * leafEntrySize();
 
-    if (!_equal(getKeyFromLeafEntry(entry).start(), getPointerOfKey(key))) {
+    if (entry == entry_limit || !equalKey(getKeyFromLeafEntry(entry).start(), getPointerOfKey(key))) {
         // key not found
         return;
     }
 
-    auto *header = getHeaderFromNode(leaf);
     header->entry_count--;
 
     std::copy(
@@ -659,26 +472,18 @@ BTree::eraseInLeaf(Block &leaf, Key key)
 void
 BTree::eraseInNode(Block &node, Key key)
 {
+    auto *header = getHeaderFromNode(node);
     auto entry_limit = getLimitEntryInNode(node);
     auto entry = getFirstEntryInNode(node);
 
-    for (;
-            entry < entry_limit;
-            entry = nextEntryInNode(entry)
-    ) {
-        if (!_less(getKeyFromNodeEntry(entry).start(), getPointerOfKey(key))) {
-            break;
-        }
-    }
-
-    auto *header = getHeaderFromNode(node);
+    entry += countKeysBefore(entry, header->entry_count, nodeEntrySize(), key, false) * nodeEntrySize();
 
     assert(
-            _equal(getKeyFromNodeEntry(entry).start(), getPointerOfKey(key)) ||
+            equalKey(getKeyFromNodeEntry(entry).start(), getPointerOfKey(key)) ||
             header->prev == 0
         );
 
-    if (!_equal(getKeyFromNodeEntry(entry).start(), getPointerOfKey(key)) && header->prev == 0) {
+    if (!equalKey(getKeyFromNodeEntry(entry).start(), getPointerOfKey(key)) && header->prev == 0) {
         // remove before
         assert(entry == getFirstEntryInNode(node));
         getMarkFromNode(node)->before = *getIndexFromNodeEntry(entry);
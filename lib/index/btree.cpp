@@ -1,26 +1,296 @@
+#include <algorithm>
+#include <bitset>
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include <stack>
 
+#if defined __AVX2__
+    #include <immintrin.h>
+#endif
+
 #include "btree-intl.hpp"
 
 using namespace cdb;
 
+/** number of entries left to compare one by one after the binary search */
+static const Length SEARCH_WINDOW = 16;
+
+template <typename T>
+static inline T
+loadKey(const Byte *entry)
+{
+    T ret;
+    std::memcpy(&ret, entry, sizeof(ret));
+    return ret;
+}
+
+template <typename T>
+static inline bool
+isKeyBefore(T entry_key, T key, bool inclusive)
+{ return inclusive ? entry_key <= key : entry_key < key; }
+
+#if defined __AVX2__
+/**
+ * Count keys before `key' among the 8 keys at `offsets' bytes from `base', only the
+ * lanes set in `lanes' are loaded and counted
+ */
+static inline Length
+countLanesBefore(const Byte *base, __m256i offsets, __m256i lanes, int key, bool inclusive)
+{
+    __m256i keys = _mm256_mask_i32gather_epi32(
+            _mm256_setzero_si256(), reinterpret_cast<const int*>(base), offsets, lanes, 1);
+    __m256i target = _mm256_set1_epi32(key);
+    __m256i before = inclusive ?
+        _mm256_andnot_si256(_mm256_cmpgt_epi32(keys, target), lanes) :
+        _mm256_and_si256(_mm256_cmpgt_epi32(target, keys), lanes);
+
+    return std::bitset<8>(_mm256_movemask_ps(_mm256_castsi256_ps(before))).count();
+}
+
+static inline Length
+countLanesBefore(const Byte *base, __m256i offsets, __m256i lanes, float key, bool inclusive)
+{
+    __m256 mask = _mm256_castsi256_ps(lanes);
+    __m256 keys = _mm256_mask_i32gather_ps(
+            _mm256_setzero_ps(), reinterpret_cast<const float*>(base), offsets, mask, 1);
+    __m256 target = _mm256_set1_ps(key);
+    __m256 before = _mm256_and_ps(
+            inclusive ?
+                _mm256_cmp_ps(keys, target, _CMP_LE_OQ) :
+                _mm256_cmp_ps(keys, target, _CMP_LT_OQ),
+            mask
+        );
+
+    return std::bitset<8>(_mm256_movemask_ps(before)).count();
+}
+#endif
+
+/**
+ * Count sorted keys of type T before `key', @see BTree::countKeysBefore
+ */
+template <typename T>
+static Length
+searchKeys(const Byte *first, Length count, Length stride, T key, bool inclusive)
+{
+    Length low = 0;
+    Length high = count;
+
+    while (high - low > SEARCH_WINDOW) {
+        Length middle = low + (high - low) / 2;
+        if (isKeyBefore(loadKey<T>(first + middle * stride), key, inclusive)) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    Length ret = low;
+
+#if defined __AVX2__
+    const __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i offsets = _mm256_mullo_epi32(lane_index, _mm256_set1_epi32(static_cast<int>(stride)));
+    for (Length i = low; i < high; i += 8) {
+        __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(high - i)), lane_index);
+        ret += countLanesBefore(first + i * stride, offsets, lanes, key, inclusive);
+    }
+#else
+    for (Length i = low; i < high; ++i) {
+        ret += isKeyBefore(loadKey<T>(first + i * stride), key, inclusive);
+    }
+#endif
+
+    return ret;
+}
+
+/** INTEGER field of keys */
+struct IntegerField
+{
+    static inline bool
+    less(const Byte *a, const Byte *b)
+    { return loadKey<int>(a) < loadKey<int>(b); }
+
+    static inline bool
+    equal(const Byte *a, const Byte *b)
+    { return loadKey<int>(a) == loadKey<int>(b); }
+};
+
+/** FLOAT field of keys */
+struct FloatField
+{
+    static inline bool
+    less(const Byte *a, const Byte *b)
+    { return loadKey<float>(a) < loadKey<float>(b); }
+
+    static inline bool
+    equal(const Byte *a, const Byte *b)
+    { return loadKey<float>(a) == loadKey<float>(b); }
+};
+
+/** CHAR field of keys, always terminated by '\0' */
+struct CharField
+{
+    static inline bool
+    less(const Byte *a, const Byte *b)
+    { return std::strcmp(reinterpret_cast<const char*>(a), reinterpret_cast<const char*>(b)) < 0; }
+
+    static inline bool
+    equal(const Byte *a, const Byte *b)
+    { return std::strcmp(reinterpret_cast<const char*>(a), reinterpret_cast<const char*>(b)) == 0; }
+};
+
+/** keys of a single field */
+template <typename Field>
+struct SingleKey
+{
+    static bool
+    less(const Byte *a, const Byte *b, Length)
+    { return Field::less(a, b); }
+
+    static bool
+    equal(const Byte *a, const Byte *b, Length)
+    { return Field::equal(a, b); }
+};
+
+/**
+ * keys of a field `length' bytes long followed by another field,
+ * @see Comparator::getCombineCmpFuncLT
+ */
+template <typename First, typename Second>
+struct CombinedKey
+{
+    static bool
+    less(const Byte *a, const Byte *b, Length length)
+    {
+        if (First::less(a, b)) {
+            return true;
+        }
+        if (First::less(b, a)) {
+            return false;
+        }
+        return Second::less(a + length, b + length);
+    }
+
+    static bool
+    equal(const Byte *a, const Byte *b, Length length)
+    { return First::equal(a, b) && Second::equal(a + length, b + length); }
+};
+
+/**
+ * Count sorted keys before `key' by binary search, @see BTree::countKeysBefore
+ */
+template <typename Compare>
+static Length
+countBefore(const Byte *first, Length count, Length stride, const Byte *key, Length length, bool inclusive)
+{
+    Length low = 0;
+    Length high = count;
+
+    while (low < high) {
+        Length middle = low + (high - low) / 2;
+        const Byte *entry_key = first + middle * stride;
+
+        bool before = inclusive ?
+            !Compare::less(key, entry_key, length) :
+            Compare::less(entry_key, key, length);
+        if (before) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+template <>
+Length
+countBefore<SingleKey<IntegerField> >(
+        const Byte *first, Length count, Length stride, const Byte *key, Length, bool inclusive)
+{ return searchKeys(first, count, stride, loadKey<int>(key), inclusive); }
+
+template <>
+Length
+countBefore<SingleKey<FloatField> >(
+        const Byte *first, Length count, Length stride, const Byte *key, Length, bool inclusive)
+{ return searchKeys(first, count, stride, loadKey<float>(key), inclusive); }
+
+template <typename Compare>
+const BTree::KeyFunctions *
+BTree::getKeyFunctions()
+{
+    static const KeyFunctions functions = {
+        &countBefore<Compare>,
+        &Compare::less,
+        &Compare::equal
+    };
+    return &functions;
+}
+
+template <typename First>
+const BTree::KeyFunctions *
+BTree::getKeyFunctions(KeyType second)
+{
+    switch (second) {
+        case KeyType::INTEGER:
+            return getKeyFunctions<CombinedKey<First, IntegerField> >();
+        case KeyType::FLOAT:
+            return getKeyFunctions<CombinedKey<First, FloatField> >();
+        case KeyType::CHAR:
+            return getKeyFunctions<CombinedKey<First, CharField> >();
+        default:
+            return nullptr;
+    }
+}
+
+const BTree::KeyFunctions *
+BTree::getKeyFunctions(const KeyLayout &layout)
+{
+    bool single = !layout.length;
+
+    switch (layout.type) {
+        case KeyType::INTEGER:
+            return single ?
+                getKeyFunctions<SingleKey<IntegerField> >() :
+                getKeyFunctions<IntegerField>(layout.second_type);
+        case KeyType::FLOAT:
+            return single ?
+                getKeyFunctions<SingleKey<FloatField> >() :
+                getKeyFunctions<FloatField>(layout.second_type);
+        case KeyType::CHAR:
+            return single ?
+                getKeyFunctions<SingleKey<CharField> >() :
+                getKeyFunctions<CharField>(layout.second_type);
+        default:
+            return nullptr;
+    }
+}
+
 BTree::BTree(
         DriverAccesser *accesser,
         Comparator less,
         Comparator equal,
         BlockIndex root_index,
         Length key_size,
-        Length value_size
+        Length value_size,
+        KeyLayout key_layout
     )
     : _accesser(accesser),
       _less(less),
       _equal(equal),
+      _key_layout(key_layout),
+      _key_functions(getKeyFunctions(key_layout)),
       _root(accesser->aquire(root_index)),
       _key_size(key_size),
       _value_size(value_size)
 {
+    assert(_key_layout.length < _key_size);
+    assert(_key_layout.length ||
+            (_key_layout.type != KeyType::INTEGER && _key_layout.type != KeyType::FLOAT) ||
+            _key_size == sizeof(int));
+
     // replace first & last leaf
     auto *header = getHeaderFromNode(_root);
     _first_leaf = header->prev;
@@ -39,6 +309,10 @@ BTree::~BTree()
     }
 }
 
+BlockIndex
+BTree::allocateNode(BlockIndex hint)
+{ return _accesser->allocateBlock(hint); }
+
 void
 BTree::reset()
 {
@@ -49,10 +323,11 @@ BTree::reset()
 void
 BTree::init()
 {
-    if (_root.index()) {
-        _accesser->freeBlock(_root.index());
+    BlockIndex old_root = _root.index();
+    if (old_root) {
+        _accesser->freeBlock(old_root);
     }
-    _root = _accesser->aquire(_accesser->allocateBlock());
+    _root = _accesser->aquire(allocateNode(old_root));
     auto *header = getHeaderFromNode(_root);
     *header = {
         true,   // node_is_leaf
@@ -72,6 +347,160 @@ BTree::clean()
     _root = _accesser->aquire(0);
 }
 
+void
+BTree::compact()
+{
+    BlockIndex hint = 0;
+    relocateNode(_root.index(), hint);
+
+    // children are moved while walking their parents in order, level by level
+    Block first = _root;
+    while (!getHeaderFromNode(first)->node_is_leaf) {
+        BlockIndex next_first = 0;
+
+        Block node = first;
+        while (true) {
+            auto *mark = getMarkFromNode(node);
+            if (mark->before) {
+                mark->before = relocateNode(mark->before, hint);
+            }
+
+            auto entry_limit = getLimitEntryInNode(node);
+            for (
+                    auto entry = getFirstEntryInNode(node);
+                    entry < entry_limit;
+                    entry = nextEntryInNode(entry)
+            ) {
+                auto *index = getIndexFromNodeEntry(entry);
+                *index = relocateNode(*index, hint);
+            }
+
+            if (!next_first) {
+                next_first = mark->before ?
+                    mark->before :
+                    *getIndexFromNodeEntry(getFirstEntryInNode(node));
+            }
+
+            if (!mark->header.next) {
+                break;
+            }
+            node = _accesser->aquire(mark->header.next);
+        }
+
+        first = _accesser->aquire(next_first);
+    }
+}
+
+void
+BTree::bulkLoad(Source source, double fill_factor)
+{
+    assert(fill_factor > 0 && fill_factor <= 1);
+
+    const Byte *record = source();
+    if (!record) {
+        init();
+        return;
+    }
+
+    if (_root.index()) {
+        _accesser->freeBlock(_root.index());
+    }
+
+    Length per_leaf = std::max<Length>(1, maximumEntryPerLeaf() * fill_factor);
+    Length per_node = std::max<Length>(
+            std::min<Length>(2, maximumEntryPerNode()),
+            maximumEntryPerNode() * fill_factor
+        );
+
+    // first key and index of each node in the level built last
+    std::vector<Byte> first_keys;
+    std::vector<BlockIndex> nodes;
+    Buffer last_key(_key_size);
+
+    BlockIndex index = allocateNode(_root.index());
+    BlockIndex prev = 0;
+    _first_leaf = index;
+    while (record) {
+        Block leaf = _accesser->aquire(index);
+        auto entry = getFirstEntryInLeaf(leaf);
+        Length count = 0;
+        for (; record && count < per_leaf; ++count, record = source()) {
+            assert((!count && !prev) || lessKey(
+                    count ?
+                        getKeyFromLeafEntry(prevEntryInLeaf(entry)).start() :
+                        last_key.content(),
+                    record
+                ));
+            std::copy(record, record + leafEntrySize(), entry);
+            entry = nextEntryInLeaf(entry);
+        }
+
+        auto *first_key = getKeyFromLeafEntry(getFirstEntryInLeaf(leaf)).start();
+        first_keys.insert(first_keys.end(), first_key, first_key + _key_size);
+        nodes.push_back(index);
+
+        auto *last = getKeyFromLeafEntry(prevEntryInLeaf(entry)).start();
+        std::copy(last, last + _key_size, last_key.content());
+
+        auto *header = getHeaderFromNode(leaf);
+        header->node_is_leaf    = true;
+        header->node_length     = 1;
+        header->entry_count     = count;
+        header->prev            = prev;
+        header->next            = record ? allocateNode(index) : 0;
+
+        prev = index;
+        index = header->next;
+    }
+    _last_leaf = prev;
+
+    while (nodes.size() > 1) {
+        std::vector<Byte> upper_keys;
+        std::vector<BlockIndex> upper_nodes;
+
+        index = allocateNode(nodes.back());
+        prev = 0;
+        for (Length child = 0; child < nodes.size(); ) {
+            Block node = _accesser->aquire(index);
+            auto *mark = getMarkFromNode(node);
+
+            auto *first_key = &first_keys[child * _key_size];
+            upper_keys.insert(upper_keys.end(), first_key, first_key + _key_size);
+            upper_nodes.push_back(index);
+
+            // the first child of the first node in this level goes to `before'
+            mark->before = prev ? 0 : nodes[child++];
+
+            auto entry = getFirstEntryInNode(node);
+            Length count = 0;
+            for (; child < nodes.size() && count < per_node; ++child, ++count) {
+                first_key = &first_keys[child * _key_size];
+                std::copy(first_key, first_key + _key_size, getKeyFromNodeEntry(entry));
+                *getIndexFromNodeEntry(entry) = nodes[child];
+                entry = nextEntryInNode(entry);
+            }
+
+            mark->header.node_is_leaf   = false;
+            mark->header.node_length    = 1;
+            mark->header.entry_count    = count;
+            mark->header.prev           = prev;
+            mark->header.next           = child < nodes.size() ? allocateNode(index) : 0;
+
+            prev = index;
+            index = mark->header.next;
+        }
+
+        first_keys.swap(upper_keys);
+        nodes.swap(upper_nodes);
+    }
+
+    _root = _accesser->aquire(nodes.front());
+}
+
+bool
+BTree::less(const Byte *a, const Byte *b)
+{ return lessKey(a, b); }
+
 BTree::Iterator
 BTree::lowerBound(Key key)
 {
@@ -87,7 +516,7 @@ BTree::upperBound(Key key)
     if (iter == end()) {
         return iter;
     }
-    if (_equal(iter.getKey().start(), getPointerOfKey(key))) {
+    if (equalKey(iter.getKey().start(), getPointerOfKey(key))) {
         return nextIterator(lowerBound(key));
     }
     else {
@@ -102,6 +531,15 @@ BTree::insert(Key key)
     keepTracingToLeaf(key, path);
 
     if (getHeaderFromNode(path.top())->entry_count >= maximumEntryPerLeaf()) {
+        // a duplicated key must be found before the leaf is split
+        auto count = getHeaderFromNode(path.top())->entry_count;
+        auto entry = getFirstEntryInLeaf(path.top());
+        auto position = countKeysBefore(entry, count, leafEntrySize(), key, false);
+        if (position < count &&
+                equalKey(getKeyFromLeafEntry(entry + position * leafEntrySize()).start(), getPointerOfKey(key))) {
+            throw BTreeDuplicateKeyException();
+        }
+
         Iterator ret = end();
 
         Length split_offset = getHeaderFromNode(path.top())->entry_count / 2;
@@ -113,7 +551,7 @@ BTree::insert(Key key)
             );
 
         if (maximumEntryPerLeaf() > 1 && 
-             _less(getPointerOfKey(key), getPointerOfKey(split_key))
+             lessKey(getPointerOfKey(key), getPointerOfKey(split_key))
         ) {
             ret = insertInLeaf(path.top(), key);
         }
@@ -131,7 +569,7 @@ BTree::insert(Key key)
             auto split_offset = getHeaderFromNode(path.top())->entry_count / 2;
             new_node = splitNode(path.top(), split_offset);
 
-            if (_less(getPointerOfKey(split_key), getKeyFromNodeEntry(getFirstEntryInNode(new_node)).start())) {
+            if (lessKey(getPointerOfKey(split_key), getKeyFromNodeEntry(getFirstEntryInNode(new_node)).start())) {
                 insertInNode(path.top(), split_key, index_to_insert);
             }
             else {
@@ -162,7 +600,11 @@ BTree::insert(Key key)
 BTree::Iterator
 BTree::begin()
 {
-    return Iterator(this, _accesser->aquire(_first_leaf), getFirstEntryOffset());
+    Block first_leaf = _accesser->aquire(_first_leaf);
+    if (_first_leaf != _last_leaf) {
+        _accesser->prefetch(getHeaderFromNode(first_leaf)->next);
+    }
+    return Iterator(this, first_leaf, getFirstEntryOffset());
 }
 
 BTree::Iterator
@@ -199,6 +641,11 @@ BTree::cleanNodeRecursive(Block &node)
         return;
     }
 
+    if (getMarkFromNode(node)->before) {
+        Block before = _accesser->aquire(getMarkFromNode(node)->before);
+        cleanNodeRecursive(before);
+    }
+
     auto entry = getFirstEntryInNode(node);
     auto entry_limit = getLimitEntryInNode(node);
 
@@ -210,6 +657,47 @@ BTree::cleanNodeRecursive(Block &node)
     _accesser->freeBlock(node.index());
 }
 
+BlockIndex
+BTree::relocateNode(BlockIndex index, BlockIndex &hint)
+{
+    BlockIndex target = _accesser->allocateBlock(hint);
+    if (target > index) {
+        _accesser->freeBlock(target);
+        return index;
+    }
+
+    Block node = _accesser->aquire(index);
+    Block moved = _accesser->aquire(target);
+    std::copy(node.cbegin(), node.cend(), moved.begin());
+
+    auto *header = getHeaderFromNode(moved);
+    if (header->prev) {
+        Block prev_node = _accesser->aquire(header->prev);
+        getHeaderFromNode(prev_node)->next = target;
+    }
+    if (header->next) {
+        Block next_node = _accesser->aquire(header->next);
+        getHeaderFromNode(next_node)->prev = target;
+    }
+
+    if (header->node_is_leaf) {
+        if (_first_leaf == index) {
+            _first_leaf = target;
+        }
+        if (_last_leaf == index) {
+            _last_leaf = target;
+        }
+    }
+
+    if (_root.index() == index) {
+        _root = std::move(moved);
+    }
+
+    _accesser->freeBlock(index);
+    hint = target;
+    return target;
+}
+
 void
 BTree::erase(Key key)
 {
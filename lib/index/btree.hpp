@@ -25,7 +25,7 @@ namespace cdb {
     /**
      * BTree is actually a B+ tree.
      *
-     * Each node of this B+ tree is a block in the disk. 
+     * Each node of this B+ tree is a block in the disk, of the accesser's blockSize().
      *
      * There two kinds of node in this B+ tree, they are:
      *  - Leaf node
@@ -50,7 +50,7 @@ namespace cdb {
      * +----------+
      *     ....
      *
-     * Each leaf node contains (BLOCK_SIZE - sizeof(LeafMark)) / (key_size + value_size) 
+     * Each leaf node contains (blockSize() - sizeof(LeafMark)) / (key_size + value_size)
      * records. Currently LeafMark only contains a Header, and binary searching is 
      * performed in the leaf node.
      *
@@ -71,7 +71,7 @@ namespace cdb {
      * +----------+
      *     ....
      *
-     * Each non-leaf node contains (BLOCK_SIZE - sizeof(NodeMark)) / (key_size + 4) 
+     * Each non-leaf node contains (blockSize() - sizeof(NodeMark)) / (key_size + 4)
      * records. Compared to LeafMark, a `before' field is added to NodeMark. So all 
      * records with a key not less than nth key is stored in a subtree indexed by nth 
      * index. Currently bineay searching is performed in the non-leaf node, so all entries
@@ -83,6 +83,10 @@ namespace cdb {
      *
      * The root node is always in memory when a BTree is constructed.
      *
+     * A new node is allocated next to the node it is split from, and a bulk loaded node
+     * next to the one loaded before, so leaves of a tree growing at its end or loaded at
+     * once are laid in contiguous runs. Nothing is reserved for a tree ahead of time.
+     *
      * NOTE: all key in the BTree should be unique
      */
     class BTree
@@ -172,12 +176,55 @@ namespace cdb {
          */
         typedef std::function<bool(const Byte *, const Byte *)> Comparator;
 
+        /**
+         * Type of a field of keys known by the BTree, GENERIC fields are unknown and only
+         * compared by the Comparator
+         */
+        enum class KeyType
+        {
+            GENERIC,
+            INTEGER,
+            FLOAT,
+            CHAR
+        };
+
+        /**
+         * Layout of keys, either a single field of `type', or a field of `type' taking the
+         * first `length' bytes followed by a field of `second_type', compared one after
+         * another like the keys of indices.
+         *
+         * Keys with a known layout are compared by functions picked when the BTree is
+         * constructed, instead of calling the Comparator. Keys with a GENERIC field are
+         * compared by the Comparator.
+         */
+        struct KeyLayout
+        {
+            KeyType type;
+            Length length;          /** length of the first field, 0 for a single field */
+            KeyType second_type;    /** GENERIC for a single field */
+
+            KeyLayout(KeyType type = KeyType::GENERIC)
+                : type(type), length(0), second_type(KeyType::GENERIC)
+            { }
+
+            KeyLayout(KeyType type, Length length, KeyType second_type)
+                : type(type), length(length), second_type(second_type)
+            { }
+        };
+
         /**
          * The Operator is used in operating records when invoking `forEach()' and 
          * `forEachReverse()'
          */
         typedef std::function<void(const Iterator &)> Operator;
 
+        /**
+         * The Source yields records for `bulkLoad()' in increasing order of keys, each
+         * record is a key followed by its value like an entry in a leaf. nullptr is
+         * returned when no record is left.
+         */
+        typedef std::function<const Byte *()> Source;
+
     private:
         struct NodeHeader;
         struct NodeMark;
@@ -199,22 +246,27 @@ namespace cdb {
         };
 
         /**
-         * Iterator used when performing binary search (currently using `std::upper_bound'
-         * in `findInNode'
+         * Functions comparing keys of a KeyLayout, instantiated for each layout. The
+         * comparison of fields is inlined into the binary search of count_before, while
+         * less and equal are still called through the pointers for a single pair of keys.
+         * Each takes the `length' of the KeyLayout.
          *
-         * NOTE: this iterator is not a fully implemented standerd random access iterator,
-         * and it should not be used in other place.
+         * @see getKeyFunctions(const KeyLayout &layout)
          */
-        struct NodeEntryIterator;
-
-        /**
-         * Iterator used when performing binary search (currently using `std::lower_bound'
-         * in `findInLeaf'
-         *
-         * NOTE: this iterator is not a fully implemented standerd random access iterator,
-         * and it should not be used in other place.
-         */
-        struct LeafEntryIterator;
+        struct KeyFunctions
+        {
+            /** @see countKeysBefore */
+            Length (*count_before)(
+                    const Byte *first,
+                    Length count,
+                    Length stride,
+                    const Byte *key,
+                    Length length,
+                    bool inclusive
+                );
+            bool (*less)(const Byte *a, const Byte *b, Length length);
+            bool (*equal)(const Byte *a, const Byte *b, Length length);
+        };
 
         /** this type is used to keep path to a leaf when search. @see keepTracingToLeaf */
         typedef std::stack<Block> BlockStack;
@@ -222,6 +274,10 @@ namespace cdb {
         DriverAccesser *_accesser;
         Comparator _less;
         Comparator _equal;
+        KeyLayout _key_layout;
+
+        /** nullptr if keys are compared by the Comparator */
+        const KeyFunctions *_key_functions;
 
         /** 
          * When on disk, `prev' and `next' field of the root node is used to store 
@@ -232,12 +288,20 @@ namespace cdb {
         BlockIndex _last_leaf;
 
         /**
-         * Currently _key_size + _value_size should less than 
-         * BLOCK_SIZE - sizeof(LeafMark)
+         * Currently _key_size + _value_size should less than
+         * _accesser->blockSize() - sizeof(LeafMark)
          */
         Length _key_size;
         Length _value_size;
 
+        /**
+         * Allocate a block for a new node, as near after `hint' as possible
+         *
+         * @param hint index of the node the new one is split from or follows
+         * @return index of the block
+         */
+        BlockIndex allocateNode(BlockIndex hint);
+
         /**
          * @return _key_size + 4
          */
@@ -305,6 +369,59 @@ namespace cdb {
          */
         inline Iterator   findInLeaf(Block &leaf, Key key);
 
+        /**
+         * Count entries in a node or leaf whose key is less than `key', or not greater
+         * than `key' if `inclusive'. Keys are sorted, so the result is the index
+         * lower_bound (or upper_bound) gives.
+         *
+         * Single INTEGER and FLOAT keys are compared a vector of keys at a time when
+         * AVX2 is available, after a binary search narrows the range.
+         *
+         * @param first the first entry
+         * @param count number of entries
+         * @param stride size of each entry
+         * @param key the key to compare with
+         * @param inclusive whether entries equal to `key' are counted
+         * @return number of entries counted
+         */
+        inline Length countKeysBefore(
+                Slice::SliceIterator first,
+                Length count,
+                Length stride,
+                Key key,
+                bool inclusive
+            );
+
+        /**
+         * Compare two keys by the KeyFunctions, or the Comparator for unknown layouts
+         *
+         * @return whether `a' is less than `b'
+         * @see equalKey
+         */
+        inline bool lessKey(const Byte *a, const Byte *b);
+
+        /**
+         * @return whether `a' is equal to `b'
+         * @see lessKey
+         */
+        inline bool equalKey(const Byte *a, const Byte *b);
+
+        /**
+         * Pick the KeyFunctions of a layout
+         *
+         * @param layout the layout of keys
+         * @return the functions, or nullptr if any field is GENERIC
+         */
+        static const KeyFunctions *getKeyFunctions(const KeyLayout &layout);
+
+        /** @return functions of keys of a field `First' followed by a field of `second' */
+        template <typename First>
+        static const KeyFunctions *getKeyFunctions(KeyType second);
+
+        /** @return functions comparing keys with `Compare' */
+        template <typename Compare>
+        static const KeyFunctions *getKeyFunctions();
+
         /**
          * Find the leaf from the root, keep trace the whole path
          * 
@@ -507,6 +624,17 @@ namespace cdb {
          * Clean a node and its subtree, free all blocks
          */
         void cleanNodeRecursive(Block &node);
+
+        /**
+         * Move a node to a free block before it, allocated near the hint, and update
+         * the links of its siblings, the first & last leaf and the root. The index in its
+         * parent is left to the caller.
+         *
+         * @param index index of the node
+         * @param hint [in,out] where the previous node is moved to
+         * @return new index of the node, or `index' if not moved
+         */
+        BlockIndex relocateNode(BlockIndex index, BlockIndex &hint);
     public:
         BTree(
                 DriverAccesser *accesser,
@@ -514,7 +642,8 @@ namespace cdb {
                 Comparator equal,
                 BlockIndex root_index,
                 Length key_size,
-                Length value_size
+                Length value_size,
+                KeyLayout key_layout = KeyLayout()
             );
 
         ~BTree();
@@ -546,6 +675,13 @@ namespace cdb {
         Length valueSize() const
         { return _value_size; }
 
+        /**
+         * Compare two keys in the order of the tree
+         *
+         * @return whether key `a' is less than key `b'
+         */
+        bool less(const Byte *a, const Byte *b);
+
         /**
          * Find the lower bound of key
          *
@@ -669,6 +805,31 @@ namespace cdb {
          */
         void clean();
 
+        /**
+         * Move nodes to free blocks towards the beginning of the driver, level by level
+         * from the root, so nodes of each level are laid in key order. A node stays
+         * where it is if no free block before it is found.
+         *
+         * NOTE: the root index may change, and no Iterator of the tree should be alive
+         */
+        void compact();
+
+        /**
+         * Build the whole tree from records in increasing order, instead of inserting
+         * them one by one.
+         *
+         * Leaves are filled left to right, each up to `fill_factor' of its capacity, then
+         * each level of non-leaf nodes is built from the first keys of the level below,
+         * so nodes are laid sequentially in key order. Like `init()', the old root is
+         * dropped without its subtree, so the tree should be empty or cleaned.
+         *
+         * NOTE: keys must be strictly increasing, which is not checked except asserted
+         *
+         * @param source the Source of records
+         * @param fill_factor part of each node to fill, in (0, 1]
+         */
+        void bulkLoad(Source source, double fill_factor = 1.0);
+
         /**
          * Make a key from a pointer
          *
@@ -37,11 +37,11 @@ LinearTable::getMaximumRecordCountByBlockIndex(BlockIndex index) const
 
 Length
 LinearTable::getMaximumRecordCountInHead() const
-{ return (Driver::BLOCK_SIZE - sizeof(Header) - sizeof(BlockHeader)) / _value_size; }
+{ return (_accesser->blockSize() - sizeof(Header) - sizeof(BlockHeader)) / _value_size; }
 
 Length
 LinearTable::getMaximumRecordCountInNormal() const
-{ return (Driver::BLOCK_SIZE - sizeof(BlockHeader)) / _value_size; }
+{ return (_accesser->blockSize() - sizeof(BlockHeader)) / _value_size; }
 
 Block
 LinearTable::fetchBlockByIndex(BlockIndex index)
@@ -73,17 +73,17 @@ constexpr Length
 LinearTable::directBlockCount()
 { return sizeof(Header::direct) / sizeof(Header::direct[0]); }
 
-constexpr Length
-LinearTable::primaryBlockCount()
-{ return Driver::BLOCK_SIZE / sizeof(BlockIndex); }
+Length
+LinearTable::primaryBlockCount() const
+{ return _accesser->blockSize() / sizeof(BlockIndex); }
 
-constexpr Length
-LinearTable::secondaryBlockCount()
-{ return primaryBlockCount() * (Driver::BLOCK_SIZE / sizeof(BlockIndex)); }
+Length
+LinearTable::secondaryBlockCount() const
+{ return primaryBlockCount() * (_accesser->blockSize() / sizeof(BlockIndex)); }
 
-constexpr Length
-LinearTable::maximumIndexPerBlock()
-{ return Driver::BLOCK_SIZE / sizeof(BlockIndex); }
+Length
+LinearTable::maximumIndexPerBlock() const
+{ return _accesser->blockSize() / sizeof(BlockIndex); }
 
 Block
 LinearTable::fetchPrimaryIndexedBlock(BlockIndex primary_index, BlockIndex offset)
@@ -107,9 +107,9 @@ namespace cdb {
         // index in this table
         inline Block fetchBlockByIndex(BlockIndex index);
         static inline constexpr Length directBlockCount();
-        static inline constexpr Length primaryBlockCount();
-        static inline constexpr Length secondaryBlockCount();
-        static inline constexpr Length maximumIndexPerBlock();
+        inline Length primaryBlockCount() const;
+        inline Length secondaryBlockCount() const;
+        inline Length maximumIndexPerBlock() const;
         inline Block fetchPrimaryIndexedBlock(BlockIndex primary_index, BlockIndex offset);
         inline Block fetchSecondaryIndexedBlock(BlockIndex secondary_index, BlockIndex offset);
         inline Block fetchTertiaryIndexedBlock(BlockIndex tertiary_index, BlockIndex offset);
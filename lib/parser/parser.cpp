@@ -3,6 +3,8 @@
 #include <memory>
 #include <vector>
 #include <stack>
+#include <stdexcept>
+#include <cstdint>
 
 #include "lib/condition/condition.hpp"
 #include "lib/table/schema.hpp"
@@ -305,6 +307,19 @@ namespace cdb {
           > >
     { };
 
+    struct commit_stmt
+        : stmt<token<pegtl_istring_t("commit") > >
+    { };
+
+    struct set_cache_size_stmt
+        : stmt<pegtl::seq<
+            token<pegtl_istring_t("set") >,
+            token<pegtl_istring_t("cache_size") >,
+            token<pegtl::one<'='> >,
+            token<integer>
+          > >
+    { };
+
     struct statment
         : pegtl::seq<
               pegtl::star<pegtl::space >,
@@ -317,7 +332,9 @@ namespace cdb {
                 select_stmt,
                 delete_stmt,
                 quit_stmt,
-                exec_stmt
+                exec_stmt,
+                commit_stmt,
+                set_cache_size_stmt
               >
           >
     { };
@@ -773,6 +790,33 @@ namespace cdb {
         }
     };
 
+    template <>
+    struct ParseAction<commit_stmt>
+    {
+        static void
+        apply(const pegtl::input &, ParseState &state)
+        {
+            state.db->commit();
+        }
+    };
+
+    template <>
+    struct ParseAction<set_cache_size_stmt>
+    {
+        static void
+        apply(const pegtl::input &, ParseState &state)
+        {
+            std::uint64_t size;
+            try {
+                size = std::stoull(state.integer);
+            }
+            catch (const std::out_of_range &) {
+                throw ParserCacheSizeOutOfRangeException();
+            }
+            state.db->setCacheSize(size);
+        }
+    };
+
     template <>
     struct ParseAction<exec_stmt>
     {
@@ -14,6 +14,12 @@ namespace cdb {
         { return "Syntax error"; }
     };
 
+    struct ParserCacheSizeOutOfRangeException : public std::exception
+    {
+        const char * what() const noexcept
+        { return "Cache size out of range"; }
+    };
+
     class Parser
     {
         Database *_db;
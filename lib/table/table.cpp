@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <vector>
+
 #include "table.hpp"
 #include "lib/condition/column-name-visitor.hpp"
 #include "lib/index/btree.hpp"
@@ -8,6 +11,27 @@
 
 using namespace cdb;
 
+/**
+ * Get the type of keys in a BTree for a type of field
+ *
+ * @param type the type of field
+ * @return the type of keys, GENERIC if not known by BTree
+ */
+static BTree::KeyType
+getKeyTypeOfField(Schema::Field::Type type)
+{
+    switch (type) {
+        case Schema::Field::Type::INTEGER:
+            return BTree::KeyType::INTEGER;
+        case Schema::Field::Type::FLOAT:
+            return BTree::KeyType::FLOAT;
+        case Schema::Field::Type::CHAR:
+            return BTree::KeyType::CHAR;
+        default:
+            return BTree::KeyType::GENERIC;
+    }
+}
+
 class Table::IndexVisitor : public ConditionVisitor
 {
     Table *_owner;
@@ -625,7 +649,7 @@ Table::buildFilter(ConditionExpr *condition)
 
 Length
 Table::calculateRecordPerBlock() const
-{ return (Driver::BLOCK_SIZE / _schema->getRecordSize()); }
+{ return (_accesser->blockSize() / _schema->getRecordSize()); }
 
 Length
 Table::calculateThreshold() const
@@ -655,21 +679,47 @@ BlockIndex
 Table::createIndex(std::string column_name, std::string name)
 {
     std::unique_ptr<Schema> index_schema(buildSchemaForIndex(column_name));
-    BlockIndex index_root = _accesser->allocateBlock();
 
-    std::unique_ptr<View> view(buildDataView());
-    view.reset(view->select(index_schema.get()));
+    auto index_col = _schema->getColumnByName(column_name);
+    auto primary_col = _schema->getPrimaryColumn();
+    auto key_size = index_schema->getRecordSize();
+    assert(key_size == index_col.getField()->length + primary_col.getField()->length);
 
-    std::unique_ptr<BTree> index_tree(buildIndexBTree(index_root, index_schema->copy()));
-    index_tree->init();
+    // keys of the index are the indexed value followed by the primary key of each row
+    std::vector<Byte> keys;
+    keys.reserve(_count * key_size);
 
-    for (auto iter = view->begin(); iter != view->end(); iter.next()) {
-        auto slice = iter.constSlice();
-        index_tree->insert(index_tree->makeKey(slice.content(), slice.length()));
+    std::unique_ptr<BTree> data_tree(buildDataBTree());
+    data_tree->forEach([&](const BTree::Iterator &iter)
+        {
+            auto index_value = index_col.getValue(iter.getValue());
+            auto primary_value = primary_col.getValue(iter.getValue());
+            keys.insert(keys.end(), index_value.content(), index_value.content() + index_value.length());
+            keys.insert(keys.end(), primary_value.content(), primary_value.content() + primary_value.length());
+        });
+
+    std::unique_ptr<BTree> index_tree(buildIndexBTree(
+            _accesser->allocateBlock(),
+            index_schema.get()
+        ));
+
+    std::vector<const Byte *> sorted_keys;
+    sorted_keys.reserve(keys.size() / key_size);
+    for (Length offset = 0; offset < keys.size(); offset += key_size) {
+        sorted_keys.push_back(keys.data() + offset);
     }
+    std::sort(
+            sorted_keys.begin(),
+            sorted_keys.end(),
+            [&](const Byte *a, const Byte *b) { return index_tree->less(a, b); }
+        );
+
+    auto key = sorted_keys.cbegin();
+    index_tree->bulkLoad([&]() -> const Byte *
+        { return key == sorted_keys.cend() ? nullptr : *key++; });
 
     _indices.emplace_back(column_name, index_tree->getRootIndex(), name);
-    return index_root;
+    return index_tree->getRootIndex();
 }
 
 void
@@ -709,7 +759,8 @@ Table::buildDataBTree()
             Comparator::getCompareFuncByTypeEQ(primary_col.getType()),
             _root,
             primary_col.getField()->length,
-            _schema->getRecordSize()
+            _schema->getRecordSize(),
+            BTree::KeyLayout(getKeyTypeOfField(primary_col.getType()))
     );
 }
 
@@ -729,7 +780,12 @@ Table::buildIndexBTree(BlockIndex root, Schema *index_schema)
             Comparator::getCombineCmpFuncEQ(index_type, index_length, primary_type),
             root,
             index_schema->getRecordSize(),
-            0
+            0,
+            BTree::KeyLayout(
+                getKeyTypeOfField(index_type),
+                index_length,
+                getKeyTypeOfField(primary_type)
+            )
     );
 }
 
@@ -943,3 +999,22 @@ Table::drop()
     }
 }
 
+void
+Table::compact()
+{
+    std::unique_ptr<BTree> data_btree(buildDataBTree());
+    data_btree->compact();
+    _root = data_btree->getRootIndex();
+
+    for (auto &index : _indices) {
+        std::unique_ptr<Schema> schema(buildSchemaForIndex(index.column_name));
+        std::unique_ptr<BTree> index_btree(
+                buildIndexBTree(
+                    index.root,
+                    schema.get()
+                    )
+                );
+        index_btree->compact();
+        index.root = index_btree->getRootIndex();
+    }
+}
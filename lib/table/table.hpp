@@ -135,6 +135,13 @@ namespace cdb {
 
         void drop();
 
+        /**
+         * Move the data tree and all index trees towards the beginning of the driver
+         *
+         * @see BTree::compact()
+         */
+        void compact();
+
         /**
          * Insert records into this table
          *
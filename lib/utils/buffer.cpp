@@ -1,3 +1,5 @@
+#include <cassert>
+
 #include "buffer.hpp"
 
 using namespace cdb;
@@ -9,6 +11,13 @@ Buffer::Buffer(Length length)
     : Buffer(std::make_shared<BufferImpl>(length))
 { }
 
+Buffer
+Buffer::Aligned(Length length, Length alignment)
+{
+    assert(alignment && !(alignment & (alignment - 1)));
+    return Buffer(std::make_shared<BufferImpl>(length, alignment));
+}
+
 Buffer::Buffer(const Buffer &buffer)
     : Buffer(std::shared_ptr<BufferImpl>(buffer.pimpl_))
 { }
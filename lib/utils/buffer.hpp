@@ -19,27 +19,32 @@ namespace cdb {
         struct BufferImpl
         {
             Length length;
+            Length alignment;
+            Byte* memory;
             Byte* content;
 
-            BufferImpl(Length length)
-                : length(length), content(new Byte[length])
+            BufferImpl(Length length, Length alignment = 1)
+                : length(length),
+                  alignment(alignment),
+                  memory(new Byte[length + alignment - 1]),
+                  content(memory + (alignment - reinterpret_cast<std::uintptr_t>(memory) % alignment) % alignment)
             { }
 
             BufferImpl(BufferImpl &&impl)
-                : length(impl.length), content(impl.content)
-            { impl.content = nullptr; }
+                : length(impl.length), alignment(impl.alignment), memory(impl.memory), content(impl.content)
+            { impl.memory = impl.content = nullptr; }
 
             BufferImpl
             copy() const
             {
-                BufferImpl ret(length);
+                BufferImpl ret(length, alignment);
                 std::copy(content, content + length, ret.content);
 
                 return ret;
             }
 
             ~BufferImpl()
-            { delete[] content; }
+            { delete[] memory; }
         };
 
         std::shared_ptr<BufferImpl> pimpl_; /** The impl of this buffer         */
@@ -58,6 +63,16 @@ namespace cdb {
         Buffer(const Buffer &buffer);
         Buffer(Buffer &&buffer);
 
+        /**
+         * Construct a Buffer whose content starts at a multiple of `alignment', as
+         * required by direct I/O. The alignment is kept when the Buffer is copied on write.
+         *
+         * @param length length of the buffer
+         * @param alignment alignment of content, must be a power of 2
+         * @return the aligned Buffer
+         */
+        static Buffer Aligned(Length length, Length alignment);
+
         template <typename T>
         Buffer(T b, T e)
             : Buffer(std::make_shared<BufferImpl>(e - b))
@@ -0,0 +1,100 @@
+#include <cassert>
+
+#include "latch.hpp"
+
+using namespace cdb;
+
+void
+Latch::lockShared()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.wait(lock, [this]() { return !_writer && !_waiting_writers; });
+    ++_readers;
+}
+
+void
+Latch::unlockShared()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    assert(_readers);
+
+    if (!--_readers) {
+        lock.unlock();
+        _cond.notify_all();
+    }
+}
+
+bool
+Latch::tryLockShared()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_writer || _waiting_writers) {
+        return false;
+    }
+
+    ++_readers;
+    return true;
+}
+
+void
+Latch::lockExclusive()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    ++_waiting_writers;
+    _cond.wait(lock, [this]() { return !_writer && !_readers; });
+    --_waiting_writers;
+    _writer = true;
+}
+
+void
+Latch::unlockExclusive()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    assert(_writer);
+
+    _writer = false;
+    lock.unlock();
+    _cond.notify_all();
+}
+
+bool
+Latch::tryLockExclusive()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_writer || _readers) {
+        return false;
+    }
+
+    _writer = true;
+    return true;
+}
+
+void
+Latch::lock(Mode mode)
+{
+    switch (mode) {
+        case Mode::SHARED:
+            lockShared();
+            break;
+        case Mode::EXCLUSIVE:
+            lockExclusive();
+            break;
+        case Mode::NONE:
+            break;
+    }
+}
+
+void
+Latch::unlock(Mode mode)
+{
+    switch (mode) {
+        case Mode::SHARED:
+            unlockShared();
+            break;
+        case Mode::EXCLUSIVE:
+            unlockExclusive();
+            break;
+        case Mode::NONE:
+            break;
+    }
+}
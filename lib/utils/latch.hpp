@@ -0,0 +1,76 @@
+#ifndef _DB_UTILS_LATCH_H_
+#define _DB_UTILS_LATCH_H_
+
+#include <condition_variable>
+#include <mutex>
+
+#include "buffer.hpp"
+
+namespace cdb {
+    /**
+     * Reader/writer latch protecting the content of a page.
+     *
+     * Any number of readers or a single writer may hold the latch. Waiting writers are
+     * preferred over new readers, so a thread must not take a shared latch it already
+     * holds, or it may deadlock with a writer waiting in between.
+     */
+    class Latch
+    {
+        std::mutex _mutex;
+        std::condition_variable _cond;
+
+        /** number of readers holding the latch */
+        Length _readers = 0;
+
+        /** number of writers waiting for the latch */
+        Length _waiting_writers = 0;
+
+        /** true if held by a writer */
+        bool _writer = false;
+
+        Latch(const Latch &) = delete;
+        Latch &operator = (const Latch &) = delete;
+
+    public:
+        enum class Mode
+        {
+            NONE,       /** not latched */
+            SHARED,     /** held with other readers */
+            EXCLUSIVE   /** held by a single writer */
+        };
+
+        Latch() = default;
+
+        void lockShared();
+        void unlockShared();
+
+        /**
+         * @return false if the latch is held or waited by a writer
+         */
+        bool tryLockShared();
+
+        void lockExclusive();
+        void unlockExclusive();
+
+        /**
+         * @return false if the latch is held by anyone
+         */
+        bool tryLockExclusive();
+
+        /**
+         * Take the latch in the given mode, Mode::NONE does nothing
+         *
+         * @param mode the mode to take
+         */
+        void lock(Mode mode);
+
+        /**
+         * Give back the latch taken in the given mode, Mode::NONE does nothing
+         *
+         * @param mode the mode it was taken
+         */
+        void unlock(Mode mode);
+    };
+}
+
+#endif // _DB_UTILS_LATCH_H_
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "lib/database/database.hpp"
 #include "../test-inc.hpp"
@@ -130,3 +132,339 @@ TEST_F(DatabaseTest, OpenAgain)
             EXPECT_EQ(3, count);
     }
 }
+
+/**
+ * Open a database with each set of options, and read rows written with the default ones
+ */
+class DatabaseOpenTest : public ::testing::TestWithParam<Database::Options>
+{
+protected:
+    static constexpr const char *OPEN_TEST_PATH = TMP_PATH_PREFIX "/database-open-test.tmp";
+
+    static void SetUpTestCase()
+    {
+        std::remove(OPEN_TEST_PATH);
+
+        std::unique_ptr<Database> db(Database::Factory(OPEN_TEST_PATH));
+        Table *table = db->createTable(
+                "test_table",
+                Schema::Factory()
+                    .addIntegerField("id")
+                    .addCharField("name", 16)
+                    .release()
+            );
+
+        std::unique_ptr<Table::RecordBuilder> builder(table->getRecordBuilder({ "id", "name" }));
+        for (int i = 0; i < 3; ++i) {
+            builder->addRow()
+                    .addInteger(i)
+                    .addChar("lalala");
+        }
+        table->insert(builder->getSchema(), builder->getRows());
+    }
+
+    static void TearDownTestCase()
+    { std::remove(OPEN_TEST_PATH); }
+};
+
+TEST_P(DatabaseOpenTest, ReadRows)
+{
+    std::unique_ptr<Database> uut(Database::Factory(OPEN_TEST_PATH, GetParam()));
+
+    Table *table = uut->getTableByName("test_table");
+    std::unique_ptr<Schema> schema(table->getSchema()->copy());
+
+    int count = 0;
+    table->select(
+            nullptr,
+            nullptr,
+            [&](ConstSlice row)
+            {
+                auto id_col = schema->getColumnById(0);
+                auto id = Convert::toString(id_col.getType(), id_col.getValue(row));
+                EXPECT_EQ(std::to_string(count), id);
+                ++count;
+            }
+        );
+    EXPECT_EQ(3, count);
+}
+
+static std::vector<Database::Options>
+optionsToOpenWith()
+{
+    std::vector<Database::Options> ret(4);
+    ret[0].driver = Database::DriverType::POSIX;
+    ret[1].driver = Database::DriverType::MMAP;
+    ret[2].driver = Database::DriverType::URING;
+    ret[3].cache_policy = Database::CachePolicy::TWO_QUEUE;
+    return ret;
+}
+
+INSTANTIATE_TEST_CASE_P(Options, DatabaseOpenTest, ::testing::ValuesIn(optionsToOpenWith()));
+
+TEST_F(DatabaseTest, CacheSize)
+{
+    Database::Options options;
+    options.cache_size = 4 * Driver::BLOCK_SIZE;
+    std::unique_ptr<Database> uut(Database::Factory(TEST_PATH, options));
+
+    auto count_rows = [&]()
+    {
+        int count = 0;
+        uut->getTableByName("test_table")->select(
+                nullptr,
+                nullptr,
+                [&](ConstSlice)
+                { ++count; }
+            );
+        return count;
+    };
+
+    EXPECT_EQ(3, count_rows());
+
+    uut->setCacheSize(1);
+    EXPECT_EQ(3, count_rows());
+
+    uut->setCacheSize(8ull * 1024 * 1024 * 1024);
+    EXPECT_EQ(3, count_rows());
+}
+
+TEST_F(DatabaseTest, DirectIOPageSize)
+{
+    static const char DIRECT_IO_TEST_PATH[] = TMP_PATH_PREFIX "/database-direct-io-test.tmp";
+
+    std::remove(DIRECT_IO_TEST_PATH);
+
+    Database::Options options;
+    options.driver = Database::DriverType::POSIX;
+    options.direct_io = true;
+    options.readahead = 16;
+
+    {
+        std::unique_ptr<Database> uut(Database::Factory(DIRECT_IO_TEST_PATH, options));
+        Table *table = uut->createTable(
+                "test_table",
+                Schema::Factory()
+                    .addIntegerField("id")
+                    .release()
+            );
+
+        std::unique_ptr<Table::RecordBuilder> builder(table->getRecordBuilder({ "id" }));
+        for (int i = 0; i < 3; ++i) {
+            builder->addRow().addInteger(i);
+        }
+        table->insert(builder->getSchema(), builder->getRows());
+    }
+
+    // pages of the new database are raised to the alignment, so it opens again
+    {
+        std::unique_ptr<Database> uut(Database::Factory(DIRECT_IO_TEST_PATH, options));
+
+        int count = 0;
+        uut->getTableByName("test_table")->select(
+                nullptr,
+                nullptr,
+                [&](ConstSlice)
+                { ++count; }
+            );
+        EXPECT_EQ(3, count);
+    }
+    std::remove(DIRECT_IO_TEST_PATH);
+
+    // the database of TEST_PATH is created with the default page size
+    EXPECT_THROW(Database::Factory(TEST_PATH, options), DatabaseDirectIOPageSizeException);
+}
+
+TEST_F(DatabaseTest, PageSize)
+{
+    static const char PAGE_SIZE_TEST_PATH[] = TMP_PATH_PREFIX "/database-page-size-test.tmp";
+    static const int ROW_COUNT = 2000;
+
+    std::remove(PAGE_SIZE_TEST_PATH);
+
+    Database::Options options;
+    options.page_size = 16 * 1024;
+
+    {
+        std::unique_ptr<Database> uut(Database::Factory(PAGE_SIZE_TEST_PATH, options));
+        Table *table = uut->createTable(
+                "test_table",
+                Schema::Factory()
+                    .addIntegerField("id")
+                    .addCharField("name", 16)
+                    .release()
+            );
+
+        std::unique_ptr<Table::RecordBuilder> builder(table->getRecordBuilder({ "id", "name" }));
+        for (int i = 0; i < ROW_COUNT; ++i) {
+            builder->addRow().addInteger(i).addChar("lalala");
+        }
+        table->insert(builder->getSchema(), builder->getRows());
+    }
+
+    // page size is read from the header, whatever the options are
+    std::unique_ptr<Database> uut(Database::Factory(PAGE_SIZE_TEST_PATH));
+    Table *table = uut->getTableByName("test_table");
+    std::unique_ptr<Schema> schema(table->getSchema()->copy());
+
+    int count = 0;
+    table->select(
+            nullptr,
+            nullptr,
+            [&](ConstSlice row)
+            {
+                auto id_col = schema->getColumnById(0);
+                auto id = Convert::toString(id_col.getType(), id_col.getValue(row));
+                EXPECT_EQ(std::to_string(count), id);
+                ++count;
+            }
+        );
+    EXPECT_EQ(ROW_COUNT, count);
+
+    uut.reset();
+    std::remove(PAGE_SIZE_TEST_PATH);
+
+    options.page_size = 3000;
+    EXPECT_THROW(Database::Factory(PAGE_SIZE_TEST_PATH, options), DatabaseInvalidPageSizeException);
+    std::remove(PAGE_SIZE_TEST_PATH);
+}
+
+TEST_F(DatabaseTest, WriteAheadLog)
+{
+    static const char WAL_TEST_PATH[] = TMP_PATH_PREFIX "/database-wal-test.tmp";
+    static const char WAL_LOG_PATH[] = TMP_PATH_PREFIX "/database-wal-test.tmp-wal.1";
+    static const int ROW_COUNT = 100;
+
+    static const int MAX_SEGMENT = 16;
+
+    // closing leaves what is written after the last commit in the log
+    auto remove_files = [&]()
+    {
+        std::remove(WAL_TEST_PATH);
+        for (int i = 1; i <= MAX_SEGMENT; ++i) {
+            std::remove((std::string(WAL_TEST_PATH) + "-wal." + std::to_string(i)).c_str());
+        }
+    };
+    remove_files();
+
+    Database::Options options;
+    options.driver = Database::DriverType::POSIX;
+    options.write_ahead_log = true;
+    options.background_flush = true;
+
+    {
+        std::unique_ptr<Database> uut(Database::Factory(WAL_TEST_PATH, options));
+        Table *table = uut->createTable(
+                "test_table",
+                Schema::Factory()
+                    .addIntegerField("id")
+                    .addCharField("name", 16)
+                    .release()
+            );
+
+        std::unique_ptr<Table::RecordBuilder> builder(table->getRecordBuilder({ "id", "name" }));
+        for (int i = 0; i < ROW_COUNT; ++i) {
+            builder->addRow().addInteger(i).addChar("lalala");
+        }
+        table->insert(builder->getSchema(), builder->getRows());
+        uut->commit();
+
+        // committed pages stay in the log until checkpointed
+        std::FILE *log = std::fopen(WAL_LOG_PATH, "rb");
+        ASSERT_NE(nullptr, log);
+        std::fseek(log, 0, SEEK_END);
+        EXPECT_LT(0, std::ftell(log));
+        std::fclose(log);
+
+        // only commit() commits, pages written back without it are discarded
+        std::unique_ptr<Table::RecordBuilder> uncommitted(table->getRecordBuilder({ "id", "name" }));
+        for (int i = ROW_COUNT; i < ROW_COUNT * 2; ++i) {
+            uncommitted->addRow().addInteger(i).addChar("lalala");
+        }
+        table->insert(uncommitted->getSchema(), uncommitted->getRows());
+    }
+
+    std::unique_ptr<Database> uut(Database::Factory(WAL_TEST_PATH, options));
+    int count = 0;
+    uut->getTableByName("test_table")->select(
+            nullptr,
+            nullptr,
+            [&](ConstSlice)
+            { ++count; }
+        );
+    EXPECT_EQ(ROW_COUNT, count);
+
+    uut.reset();
+    remove_files();
+}
+
+TEST_F(DatabaseTest, Compact)
+{
+    static const char COMPACT_TEST_PATH[] = TMP_PATH_PREFIX "/database-compact-test.tmp";
+    static const int LARGE_ROW_COUNT = 30000;
+    static const int ROW_COUNT = 100;
+
+    std::remove(COMPACT_TEST_PATH);
+
+    Database::Options options;
+    options.driver = Database::DriverType::POSIX;
+
+    auto file_size = [&]() -> long
+    {
+        std::FILE *file = std::fopen(COMPACT_TEST_PATH, "rb");
+        std::fseek(file, 0, SEEK_END);
+        long ret = std::ftell(file);
+        std::fclose(file);
+        return ret;
+    };
+
+    {
+        std::unique_ptr<Database> uut(Database::Factory(COMPACT_TEST_PATH, options));
+        // the large table takes more than one section, the other one goes after it
+        for (auto name : { "large_table", "test_table" }) {
+            int row_count = std::string(name) == "large_table" ? LARGE_ROW_COUNT : ROW_COUNT;
+            Table *table = uut->createTable(
+                    name,
+                    Schema::Factory()
+                        .addIntegerField("id")
+                        .addCharField("name", 100)
+                        .release()
+                );
+
+            std::unique_ptr<Table::RecordBuilder> builder(table->getRecordBuilder({ "id", "name" }));
+            for (int i = 0; i < row_count; ++i) {
+                builder->addRow().addInteger(i).addChar("lalala");
+            }
+            table->insert(builder->getSchema(), builder->getRows());
+            table->createIndex("name", std::string(name) + "_idx");
+        }
+        uut->commit();
+        long size_before = file_size();
+
+        uut->dropTable("large_table");
+        uut->compact();
+        EXPECT_GT(size_before, file_size());
+    }
+
+    std::unique_ptr<Database> uut(Database::Factory(COMPACT_TEST_PATH, options));
+    Table *table = uut->getTableByName("test_table");
+    std::unique_ptr<Schema> schema(table->getSchema()->copy());
+
+    int count = 0;
+    table->select(
+            nullptr,
+            nullptr,
+            [&](ConstSlice row)
+            {
+                auto id_col = schema->getColumnById(0);
+                auto id = Convert::toString(id_col.getType(), id_col.getValue(row));
+                EXPECT_EQ(std::to_string(count), id);
+                ++count;
+            }
+        );
+    EXPECT_EQ(ROW_COUNT, count);
+    EXPECT_EQ("test_table", uut->indexFor("test_table_idx"));
+
+    uut.reset();
+    std::remove(COMPACT_TEST_PATH);
+}
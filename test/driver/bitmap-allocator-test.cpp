@@ -135,3 +135,241 @@ TEST_F(BitmapAllocatorTest, AnotherStartAt)
     }
 }
 
+
+TEST_F(BitmapAllocatorTest, LargerBlockSize)
+{
+    static const Length BLOCK_SIZE = 4096;
+    static const Length BLOCK_PER_SECTION = BLOCK_SIZE * 8;
+
+    uut.reset();
+    drv.reset();
+    std::remove(TEST_PATH);
+
+    drv.reset(new BasicDriver(TEST_PATH));
+    drv->setBlockSize(BLOCK_SIZE);
+    uut.reset(new BitmapAllocator(drv.get(), 1));
+    uut->reset();
+
+    // the bitmap block of a section moves with the block size
+    for (Length i = 2; i < BLOCK_PER_SECTION - 1; ++i) {
+        EXPECT_EQ(i < BLOCK_PER_SECTION - 32 ? i : i + 1, uut->allocateBlock());
+    }
+    EXPECT_EQ(BLOCK_PER_SECTION, uut->allocateBlock());
+}
+
+TEST_F(BitmapAllocatorTest, AllocatingWholeUnit)
+{
+    EXPECT_EQ(32, uut->allocateBlocks(32));
+    EXPECT_EQ(2, uut->allocateBlock());
+    uut->freeBlocks(32, 32);
+    EXPECT_EQ(32, uut->allocateBlocks(32));
+}
+
+TEST_F(BitmapAllocatorTest, AllocatingExtent)
+{
+    EXPECT_EQ(2, uut->allocateBlocks(100));
+    EXPECT_EQ(102, uut->allocateBlock());
+    EXPECT_EQ(103, uut->allocateBlocks(1000));
+    EXPECT_EQ(1103, uut->allocateBlocks(2));
+
+    uut->freeBlocks(2, 100);
+    EXPECT_EQ(2, uut->allocateBlocks(40));
+    EXPECT_EQ(42, uut->allocateBlocks(60));
+
+    uut->freeBlocks(103, 1000);
+    EXPECT_EQ(103, uut->allocateBlocks(1000, 103));
+}
+
+TEST_F(BitmapAllocatorTest, ExtentWithHint)
+{
+    EXPECT_EQ(2, uut->allocateBlocks(64));
+    EXPECT_EQ(4096, uut->allocateBlocks(64, 4096));
+
+    // wraps to the beginning if nothing is found after the hint
+    EXPECT_EQ(66, uut->allocateBlocks(3000, 6000));
+}
+
+TEST_F(BitmapAllocatorTest, ExtentAcrossSections)
+{
+    // the bitmap block of the first section is at 8160, the second at 16352
+    EXPECT_EQ(8992, uut->allocateBlock(9000));
+    EXPECT_EQ(8161, uut->allocateBlocks(64, 8161));
+
+    // nothing long enough after the hint, wraps to the beginning
+    EXPECT_EQ(2, uut->allocateBlocks(8000, 9000));
+
+    // a new section is appended, the run starts after the bitmap block of the last one
+    EXPECT_EQ(16353, uut->allocateBlocks(8000));
+
+    uut->freeBlocks(8161, 64);
+    EXPECT_EQ(8161, uut->allocateBlocks(33, 8161));
+}
+
+TEST_F(BitmapAllocatorTest, ExtentOpennedAgain)
+{
+    EXPECT_EQ(2, uut->allocateBlocks(5000));
+
+    uut.reset();
+    drv.reset();
+
+    drv.reset(new BasicDriver(TEST_PATH));
+    uut.reset(new BitmapAllocator(drv.get(), 1));
+
+    EXPECT_EQ(5002, uut->allocateBlock());
+}
+
+TEST_F(BitmapAllocatorTest, SkipsFullSections)
+{
+    // fill the first 4 sections, leaving a hole of 4 blocks in the third one
+    for (int i = 2; i < 4 * 8192; ++i) {
+        if (i % 8192 != 8160) {
+            uut->allocateBlock(i);
+        }
+    }
+    uut->freeBlocks(2 * 8192 + 124, 4);
+
+    EXPECT_EQ(2 * 8192 + 124, uut->allocateBlocks(4, 3 * 8192));
+    EXPECT_EQ(4 * 8192, uut->allocateBlocks(4, 8192));
+
+    // an extent continues the free tail of a section into the next one
+    uut->freeBlocks(3 * 8192 - 16, 16);
+    uut->freeBlocks(3 * 8192, 64);
+    EXPECT_EQ(3 * 8192 - 16, uut->allocateBlocks(80, 2));
+}
+
+TEST_F(BitmapAllocatorTest, FindsUnitAtAnyPosition)
+{
+    // fill the first section
+    for (int i = 2; i < 8192; ++i) {
+        if (i != 8160) {
+            uut->allocateBlock(i);
+        }
+    }
+
+    // a single unit with free blocks, before and after the hint, at every offset
+    // of a vector
+    for (int unit = 1; unit < 40; ++unit) {
+        uut->freeBlocks(unit * 32 + 16, 16);
+        EXPECT_EQ(unit * 32 + 16, uut->allocateBlocks(16, 32));
+        uut->freeBlocks(unit * 32 + 16, 16);
+        EXPECT_EQ(unit * 32 + 16, uut->allocateBlocks(16, 40 * 32));
+    }
+
+    // an extent after a long run of units without free blocks
+    uut->freeBlocks(200 * 32 + 16, 48);
+    EXPECT_EQ(200 * 32 + 16, uut->allocateBlocks(48, 32));
+}
+
+TEST_F(BitmapAllocatorTest, ReadsBitmapsOnDemand)
+{
+    // fill the first two sections, and start the third one
+    for (int i = 2; i < 2 * 8192; ++i) {
+        if (i % 8192 != 8160) {
+            uut->allocateBlock(i);
+        }
+    }
+    EXPECT_EQ(2 * 8192, uut->allocateBlock(2 * 8192));
+
+    uut.reset();
+    drv.reset();
+
+    // ----
+
+    drv.reset(new BasicDriver(TEST_PATH));
+    auto *allocator = new BitmapAllocator(drv.get(), 1);
+    uut.reset(allocator);
+    EXPECT_EQ(0u, allocator->loadedBitmapCount());
+
+    // full sections are skipped without reading them
+    EXPECT_EQ(2 * 8192 + 1, uut->allocateBlock());
+    EXPECT_EQ(1u, allocator->loadedBitmapCount());
+}
+
+TEST_F(BitmapAllocatorTest, DropsColdBitmaps)
+{
+    auto *allocator = static_cast<BitmapAllocator*>(uut.get());
+    allocator->setBitmapCapacity(1);
+
+    EXPECT_EQ(2, uut->allocateBlock());
+    EXPECT_EQ(8192, uut->allocateBlock(8192));
+    EXPECT_EQ(1u, allocator->loadedBitmapCount());
+
+    // dropped bitmaps are written back and read again
+    EXPECT_EQ(3, uut->allocateBlock());
+    uut->freeBlock(8192);
+    EXPECT_EQ(1u, allocator->loadedBitmapCount());
+
+    uut.reset();
+    drv.reset();
+
+    // ----
+
+    drv.reset(new BasicDriver(TEST_PATH));
+    uut.reset(new BitmapAllocator(drv.get(), 1));
+
+    EXPECT_EQ(4, uut->allocateBlock());
+    EXPECT_EQ(8192, uut->allocateBlock(8192));
+}
+
+TEST_F(BitmapAllocatorTest, Trim)
+{
+    EXPECT_EQ(8192, uut->allocateBlock(8192));
+    EXPECT_EQ(2 * 8192, uut->allocateBlock(2 * 8192));
+
+    // sections with blocks allocated are kept
+    EXPECT_EQ(0u, uut->trim());
+
+    uut->freeBlock(2 * 8192);
+    EXPECT_EQ(2u * 8192, uut->trim());
+
+    uut->freeBlock(8192);
+    EXPECT_EQ(8192u, uut->trim());
+    EXPECT_EQ(0u, uut->trim());
+
+    uut.reset();
+    drv.reset();
+
+    // ----
+
+    drv.reset(new BasicDriver(TEST_PATH));
+    uut.reset(new BitmapAllocator(drv.get(), 1));
+
+    // trimmed sections are appended again
+    EXPECT_EQ(2, uut->allocateBlock());
+    EXPECT_EQ(8192, uut->allocateBlock(8192));
+}
+
+class FailingBitmapDriver : public BasicDriver
+{
+public:
+    bool failing = false;
+
+    FailingBitmapDriver(const char *path)
+        : BasicDriver(path)
+    { }
+
+    virtual void flush()
+    {
+        if (failing) {
+            throw BasicDriverIOException();
+        }
+        BasicDriver::flush();
+    }
+};
+
+TEST_F(BitmapAllocatorTest, DestructWhenFlushFails)
+{
+    uut.reset();
+    drv.reset();
+
+    std::unique_ptr<FailingBitmapDriver> failing(new FailingBitmapDriver(TEST_PATH));
+    uut.reset(new BitmapAllocator(failing.get(), 1));
+    uut->reset();
+
+    failing->failing = true;
+    EXPECT_EQ(2, uut->allocateBlock());
+    EXPECT_THROW(uut->flush(), BasicDriverIOException);
+
+    // the destructor flushes again, the failure is not thrown out of it
+    uut.reset();
+}
@@ -1,13 +1,20 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <cstring>
+#include <chrono>
 #include <cstdio>
+#include <thread>
+#include <vector>
 
 #include "../test-inc.hpp"
 
 #include "lib/driver/bitmap-allocator.hpp"
 #include "lib/driver/basic-driver.hpp"
 #include "lib/driver/cached-accesser.hpp"
+#include "lib/driver/uring-driver.hpp"
 
 using namespace cdb;
 
@@ -126,3 +133,610 @@ TEST_F(CachedAccesserTest, OpenAgain)
         EXPECT_EQ(0, std::strcmp(TEST_STRING, reinterpret_cast<char*>(block.content())));
     }
 }
+
+TEST_F(CachedAccesserTest, Eviction)
+{
+    static const int CHUNK_COUNT = 150;
+    static const BlockIndex BLOCK_PER_CHUNK = 1024;
+
+    std::unique_ptr<BasicDriver> drv(new BasicDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    // keep one block pinned while touching more chunks than the cache holds
+    auto pinned = uut->aquire(1);
+    std::strcpy(reinterpret_cast<char*>(pinned.content()), TEST_STRING);
+
+    for (int i = 1; i < CHUNK_COUNT; ++i) {
+        auto block = uut->aquire(i * BLOCK_PER_CHUNK + 1);
+        *reinterpret_cast<int*>(block.content()) = i;
+    }
+
+    // evicted chunks are read back again
+    for (int i = 1; i < CHUNK_COUNT; ++i) {
+        auto block = uut->aquire(i * BLOCK_PER_CHUNK + 1);
+        EXPECT_EQ(i, *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+
+    EXPECT_EQ(0, std::strcmp(TEST_STRING, reinterpret_cast<const char*>(pinned.constSlice().content())));
+}
+
+class CountingDriver : public BasicDriver
+{
+public:
+    int write_count = 0;
+    int read_count = 0;
+    int flush_count = 0;
+
+    CountingDriver(const char *path)
+        : BasicDriver(path)
+    { }
+
+    virtual void readBlocksV(const BlockIndex *indices, Length count, Slice *dests)
+    {
+        ++read_count;
+        BasicDriver::readBlocksV(indices, count, dests);
+    }
+
+    // called once for each run of adjacent blocks written
+    virtual void writeBlocksGathered(BlockIndex index, Length count, const ConstSlice *srcs)
+    {
+        ++write_count;
+        BasicDriver::writeBlocksGathered(index, count, srcs);
+    }
+
+    virtual void flush()
+    {
+        ++flush_count;
+        BasicDriver::flush();
+    }
+};
+
+TEST_F(CachedAccesserTest, WriteBack)
+{
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    BlockIndex indices[] = { 10, 11, 12, 20 };
+    for (int i = 0; i < 100; ++i) {
+        for (auto index : indices) {
+            auto block = uut->aquire(index);
+            *reinterpret_cast<int*>(block.content()) = i;
+        }
+    }
+    EXPECT_EQ(0, drv->write_count);
+
+    // not written to the driver until flushed
+    Buffer buffer(Driver::BLOCK_SIZE);
+    drv->readBlock(20, buffer);
+    EXPECT_NE(99, *reinterpret_cast<const int*>(buffer.content()));
+
+    // adjacent dirty blocks are coalesced
+    uut->flush();
+    EXPECT_EQ(2, drv->write_count);
+
+    for (auto index : indices) {
+        drv->readBlock(index, buffer);
+        EXPECT_EQ(99, *reinterpret_cast<const int*>(buffer.content()));
+    }
+
+    // clean blocks are not written again
+    uut->flush();
+    EXPECT_EQ(2, drv->write_count);
+}
+
+TEST_F(CachedAccesserTest, Readahead)
+{
+    static const BlockIndex START = 100;
+    static const Length COUNT = 33;
+    static const Length READAHEAD = 8;
+
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    // random misses read only the block required
+    uut->aquire(START * 3);
+    uut->aquire(START * 2);
+    EXPECT_EQ(2, drv->read_count);
+
+    uut->setReadahead(READAHEAD);
+    EXPECT_EQ(READAHEAD, uut->readahead());
+
+    drv->read_count = 0;
+    for (Length i = 0; i < COUNT; ++i) {
+        uut->aquire(START + i);
+    }
+
+    // the first miss is not known to be sequential
+    EXPECT_EQ(1 + (COUNT - 1 + READAHEAD - 1) / READAHEAD, drv->read_count);
+}
+
+TEST_F(CachedAccesserTest, Statistics)
+{
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 1));
+    uut->setCapacity(2);
+
+    {
+        auto block = uut->aquire(10);
+        *reinterpret_cast<int*>(block.content()) = 10;
+    }
+    uut->aquire(10);
+    uut->aquire(11);
+    uut->aquire(12);
+
+    EXPECT_EQ(1u, uut->statistics().hits);
+    EXPECT_EQ(3u, uut->statistics().misses);
+    EXPECT_EQ(1u, uut->statistics().evictions);
+    EXPECT_EQ(1u, uut->statistics().dirty_writes);
+    EXPECT_EQ(0u, uut->statistics().overflows);
+
+    uut->resetStatistics();
+    EXPECT_EQ(0u, uut->statistics().misses);
+}
+
+TEST_F(CachedAccesserTest, Resize)
+{
+    static const Length COUNT = 16;
+
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 1));
+
+    for (Length i = 0; i < COUNT; ++i) {
+        auto block = uut->aquire(100 + i);
+        *reinterpret_cast<int*>(block.content()) = i;
+    }
+    EXPECT_EQ(COUNT, uut->size());
+
+    // frames beyond the new capacity are written back and freed
+    uut->setCapacity(COUNT / 4);
+    EXPECT_EQ(COUNT / 4, uut->capacity());
+    EXPECT_EQ(COUNT / 4, uut->size());
+    EXPECT_EQ(COUNT - COUNT / 4, uut->statistics().evictions);
+    EXPECT_LE(COUNT - COUNT / 4, uut->statistics().dirty_writes);
+
+    for (Length i = 0; i < COUNT; ++i) {
+        auto block = uut->aquire(100 + i);
+        EXPECT_EQ(static_cast<int>(i), *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+    EXPECT_EQ(COUNT / 4, uut->size());
+}
+
+TEST_F(CachedAccesserTest, AllPinned)
+{
+    static const Length CAPACITY = 4;
+
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 1));
+    uut->setCapacity(CAPACITY);
+
+    {
+        // more blocks pinned than the pool holds
+        std::vector<Block> pinned;
+        pinned.reserve(CAPACITY * 2);
+        for (Length i = 0; i < CAPACITY * 2; ++i) {
+            pinned.push_back(uut->aquire(200 + i));
+            *reinterpret_cast<int*>(pinned.back().content()) = i;
+        }
+        EXPECT_EQ(CAPACITY * 2, uut->size());
+        EXPECT_EQ(CAPACITY, uut->statistics().overflows);
+    }
+
+    // extra frames are given back once unpinned
+    uut->aquire(300);
+    EXPECT_EQ(CAPACITY, uut->size());
+
+    for (Length i = 0; i < CAPACITY * 2; ++i) {
+        auto block = uut->aquire(200 + i);
+        EXPECT_EQ(static_cast<int>(i), *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+}
+
+TEST_F(CachedAccesserTest, Sharded)
+{
+    static const Length CAPACITY = 64;
+
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 4));
+    uut->setCapacity(CAPACITY);
+    EXPECT_EQ(4u, uut->shardCount());
+
+    // each shard holds its part of the capacity
+    for (Length i = 0; i < CAPACITY * 2; ++i) {
+        auto block = uut->aquire(i * CachedAccesser::SHARD_STRIDE / 2);
+        *reinterpret_cast<int*>(block.content()) = i;
+    }
+    EXPECT_EQ(CAPACITY, uut->size());
+
+    for (Length i = 0; i < CAPACITY * 2; ++i) {
+        auto block = uut->aquire(i * CachedAccesser::SHARD_STRIDE / 2);
+        EXPECT_EQ(static_cast<int>(i), *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+}
+
+TEST_F(CachedAccesserTest, Concurrent)
+{
+    static const int THREAD_COUNT = 8;
+    static const int ROUND = 2000;
+    static const BlockIndex BLOCK_COUNT = 64;
+
+    std::unique_ptr<BasicDriver> drv(new BasicDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    // small enough to evict while other threads are working
+    uut->setCapacity(BLOCK_COUNT / 2);
+
+    for (BlockIndex i = 0; i < BLOCK_COUNT; ++i) {
+        auto block = uut->aquire(i * 100, Latch::Mode::EXCLUSIVE);
+        reinterpret_cast<int*>(block.content())[0] = 0;
+        reinterpret_cast<int*>(block.content())[1] = 0;
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([&, t]()
+            {
+                for (int i = 0; i < ROUND; ++i) {
+                    BlockIndex index = ((i * 7 + t * 13) % BLOCK_COUNT) * 100;
+                    if (i % 4) {
+                        // both counters are updated together under the exclusive latch
+                        auto block = uut->aquire(index, Latch::Mode::SHARED);
+                        auto *counters = reinterpret_cast<const int*>(block.constSlice().content());
+                        EXPECT_EQ(counters[0], counters[1]);
+                    }
+                    else {
+                        auto block = uut->aquire(index, Latch::Mode::EXCLUSIVE);
+                        auto *counters = reinterpret_cast<int*>(block.content());
+                        ++counters[0];
+                        ++counters[1];
+                    }
+                }
+            });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    int total = 0;
+    for (BlockIndex i = 0; i < BLOCK_COUNT; ++i) {
+        auto block = uut->aquire(i * 100, Latch::Mode::SHARED);
+        total += reinterpret_cast<const int*>(block.constSlice().content())[0];
+    }
+    EXPECT_EQ(THREAD_COUNT * ROUND / 4, total);
+}
+
+TEST_F(CachedAccesserTest, FlushWaitsForWriter)
+{
+    std::unique_ptr<BasicDriver> drv(new BasicDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    {
+        auto block = uut->aquire(800);
+        reinterpret_cast<int*>(block.content())[0] = 0;
+        reinterpret_cast<int*>(block.content())[1] = 0;
+    }
+
+    std::atomic<bool> flushed(false);
+    std::thread flusher;
+    {
+        auto block = uut->aquire(800, Latch::Mode::EXCLUSIVE);
+        flusher = std::thread([&]()
+            {
+                uut->flush();
+                flushed = true;
+            });
+
+        // the dirty block is written neither torn nor skipped
+        reinterpret_cast<int*>(block.content())[0] = 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        reinterpret_cast<int*>(block.content())[1] = 1;
+        EXPECT_FALSE(flushed);
+    }
+    flusher.join();
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    drv->readBlock(800, buffer);
+    EXPECT_EQ(1, reinterpret_cast<const int*>(buffer.content())[0]);
+    EXPECT_EQ(1, reinterpret_cast<const int*>(buffer.content())[1]);
+}
+
+class GatedDriver : public BasicDriver
+{
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _open = false;
+    bool _waiting = false;
+
+public:
+    BlockIndex gated;
+
+    GatedDriver(const char *path, BlockIndex gated)
+        : BasicDriver(path), gated(gated)
+    { }
+
+    // reading the gated block blocks until the gate is opened
+    virtual void readBlocksV(const BlockIndex *indices, Length count, Slice *dests)
+    {
+        if (indices[0] == gated) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _waiting = true;
+            _cond.notify_all();
+            _cond.wait(lock, [this]() { return _open; });
+        }
+        BasicDriver::readBlocksV(indices, count, dests);
+    }
+
+    void waitForReader()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this]() { return _waiting; });
+    }
+
+    void open()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _open = true;
+        _cond.notify_all();
+    }
+};
+
+TEST_F(CachedAccesserTest, ReadWithoutShardMutex)
+{
+    std::unique_ptr<GatedDriver> drv(new GatedDriver(TEST_PATH, 900));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 1));
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    *reinterpret_cast<int*>(buffer.content()) = 900;
+    drv->writeBlock(900, buffer);
+
+    std::thread reader([&]()
+        {
+            auto block = uut->aquire(900);
+            EXPECT_EQ(900, *reinterpret_cast<const int*>(block.constSlice().content()));
+        });
+    drv->waitForReader();
+
+    // other blocks of the shard are served while the read is blocked
+    {
+        auto block = uut->aquire(901);
+        *reinterpret_cast<int*>(block.content()) = 901;
+    }
+    drv->open();
+    reader.join();
+
+    auto block = uut->aquire(900);
+    EXPECT_EQ(900, *reinterpret_cast<const int*>(block.constSlice().content()));
+    EXPECT_EQ(2u, uut->statistics().misses);
+}
+
+TEST_F(CachedAccesserTest, Prefetch)
+{
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    uut->prefetch(400);
+    EXPECT_EQ(1, drv->read_count);
+    EXPECT_EQ(1u, uut->statistics().prefetches);
+
+    // prefetched blocks are not read again
+    uut->aquire(400);
+    EXPECT_EQ(1, drv->read_count);
+    EXPECT_EQ(1u, uut->statistics().hits);
+
+    uut->prefetch(400);
+    EXPECT_EQ(1u, uut->statistics().prefetches);
+}
+
+TEST_F(CachedAccesserTest, PrefetchAsync)
+{
+    static const BlockIndex START = 500;
+    static const Length COUNT = 32;
+
+    std::unique_ptr<UringDriver> drv(new UringDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    for (Length i = 0; i < COUNT; ++i) {
+        *reinterpret_cast<int*>(buffer.content()) = i;
+        drv->writeBlock(START + i, buffer);
+    }
+
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+    uut->setReadahead(COUNT / 4);
+
+    // each hint continuing the previous one reads the following blocks too
+    for (Length i = 0; i < COUNT; ++i) {
+        uut->prefetch(START + i);
+        auto block = uut->aquire(START + i);
+        EXPECT_EQ(static_cast<int>(i), *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+    EXPECT_LE(COUNT, uut->statistics().prefetches);
+    EXPECT_EQ(0u, uut->statistics().misses);
+
+    // pending reads are waited for when destructed
+    uut->prefetch(START + COUNT * 2);
+}
+
+struct FailedReadException : public std::exception
+{ };
+
+class FailingAsyncDriver : public BasicDriver
+{
+public:
+    static const RequestHandle FAILING_HANDLE = 42;
+
+    int wait_count = 0;
+
+    FailingAsyncDriver(const char *path)
+        : BasicDriver(path)
+    { }
+
+    // the request is never read, and fails when waited
+    virtual RequestHandle readBlocksAsync(const BlockIndex *, Length, Slice *)
+    { return FAILING_HANDLE; }
+
+    virtual bool finished(RequestHandle)
+    { return false; }
+
+    virtual void wait(RequestHandle handle)
+    {
+        ++wait_count;
+        if (handle == FAILING_HANDLE) {
+            throw FailedReadException();
+        }
+    }
+};
+
+TEST_F(CachedAccesserTest, PrefetchFailure)
+{
+    static const Length COUNT = 4;
+
+    std::unique_ptr<FailingAsyncDriver> drv(new FailingAsyncDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    for (Length i = 0; i < COUNT; ++i) {
+        *reinterpret_cast<int*>(buffer.content()) = i;
+        drv->writeBlock(i, buffer);
+    }
+
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+    uut->setReadahead(COUNT);
+
+    // all blocks share one request
+    uut->prefetch(0);
+    EXPECT_EQ(COUNT, uut->statistics().prefetches);
+
+    // the request is waited once, the frames of the failed read are read again
+    EXPECT_THROW(uut->aquire(0), FailedReadException);
+    for (Length i = 0; i < COUNT; ++i) {
+        auto block = uut->aquire(i);
+        EXPECT_EQ(static_cast<int>(i), *reinterpret_cast<const int*>(block.constSlice().content()));
+    }
+    EXPECT_EQ(1, drv->wait_count);
+}
+
+class FailingFlushDriver : public BasicDriver
+{
+public:
+    bool failing = false;
+
+    FailingFlushDriver(const char *path)
+        : BasicDriver(path)
+    { }
+
+    virtual void flush()
+    {
+        if (failing) {
+            throw BasicDriverIOException();
+        }
+        BasicDriver::flush();
+    }
+};
+
+TEST_F(CachedAccesserTest, DestructWhenFlushFails)
+{
+    std::unique_ptr<FailingFlushDriver> drv(new FailingFlushDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    allocator->reset();
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+
+    drv->failing = true;
+    {
+        auto block = uut->aquire(uut->allocateBlock());
+        block.content()[0] = 1;
+    }
+    EXPECT_THROW(uut->flush(), BasicDriverIOException);
+
+    // the destructor flushes again, the failure is not thrown out of it
+    uut.reset();
+}
+
+// wait for the flusher until pred holds, at most a few seconds
+template <typename Pred>
+static bool
+waitFor(Pred pred)
+{
+    for (int i = 0; i < 500 && !pred(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return pred();
+}
+
+TEST_F(CachedAccesserTest, FlusherWatermark)
+{
+    static const Length CAPACITY = 100;
+
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get(), nullptr, 1));
+    uut->setCapacity(CAPACITY);
+    uut->setDirtyWatermarks(50, 10);
+    uut->setFlushInterval(0);
+    uut->startFlusher();
+    EXPECT_TRUE(uut->flusherRunning());
+
+    for (Length i = 0; i < CAPACITY / 2; ++i) {
+        auto block = uut->aquire(600 + i);
+        *reinterpret_cast<int*>(block.content()) = i;
+    }
+    EXPECT_EQ(CAPACITY / 2, uut->dirtyCount());
+    EXPECT_EQ(0u, uut->statistics().background_writes);
+
+    // passing the high watermark wakes the flusher
+    {
+        auto block = uut->aquire(600 + CAPACITY / 2);
+        *reinterpret_cast<int*>(block.content()) = CAPACITY / 2;
+    }
+    EXPECT_TRUE(waitFor([&]() { return uut->dirtyCount() * 100 <= CAPACITY * 10; }));
+    EXPECT_LT(0u, uut->statistics().background_writes);
+
+    uut->stopFlusher();
+    EXPECT_FALSE(uut->flusherRunning());
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    drv->readBlock(600, buffer);
+    EXPECT_EQ(0, *reinterpret_cast<const int*>(buffer.content()));
+    drv->readBlock(601, buffer);
+    EXPECT_EQ(1, *reinterpret_cast<const int*>(buffer.content()));
+}
+
+TEST_F(CachedAccesserTest, FlusherInterval)
+{
+    std::unique_ptr<CountingDriver> drv(new CountingDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<CachedAccesser> uut(new CachedAccesser(drv.get(), allocator.get()));
+    uut->setFlushInterval(20);
+    uut->startFlusher();
+    uut->startFlusher();
+
+    for (Length i = 0; i < 3; ++i) {
+        auto block = uut->aquire(700 + i);
+        *reinterpret_cast<int*>(block.content()) = i;
+    }
+
+    // pinned again, so it may be modified
+    auto pinned = uut->aquire(700);
+
+    // far below the high watermark, written by the timer without flushing the driver
+    EXPECT_TRUE(waitFor([&]() { return uut->dirtyCount() == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(1u, uut->dirtyCount());
+    EXPECT_EQ(0, drv->flush_count);
+
+    pinned = uut->aquire(701);
+    EXPECT_TRUE(waitFor([&]() { return uut->dirtyCount() == 0; }));
+
+    uut->stopFlusher();
+    uut->stopFlusher();
+}
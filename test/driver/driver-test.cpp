@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+#include "../test-inc.hpp"
+#include "lib/driver/basic-driver.hpp"
+#include "lib/driver/posix-driver.hpp"
+#include "lib/driver/mmap-driver.hpp"
+#include "lib/driver/uring-driver.hpp"
+
+using namespace cdb;
+
+static const char TEST_PATH[] = TMP_PATH_PREFIX "driver-test.tmp";
+
+/**
+ * Behaviors every kind of Driver shares, run with each of them
+ */
+template <typename T>
+class DriverTest : public ::testing::Test
+{
+protected:
+    static void TearDownTestCase()
+    { std::remove(TEST_PATH); }
+
+    std::unique_ptr<Driver> uut;
+
+    DriverTest()
+    {
+        std::remove(TEST_PATH);
+        uut.reset(new T(TEST_PATH));
+    }
+
+    /** Write "block <index>" to some blocks out of order with one writeBlocksV */
+    void writeVectored()
+    {
+        BlockIndex indices[] = { 7, 3, 4, 12, 5, 20 };
+        const int count = sizeof(indices) / sizeof(indices[0]);
+
+        Buffer buffer(Driver::BLOCK_SIZE * count);
+        std::vector<ConstSlice> srcs;
+        for (int i = 0; i < count; ++i) {
+            std::sprintf(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE), "block %d", indices[i]);
+            srcs.push_back(ConstSlice(buffer.content() + i * Driver::BLOCK_SIZE, Driver::BLOCK_SIZE));
+        }
+        uut->writeBlocksV(indices, count, srcs.data());
+    }
+};
+
+typedef ::testing::Types<BasicDriver, PosixDriver, MmapDriver, UringDriver> DriverTypes;
+TYPED_TEST_CASE(DriverTest, DriverTypes);
+
+TYPED_TEST(DriverTest, WriteVectored)
+{
+    this->writeVectored();
+
+    Buffer dest(Driver::BLOCK_SIZE);
+    this->uut->readBlock(12, dest);
+    EXPECT_STREQ("block 12", reinterpret_cast<const char*>(dest.content()));
+}
+
+TYPED_TEST(DriverTest, ReadVectored)
+{
+    this->writeVectored();
+
+    BlockIndex indices[] = { 20, 4, 3, 1000, 12, 5, 7 };
+    const int count = sizeof(indices) / sizeof(indices[0]);
+
+    // separate buffers, so runs can not be read into one piece of memory
+    std::vector<std::unique_ptr<Buffer> > buffers;
+    std::vector<Slice> dests;
+    for (int i = 0; i < count; ++i) {
+        buffers.emplace_back(new Buffer(Driver::BLOCK_SIZE));
+        std::memset(buffers.back()->content(), 0x7F, Driver::BLOCK_SIZE);
+        dests.push_back(*buffers.back());
+    }
+    this->uut->readBlocksV(indices, count, dests.data());
+
+    char expected[32];
+    for (int i = 0; i < count; ++i) {
+        if (indices[i] == 1000) {
+            EXPECT_EQ(0, dests[i].content()[0]);
+            EXPECT_EQ(0, dests[i].content()[Driver::BLOCK_SIZE - 1]);
+            continue;
+        }
+        std::sprintf(expected, "block %d", indices[i]);
+        EXPECT_STREQ(expected, reinterpret_cast<const char*>(dests[i].content()));
+    }
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include "lib/driver/free-space-tree.hpp"
+
+using namespace cdb;
+
+static const Length WIDTH = 64;
+
+static FreeSpaceTree::Summary
+summary(Length prefix, Length suffix, Length best, Length unit_max)
+{
+    FreeSpaceTree::Summary ret;
+    ret.width = WIDTH;
+    ret.prefix = prefix;
+    ret.suffix = suffix;
+    ret.best = best;
+    ret.unit_max = unit_max;
+    return ret;
+}
+
+TEST(FreeSpaceTreeTest, Combine)
+{
+    auto empty = summary(WIDTH, WIDTH, WIDTH, 32);
+    auto ret = FreeSpaceTree::Summary::combine(summary(1, 10, 20, 10), empty);
+    EXPECT_EQ(2 * WIDTH, ret.width);
+    EXPECT_EQ(1u, ret.prefix);
+    EXPECT_EQ(WIDTH + 10, ret.suffix);
+    EXPECT_EQ(WIDTH + 10, ret.best);
+    EXPECT_EQ(32u, ret.unit_max);
+
+    ret = FreeSpaceTree::Summary::combine(empty, summary(5, 0, 5, 5));
+    EXPECT_EQ(WIDTH + 5, ret.prefix);
+    EXPECT_EQ(0u, ret.suffix);
+}
+
+TEST(FreeSpaceTreeTest, Fit)
+{
+    FreeSpaceTree uut(WIDTH);
+    uut.resize(5);
+    uut.update(1, summary(0, 0, 8, 8));
+    uut.update(3, summary(0, 0, 16, 16));
+
+    Length section;
+    ASSERT_TRUE(uut.firstFit(0, 5, 8, section));
+    EXPECT_EQ(1u, section);
+    ASSERT_TRUE(uut.firstFit(2, 5, 8, section));
+    EXPECT_EQ(3u, section);
+    ASSERT_TRUE(uut.lastFit(0, 5, 8, section));
+    EXPECT_EQ(3u, section);
+    ASSERT_TRUE(uut.lastFit(0, 3, 8, section));
+    EXPECT_EQ(1u, section);
+
+    EXPECT_FALSE(uut.firstFit(0, 5, 17, section));
+    EXPECT_FALSE(uut.lastFit(0, 1, 1, section));
+
+    // sections appended have no free blocks until updated
+    uut.resize(9);
+    EXPECT_EQ(9u, uut.size());
+    EXPECT_FALSE(uut.firstFit(4, 9, 1, section));
+    uut.update(8, summary(0, 0, 32, 32));
+    ASSERT_TRUE(uut.firstFit(4, 9, 17, section));
+    EXPECT_EQ(8u, section);
+    EXPECT_EQ(32u, uut.root().unit_max);
+}
+
+TEST(FreeSpaceTreeTest, RunAcrossSections)
+{
+    FreeSpaceTree uut(WIDTH);
+    uut.resize(4);
+    uut.update(0, summary(0, 10, 10, 10));
+    uut.update(1, summary(WIDTH, WIDTH, WIDTH, 32));
+    uut.update(2, summary(6, 0, 6, 0));
+
+    Length section;
+    BlockIndex start;
+    ASSERT_TRUE(uut.firstRun(1, WIDTH + 16, 10, WIDTH - 10, section, start));
+    EXPECT_EQ(uut.size(), section);
+    EXPECT_EQ(WIDTH - 10, start);
+
+    EXPECT_FALSE(uut.firstRun(1, WIDTH + 17, 10, WIDTH - 10, section, start));
+
+    // without the carry, the run starts at the beginning of section 1
+    ASSERT_TRUE(uut.firstRun(1, WIDTH + 6, 0, 0, section, start));
+    EXPECT_EQ(uut.size(), section);
+    EXPECT_EQ(WIDTH, start);
+}
+
+TEST(FreeSpaceTreeTest, RunInsideSection)
+{
+    FreeSpaceTree uut(WIDTH);
+    uut.resize(3);
+    uut.update(1, summary(2, 3, 20, 8));
+    uut.update(2, summary(0, 0, 40, 32));
+
+    Length section;
+    BlockIndex start;
+    ASSERT_TRUE(uut.firstRun(0, 20, 0, 0, section, start));
+    EXPECT_EQ(1u, section);
+    ASSERT_TRUE(uut.firstRun(0, 21, 0, 0, section, start));
+    EXPECT_EQ(2u, section);
+}
+
+TEST(FreeSpaceTreeTest, Shrink)
+{
+    FreeSpaceTree uut(WIDTH);
+    uut.resize(3);
+    uut.update(2, summary(0, 0, 40, 32));
+
+    Length section;
+    ASSERT_TRUE(uut.firstFit(0, 3, 32, section));
+    EXPECT_EQ(2u, section);
+
+    // dropped sections are not found, even when grown again
+    uut.resize(2);
+    EXPECT_EQ(2u, uut.size());
+    EXPECT_FALSE(uut.firstFit(0, 2, 1, section));
+    uut.resize(3);
+    EXPECT_FALSE(uut.firstFit(0, 3, 1, section));
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+
+#include "../test-inc.hpp"
+
+#include "lib/driver/bitmap-allocator.hpp"
+#include "lib/driver/mmap-accesser.hpp"
+#include "lib/driver/mmap-driver.hpp"
+
+using namespace cdb;
+
+static const char TEST_PATH[] = TMP_PATH_PREFIX "mmap-accesser-test.tmp";
+static const char TEST_STRING[] = "Hello World!";
+
+class MmapAccesserTest : public ::testing::Test
+{
+protected:
+    static void TearDownTestCase()
+    { std::remove(TEST_PATH); }
+};
+
+TEST_F(MmapAccesserTest, Access)
+{
+    std::unique_ptr<MmapDriver> drv(new MmapDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    allocator->reset();
+
+    std::unique_ptr<MmapAccesser> uut(new MmapAccesser(drv.get(), allocator.get()));
+    auto index = uut->allocateBlock();
+
+    {
+        auto block = uut->aquire(index);
+        std::strcpy(reinterpret_cast<char*>(block.content()), TEST_STRING);
+    }
+
+    uut.reset();
+    allocator.reset();
+    drv.reset();
+
+    // ----
+    drv.reset(new MmapDriver(TEST_PATH));
+    allocator.reset(new BitmapAllocator(drv.get(), 0));
+    uut.reset(new MmapAccesser(drv.get(), allocator.get()));
+
+    {
+        auto block = uut->aquire(index);
+        EXPECT_EQ(0, std::strcmp(reinterpret_cast<char*>(block.content()), TEST_STRING));
+    }
+
+    uut->freeBlock(index);
+}
+
+TEST_F(MmapAccesserTest, ZeroCopy)
+{
+    std::unique_ptr<MmapDriver> drv(new MmapDriver(TEST_PATH));
+    std::unique_ptr<BitmapAllocator> allocator(new BitmapAllocator(drv.get(), 0));
+    std::unique_ptr<MmapAccesser> uut(new MmapAccesser(drv.get(), allocator.get()));
+
+    auto index = uut->allocateBlock();
+    auto block1 = uut->aquire(index);
+    auto block2 = uut->aquire(index);
+
+    EXPECT_EQ(block1.content(), block2.content());
+    EXPECT_EQ(drv->mapBlock(index).content(), block1.content());
+
+    std::strcpy(reinterpret_cast<char*>(block1.content()), TEST_STRING);
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    drv->readBlock(index, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<char*>(buffer.content()), TEST_STRING));
+
+    uut->freeBlock(index);
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <cstdio>
+
+#include "../test-inc.hpp"
+#include "lib/driver/mmap-driver.hpp"
+
+using namespace cdb;
+
+static const char TEST_PATH[] = TMP_PATH_PREFIX "mmap-driver-test.tmp";
+static const char TEST_STRING[] = "Hello world";
+static const int MULTIPLE_TIME = 10;
+static const BlockIndex FAR_AWAY = 64 * 1024;   // beyond the first chunk of mapping
+
+class MmapDriverTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestCase()
+    { std::remove(TEST_PATH); }
+
+    static void TearDownTestCase()
+    { std::remove(TEST_PATH); }
+
+    std::unique_ptr<MmapDriver> uut;
+
+    MmapDriverTest()
+        : uut(new MmapDriver(TEST_PATH))
+    { }
+};
+
+TEST_F(MmapDriverTest, WriteSingle)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    std::strcpy(reinterpret_cast<char*>(buffer.content()), TEST_STRING);
+    uut->writeBlock(0, buffer);
+}
+
+TEST_F(MmapDriverTest, ReadSingle)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    uut->readBlock(0, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(buffer.content()), TEST_STRING));
+}
+
+TEST_F(MmapDriverTest, WriteMultple)
+{
+    Buffer buffer(Driver::BLOCK_SIZE * MULTIPLE_TIME);
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        std::strcpy(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE), TEST_STRING);
+    }
+    uut->writeBlocks(0, MULTIPLE_TIME, buffer);
+}
+
+TEST_F(MmapDriverTest, ReadMultple)
+{
+    Buffer buffer(Driver::BLOCK_SIZE * MULTIPLE_TIME);
+    uut->readBlocks(0, MULTIPLE_TIME, buffer);
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        EXPECT_EQ(0, 
+                std::strcmp(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE),
+                    TEST_STRING));
+    }
+}
+
+TEST_F(MmapDriverTest, ReadBeyondMapping)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    std::fill(buffer.begin(), buffer.end(), 1);
+    uut->readBlock(FAR_AWAY, buffer);
+    for (auto i = 0u; i < Driver::BLOCK_SIZE; ++i) {
+        EXPECT_EQ(0, buffer.content()[i]);
+    }
+}
+
+TEST_F(MmapDriverTest, GrowAndMap)
+{
+    auto near = uut->mapBlock(1);
+    std::strcpy(reinterpret_cast<char*>(near.content()), TEST_STRING);
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    std::strcpy(reinterpret_cast<char*>(buffer.content()), TEST_STRING);
+    uut->writeBlock(FAR_AWAY, buffer);
+
+    // growing never moves blocks mapped before
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(near.content()), TEST_STRING));
+
+    auto far = uut->mapBlock(FAR_AWAY);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(far.content()), TEST_STRING));
+}
+
+TEST_F(MmapDriverTest, OpenAgain)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+
+    uut->readBlock(1, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(buffer.content()), TEST_STRING));
+
+    uut->readBlock(FAR_AWAY, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(buffer.content()), TEST_STRING));
+}
+
+TEST_F(MmapDriverTest, OpenFailure)
+{
+    EXPECT_THROW(MmapDriver(TMP_PATH_PREFIX "no-such-directory/mmap-driver-test.tmp"), MmapDriverIOException);
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../test-inc.hpp"
+#include "lib/driver/posix-driver.hpp"
+
+using namespace cdb;
+
+static const char TEST_PATH[] = TMP_PATH_PREFIX "posix-driver-test.tmp";
+static const char TEST_STRING[] = "Hello world";
+static const int MULTIPLE_TIME = 10;
+static const int THREAD_COUNT = 4;
+
+class PosixDriverTest : public ::testing::Test
+{
+protected:
+    static void TearDownTestCase()
+    { std::remove(TEST_PATH); }
+
+    std::unique_ptr<Driver> uut;
+
+    PosixDriverTest()
+        : uut(new PosixDriver(TEST_PATH))
+    { }
+};
+
+TEST_F(PosixDriverTest, WriteSingle)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    std::strcpy(reinterpret_cast<char*>(buffer.content()), TEST_STRING);
+    uut->writeBlock(0, buffer);
+}
+
+TEST_F(PosixDriverTest, ReadSingle)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    uut->readBlock(0, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(buffer.content()), TEST_STRING));
+}
+
+TEST_F(PosixDriverTest, WriteMultple)
+{
+    Buffer buffer(Driver::BLOCK_SIZE * MULTIPLE_TIME);
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        std::strcpy(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE), TEST_STRING);
+    }
+    uut->writeBlocks(0, MULTIPLE_TIME, buffer);
+}
+
+TEST_F(PosixDriverTest, ReadMultple)
+{
+    Buffer buffer(Driver::BLOCK_SIZE * MULTIPLE_TIME);
+    uut->readBlocks(0, MULTIPLE_TIME, buffer);
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        EXPECT_EQ(0, 
+                std::strcmp(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE),
+                    TEST_STRING));
+    }
+}
+
+TEST_F(PosixDriverTest, ReadBeyondEnd)
+{
+    Buffer buffer(Driver::BLOCK_SIZE * 2);
+    std::fill(buffer.begin(), buffer.end(), 1);
+
+    uut->readBlocks(MULTIPLE_TIME - 1, 2, buffer);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<char*>(buffer.content()), TEST_STRING));
+    for (auto i = Driver::BLOCK_SIZE; i < Driver::BLOCK_SIZE * 2; ++i) {
+        EXPECT_EQ(0, buffer.content()[i]);
+    }
+}
+
+TEST_F(PosixDriverTest, ConcurrentAccess)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([this, t]() {
+            Buffer buffer(Driver::BLOCK_SIZE);
+            for (int i = t; i < MULTIPLE_TIME * THREAD_COUNT; i += THREAD_COUNT) {
+                std::fill(buffer.begin(), buffer.end(), static_cast<Byte>(i));
+                uut->writeBlock(i, buffer);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    Buffer buffer(Driver::BLOCK_SIZE * MULTIPLE_TIME * THREAD_COUNT);
+    uut->readBlocks(0, MULTIPLE_TIME * THREAD_COUNT, buffer);
+    for (int i = 0; i < MULTIPLE_TIME * THREAD_COUNT; ++i) {
+        EXPECT_EQ(static_cast<Byte>(i), buffer.content()[i * Driver::BLOCK_SIZE]);
+        EXPECT_EQ(static_cast<Byte>(i), buffer.content()[(i + 1) * Driver::BLOCK_SIZE - 1]);
+    }
+}
+
+TEST_F(PosixDriverTest, OpenFailure)
+{
+    EXPECT_THROW(PosixDriver(TMP_PATH_PREFIX "no-such-directory/posix-driver-test.tmp"), PosixDriverIOException);
+}
+
+TEST_F(PosixDriverTest, FlushFailure)
+{
+    // character devices cannot be synced
+    PosixDriver device("/dev/null");
+    EXPECT_THROW(device.flush(), PosixDriverIOException);
+}
+
+static const char DIRECT_TEST_PATH[] = TMP_PATH_PREFIX "posix-driver-direct-test.tmp";
+
+class PosixDriverDirectTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestCase()
+    { std::remove(DIRECT_TEST_PATH); }
+
+    static void TearDownTestCase()
+    { std::remove(DIRECT_TEST_PATH); }
+
+    std::unique_ptr<PosixDriver> uut;
+
+    PosixDriverDirectTest()
+        : uut(new PosixDriver(DIRECT_TEST_PATH, true))
+    { }
+};
+
+TEST_F(PosixDriverDirectTest, WriteUnaligned)
+{
+    // single blocks in the middle of aligned pages are read-modify-write
+    Buffer buffer(Driver::BLOCK_SIZE);
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        std::sprintf(reinterpret_cast<char*>(buffer.content()), "block %d", i);
+        uut->writeBlock(i * 3, buffer);
+    }
+}
+
+TEST_F(PosixDriverDirectTest, ReadUnaligned)
+{
+    Buffer buffer(Driver::BLOCK_SIZE);
+    char expected[32];
+    for (int i = 0; i < MULTIPLE_TIME; ++i) {
+        uut->readBlock(i * 3, buffer);
+        std::sprintf(expected, "block %d", i);
+        EXPECT_STREQ(expected, reinterpret_cast<const char*>(buffer.content()));
+    }
+}
+
+TEST_F(PosixDriverDirectTest, WriteAligned)
+{
+    Length count = PosixDriver::DIRECT_IO_ALIGNMENT / Driver::BLOCK_SIZE * 2;
+    Buffer buffer = Buffer::Aligned(Driver::BLOCK_SIZE * count, uut->ioAlignment());
+    for (Length i = 0; i < count; ++i) {
+        std::sprintf(reinterpret_cast<char*>(buffer.content() + i * Driver::BLOCK_SIZE), "aligned %d", i);
+    }
+    uut->writeBlocks(count, count, buffer);
+
+    // the unaligned blocks before are kept
+    Buffer block(Driver::BLOCK_SIZE);
+    uut->readBlock(3, block);
+    EXPECT_STREQ("block 1", reinterpret_cast<const char*>(block.content()));
+}
+
+TEST_F(PosixDriverDirectTest, ReadAcrossPages)
+{
+    Length count = PosixDriver::DIRECT_IO_ALIGNMENT / Driver::BLOCK_SIZE * 2;
+    Buffer buffer(Driver::BLOCK_SIZE * 3);
+    uut->readBlocks(count * 2 - 1, 3, buffer);
+
+    char expected[32];
+    std::sprintf(expected, "aligned %d", count - 1);
+    EXPECT_STREQ(expected, reinterpret_cast<const char*>(buffer.content()));
+    for (auto i = Driver::BLOCK_SIZE; i < Driver::BLOCK_SIZE * 3; ++i) {
+        EXPECT_EQ(0, buffer.content()[i]);
+    }
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <set>
+
+#include "lib/driver/replacement-policy.hpp"
+
+using namespace cdb;
+
+static const ReplacementPolicy::Evictable ANY = [](BlockIndex) { return true; };
+
+TEST(ReplacementPolicyTest, LRUOrder)
+{
+    std::unique_ptr<ReplacementPolicy> uut(new LRUReplacementPolicy());
+    uut->setCapacity(3);
+
+    uut->admit(1);
+    uut->admit(2);
+    uut->admit(3);
+    uut->touch(1);
+
+    BlockIndex victim;
+    ASSERT_TRUE(uut->victim(ANY, victim));
+    EXPECT_EQ(2u, victim);
+    uut->evict(victim);
+
+    ASSERT_TRUE(uut->victim(ANY, victim));
+    EXPECT_EQ(3u, victim);
+}
+
+TEST(ReplacementPolicyTest, PinnedSkipped)
+{
+    std::unique_ptr<ReplacementPolicy> uut(new LRUReplacementPolicy());
+    uut->admit(1);
+    uut->admit(2);
+
+    BlockIndex victim;
+    ASSERT_TRUE(uut->victim([](BlockIndex index) { return index != 1; }, victim));
+    EXPECT_EQ(2u, victim);
+
+    EXPECT_FALSE(uut->victim([](BlockIndex) { return false; }, victim));
+}
+
+TEST(ReplacementPolicyTest, TwoQueueScanResistant)
+{
+    static const Length CAPACITY = 16;
+    static const BlockIndex HOT_COUNT = 4;
+    static const BlockIndex SCAN_START = 1000;
+    static const BlockIndex SCAN_COUNT = 100;
+
+    std::unique_ptr<ReplacementPolicy> uut(new TwoQueueReplacementPolicy(CAPACITY));
+    std::set<BlockIndex> cached;
+
+    auto access = [&](BlockIndex index)
+    {
+        if (cached.count(index)) {
+            uut->touch(index);
+            return;
+        }
+        if (cached.size() == CAPACITY) {
+            BlockIndex victim;
+            ASSERT_TRUE(uut->victim(ANY, victim));
+            uut->evict(victim);
+            cached.erase(victim);
+        }
+        uut->admit(index);
+        cached.insert(index);
+    };
+
+    // hot blocks are accessed again soon after falling out of A1in, so they enter Am
+    for (BlockIndex round = 0; round < CAPACITY; ++round) {
+        for (BlockIndex i = 0; i < HOT_COUNT; ++i) {
+            access(i);
+        }
+        for (BlockIndex i = 0; i < HOT_COUNT; ++i) {
+            access(SCAN_START + round * HOT_COUNT + i);
+        }
+    }
+
+    // a long scan does not flush the hot blocks
+    for (BlockIndex i = 0; i < SCAN_COUNT; ++i) {
+        access(SCAN_START * 2 + i);
+    }
+    for (BlockIndex i = 0; i < HOT_COUNT; ++i) {
+        EXPECT_TRUE(cached.count(i));
+    }
+}
+
+TEST(ReplacementPolicyTest, LRUNotScanResistant)
+{
+    static const Length CAPACITY = 16;
+    std::unique_ptr<ReplacementPolicy> uut(new LRUReplacementPolicy());
+    std::set<BlockIndex> cached;
+
+    for (BlockIndex i = 0; i < CAPACITY + 1; ++i) {
+        if (cached.size() == CAPACITY) {
+            BlockIndex victim;
+            ASSERT_TRUE(uut->victim(ANY, victim));
+            uut->evict(victim);
+            cached.erase(victim);
+        }
+        uut->admit(i);
+        cached.insert(i);
+    }
+
+    EXPECT_FALSE(cached.count(0));
+}
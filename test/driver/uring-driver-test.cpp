@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+#include "../test-inc.hpp"
+#include "lib/driver/uring-driver.hpp"
+
+using namespace cdb;
+
+static const char TEST_PATH[] = TMP_PATH_PREFIX "uring-driver-test.tmp";
+static const int BATCH_SIZE = 200;
+
+class UringDriverTest : public ::testing::Test
+{
+protected:
+    static void TearDownTestCase()
+    { std::remove(TEST_PATH); }
+
+    std::unique_ptr<Driver> uut;
+
+    UringDriverTest()
+    {
+        std::remove(TEST_PATH);
+        uut.reset(new UringDriver(TEST_PATH, 16));
+    }
+
+    /**
+     * Write BATCH_SIZE blocks, more than the queue depth, in one request. The i-th block
+     * is filled with i & 0x7F and written to (BATCH_SIZE - i) * 2, in reversed order.
+     *
+     * @return handle of the request, already waited
+     */
+    Driver::RequestHandle writeBatch()
+    {
+        std::vector<BlockIndex> indices;
+        std::vector<ConstSlice> srcs;
+        Buffer buffer(Driver::BLOCK_SIZE * BATCH_SIZE);
+
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            Byte *block = buffer.content() + i * Driver::BLOCK_SIZE;
+            std::memset(block, i & 0x7F, Driver::BLOCK_SIZE);
+            indices.push_back((BATCH_SIZE - i) * 2);
+            srcs.push_back(ConstSlice(block, Driver::BLOCK_SIZE));
+        }
+
+        auto handle = uut->writeBlocksAsync(indices.data(), BATCH_SIZE, srcs.data());
+        uut->wait(handle);
+        return handle;
+    }
+};
+
+TEST_F(UringDriverTest, WriteAsync)
+{
+    EXPECT_TRUE(uut->finished(writeBatch()));
+}
+
+TEST_F(UringDriverTest, ReadAsync)
+{
+    writeBatch();
+
+    std::vector<BlockIndex> indices;
+    std::vector<Slice> dests;
+    Buffer buffer(Driver::BLOCK_SIZE * BATCH_SIZE);
+
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+        indices.push_back((BATCH_SIZE - i) * 2);
+        dests.push_back(Slice(buffer.content() + i * Driver::BLOCK_SIZE, Driver::BLOCK_SIZE));
+    }
+
+    auto handle = uut->readBlocksAsync(indices.data(), BATCH_SIZE, dests.data());
+    uut->wait(handle);
+
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+        EXPECT_EQ(i & 0x7F, dests[i].content()[0]);
+        EXPECT_EQ(i & 0x7F, dests[i].content()[Driver::BLOCK_SIZE - 1]);
+    }
+}
+
+TEST_F(UringDriverTest, ReadHoleAndBeyondEnd)
+{
+    BlockIndex indices[] = { 1, BATCH_SIZE * 4 };
+    Buffer buffer(Driver::BLOCK_SIZE * 2);
+    std::memset(buffer.content(), 0xFF, Driver::BLOCK_SIZE * 2);
+    Slice dests[] = {
+        Slice(buffer.content(), Driver::BLOCK_SIZE),
+        Slice(buffer.content() + Driver::BLOCK_SIZE, Driver::BLOCK_SIZE)
+    };
+
+    uut->wait(uut->readBlocksAsync(indices, 2, dests));
+
+    for (Length i = 0; i < Driver::BLOCK_SIZE * 2; ++i) {
+        EXPECT_EQ(0, buffer.content()[i]);
+    }
+}
+
+TEST_F(UringDriverTest, MultipleRequestsInFlight)
+{
+    static const int REQUEST_COUNT = 8;
+
+    writeBatch();
+
+    Buffer buffer(Driver::BLOCK_SIZE * REQUEST_COUNT);
+    std::vector<Slice> dests;
+    std::vector<BlockIndex> indices;
+    std::vector<Driver::RequestHandle> handles;
+
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        indices.push_back((BATCH_SIZE - i) * 2);
+        dests.push_back(Slice(buffer.content() + i * Driver::BLOCK_SIZE, Driver::BLOCK_SIZE));
+    }
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        handles.push_back(uut->readBlocksAsync(&indices[i], 1, &dests[i]));
+    }
+    for (auto iter = handles.rbegin(); iter != handles.rend(); ++iter) {
+        uut->wait(*iter);
+    }
+
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        EXPECT_EQ(i, dests[i].content()[0]);
+    }
+}
+
+TEST_F(UringDriverTest, SyncReadAfterAsyncWrite)
+{
+    BlockIndex index = 3;
+    Buffer src(Driver::BLOCK_SIZE);
+    std::strcpy(reinterpret_cast<char*>(src.content()), "Hello world");
+    ConstSlice srcs[] = { src };
+
+    uut->wait(uut->writeBlocksAsync(&index, 1, srcs));
+
+    Buffer dest(Driver::BLOCK_SIZE);
+    uut->readBlock(index, dest);
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(dest.content()), "Hello world"));
+}
@@ -0,0 +1,452 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../test-inc.hpp"
+#include "lib/driver/posix-driver.hpp"
+#include "lib/driver/write-ahead-log.hpp"
+
+using namespace cdb;
+
+static const char DATA_PATH[] = TMP_PATH_PREFIX "write-ahead-log-test.tmp";
+static const char LOG_PATH[] = TMP_PATH_PREFIX "write-ahead-log-test.tmp-wal";
+static const char SAVED_PATH[] = TMP_PATH_PREFIX "write-ahead-log-test.tmp-saved";
+static const int MAX_SEGMENT = 256;
+static const int THREAD_COUNT = 8;
+static const int COMMIT_TIME = 20;
+
+/** a data driver whose sync fails while `failing' is set */
+class FailingSyncDriver : public PosixDriver
+{
+public:
+    bool failing;
+
+    FailingSyncDriver(const char *path)
+        : PosixDriver(path),
+          failing(false)
+    { }
+
+    virtual void flush()
+    {
+        if (failing) {
+            throw PosixDriverIOException();
+        }
+        PosixDriver::flush();
+    }
+};
+
+class WriteAheadLogTest : public ::testing::Test
+{
+protected:
+    std::unique_ptr<WriteAheadLog> uut;
+
+    WriteAheadLogTest()
+    {
+        removeAll();
+        uut.reset(new WriteAheadLog(new PosixDriver(DATA_PATH), LOG_PATH));
+    }
+
+    ~WriteAheadLogTest()
+    {
+        uut.reset();
+        removeAll();
+    }
+
+    static std::string segmentPath(const std::string &path, int segment)
+    { return path + "." + std::to_string(segment); }
+
+    static bool exists(const std::string &path)
+    { return std::ifstream(path).good(); }
+
+    static void copyFile(const std::string &from, const std::string &to)
+    {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+    }
+
+    static void removeAll()
+    {
+        std::remove(DATA_PATH);
+        std::remove(SAVED_PATH);
+        for (int i = 1; i <= MAX_SEGMENT; ++i) {
+            std::remove(segmentPath(LOG_PATH, i).c_str());
+            std::remove(segmentPath(SAVED_PATH, i).c_str());
+        }
+    }
+
+    static Buffer filled(Byte value)
+    {
+        Buffer buffer(Driver::BLOCK_SIZE);
+        std::fill(buffer.begin(), buffer.end(), value);
+        return buffer;
+    }
+
+    static Byte readData(BlockIndex index)
+    {
+        PosixDriver data(DATA_PATH);
+        Buffer buffer(Driver::BLOCK_SIZE);
+        data.readBlock(index, buffer);
+        return buffer.content()[0];
+    }
+
+    /**
+     * Save the segments and the data file, as if crashed at this moment
+     *
+     * A checkpoint running meanwhile flushes the data file before it deletes segments,
+     * from the oldest one. So segments are saved from the newest one and the data file
+     * is saved last, what is saved is then a run of segments ending with the newest,
+     * and a data file containing the images of every segment deleted before. Replaying
+     * images the data file already has changes nothing.
+     *
+     * @return number of the last segment saved
+     */
+    static int save()
+    {
+        int last = 0;
+        for (int i = MAX_SEGMENT; i >= 1; --i) {
+            if (exists(segmentPath(LOG_PATH, i))) {
+                copyFile(segmentPath(LOG_PATH, i), segmentPath(SAVED_PATH, i));
+                last = std::max(last, i);
+            }
+        }
+
+        copyFile(DATA_PATH, SAVED_PATH);
+        return last;
+    }
+
+    /**
+     * Reopen the log with what is saved before
+     */
+    void crashAndReopen()
+    {
+        uut.reset();
+
+        copyFile(SAVED_PATH, DATA_PATH);
+        for (int i = 1; i <= MAX_SEGMENT; ++i) {
+            std::remove(segmentPath(LOG_PATH, i).c_str());
+            if (exists(segmentPath(SAVED_PATH, i))) {
+                copyFile(segmentPath(SAVED_PATH, i), segmentPath(LOG_PATH, i));
+            }
+        }
+
+        uut.reset(new WriteAheadLog(new PosixDriver(DATA_PATH), LOG_PATH));
+    }
+
+    template <typename Predicate>
+    static bool waitFor(Predicate predicate)
+    {
+        for (int i = 0; i < 1000 && !predicate(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return predicate();
+    }
+};
+
+TEST_F(WriteAheadLogTest, ReadWritten)
+{
+    uut->writeBlock(1, filled(1));
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    uut->readBlock(1, buffer);
+    EXPECT_EQ(1, buffer.content()[Driver::BLOCK_SIZE - 1]);
+
+    // not in the data file before a checkpoint
+    EXPECT_EQ(0, readData(1));
+}
+
+TEST_F(WriteAheadLogTest, ReplayCommitted)
+{
+    uut->writeBlock(1, filled(1));
+    uut->writeBlock(2, filled(2));
+    uut->writeBlock(1, filled(3));
+    uut->commit();
+    save();
+
+    crashAndReopen();
+    EXPECT_EQ(0, uut->size());
+    EXPECT_EQ(3, readData(1));
+    EXPECT_EQ(2, readData(2));
+}
+
+TEST_F(WriteAheadLogTest, DiscardUncommitted)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    uut->writeBlock(1, filled(2));
+    uut->writeBlock(2, filled(2));
+    save();
+
+    crashAndReopen();
+    EXPECT_EQ(1, readData(1));
+    EXPECT_EQ(0, readData(2));
+}
+
+TEST_F(WriteAheadLogTest, DiscardTorn)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    uut->writeBlock(2, filled(2));
+    uut->commit();
+    auto segment = segmentPath(SAVED_PATH, save());
+
+    // lose the last byte of the second commit record
+    std::ifstream in(segment, std::ios::binary);
+    std::vector<char> content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(segment, std::ios::binary | std::ios::trunc);
+    out.write(content.data(), content.size() - 1);
+    out.close();
+
+    crashAndReopen();
+    EXPECT_EQ(1, readData(1));
+    EXPECT_EQ(0, readData(2));
+}
+
+TEST_F(WriteAheadLogTest, FlushWithoutCommit)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+
+    // as if crashed between writing back the pages of the cache and of the allocator
+    uut->writeBlock(1, filled(2));
+    uut->flush();
+    save();
+    uut->writeBlock(2, filled(2));
+    uut->flush();
+    uut->commit();
+
+    crashAndReopen();
+    EXPECT_EQ(1, readData(1));
+    EXPECT_EQ(0, readData(2));
+}
+
+TEST_F(WriteAheadLogTest, CommitWithoutWrite)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    auto syncs = uut->syncCount();
+
+    uut->commit();
+    EXPECT_EQ(syncs, uut->syncCount());
+}
+
+/**
+ * Block threads until all of them arrive
+ */
+class Barrier
+{
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _count;
+    int _waiting = 0;
+    int _generation = 0;
+
+public:
+    Barrier(int count)
+        : _count(count)
+    { }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        int generation = _generation;
+        if (++_waiting == _count) {
+            _waiting = 0;
+            ++_generation;
+            _cond.notify_all();
+            return;
+        }
+        _cond.wait(lock, [&]() { return generation != _generation; });
+    }
+};
+
+TEST_F(WriteAheadLogTest, GroupCommit)
+{
+    auto syncs = uut->syncCount();
+
+    // every page is written before anyone commits, so the first commit of a round
+    // commits the pages of all threads, and the others piggyback on its sync
+    Barrier barrier(THREAD_COUNT);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([this, t, &barrier]() {
+            for (int i = 0; i < COMMIT_TIME; ++i) {
+                uut->writeBlock(t, filled(static_cast<Byte>(i + 1)));
+                barrier.wait();
+                uut->commit();
+                barrier.wait();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(syncs + COMMIT_TIME, uut->syncCount());
+
+    uut.reset();
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        EXPECT_EQ(COMMIT_TIME, readData(t));
+    }
+}
+
+TEST_F(WriteAheadLogTest, Checkpoint)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    EXPECT_LT(0, uut->size());
+
+    uut->checkpoint();
+    EXPECT_EQ(0, uut->size());
+    EXPECT_EQ(1, readData(1));
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    uut->readBlock(1, buffer);
+    EXPECT_EQ(1, buffer.content()[0]);
+
+}
+
+TEST_F(WriteAheadLogTest, CheckpointKeepsSegmentsWhenSyncFails)
+{
+    uut.reset();
+    auto *data = new FailingSyncDriver(DATA_PATH);
+    uut.reset(new WriteAheadLog(data, LOG_PATH));
+
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    auto size = uut->size();
+
+    data->failing = true;
+    EXPECT_THROW(uut->checkpoint(), PosixDriverIOException);
+    EXPECT_EQ(size, uut->size());
+    EXPECT_EQ(0, uut->checkpointCount());
+
+    data->failing = false;
+    uut->checkpoint();
+    EXPECT_EQ(0, uut->size());
+    EXPECT_EQ(1, readData(1));
+}
+
+TEST_F(WriteAheadLogTest, CheckpointKeepsUncommitted)
+{
+    uut->writeBlock(1, filled(1));
+    uut->commit();
+    uut->writeBlock(2, filled(2));
+
+    uut->checkpoint();
+    EXPECT_EQ(1, readData(1));
+    EXPECT_EQ(0, readData(2));
+    EXPECT_EQ(1, uut->segmentCount());
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    uut->readBlock(2, buffer);
+    EXPECT_EQ(2, buffer.content()[0]);
+
+    // the older segment is gone, the page is committed from the new one
+    uut->commit();
+    save();
+
+    crashAndReopen();
+    EXPECT_EQ(1, readData(1));
+    EXPECT_EQ(2, readData(2));
+}
+
+TEST_F(WriteAheadLogTest, Segments)
+{
+    static const int BLOCK_COUNT = 32;
+
+    uut->setCheckpointSize(0);
+    uut->setSegmentSize(4 * Driver::BLOCK_SIZE);
+    for (int i = 0; i < BLOCK_COUNT; ++i) {
+        uut->writeBlock(i, filled(static_cast<Byte>(i + 1)));
+        if (i % 3 == 2) {
+            uut->commit();
+        }
+    }
+    uut->commit();
+    EXPECT_LT(1, uut->segmentCount());
+    save();
+
+    crashAndReopen();
+    EXPECT_EQ(1, uut->segmentCount());
+    for (int i = 0; i < BLOCK_COUNT; ++i) {
+        EXPECT_EQ(i + 1, readData(i));
+    }
+}
+
+TEST_F(WriteAheadLogTest, ReplayAfterCheckpoint)
+{
+    uut->setSegmentSize(4 * Driver::BLOCK_SIZE);
+    for (int i = 0; i < 8; ++i) {
+        uut->writeBlock(i, filled(1));
+    }
+    uut->commit();
+    uut->checkpoint();
+    EXPECT_EQ(0, uut->size());
+
+    uut->writeBlock(0, filled(2));
+    uut->commit();
+    save();
+
+    // only the tail after the checkpoint is left to replay
+    crashAndReopen();
+    EXPECT_EQ(2, readData(0));
+    for (int i = 1; i < 8; ++i) {
+        EXPECT_EQ(1, readData(i));
+    }
+}
+
+TEST_F(WriteAheadLogTest, BackgroundCheckpoint)
+{
+    uut->setCheckpointSize(8 * Driver::BLOCK_SIZE);
+    for (int i = 0; i < 16; ++i) {
+        uut->writeBlock(i, filled(1));
+        uut->commit();
+    }
+
+    EXPECT_TRUE(waitFor([this]() { return uut->checkpointCount() > 0; }));
+    EXPECT_GT(16 * Driver::BLOCK_SIZE, uut->size());
+
+    Buffer buffer(Driver::BLOCK_SIZE);
+    for (int i = 0; i < 16; ++i) {
+        uut->readBlock(i, buffer);
+        EXPECT_EQ(1, buffer.content()[0]);
+    }
+}
+
+TEST_F(WriteAheadLogTest, ConcurrentCheckpoint)
+{
+    uut->setCheckpointSize(8 * Driver::BLOCK_SIZE);
+    uut->setSegmentSize(4 * Driver::BLOCK_SIZE);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([this, t]() {
+            Buffer buffer(Driver::BLOCK_SIZE);
+            for (int i = 0; i < COMMIT_TIME; ++i) {
+                uut->writeBlock(t, filled(static_cast<Byte>(i + 1)));
+                uut->readBlock(t, buffer);
+                EXPECT_EQ(i + 1, buffer.content()[0]);
+                uut->commit();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    save();
+
+    crashAndReopen();
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        EXPECT_EQ(COMMIT_TIME, readData(t));
+    }
+}
@@ -3,14 +3,18 @@
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
 #include <vector>
 #include <random>
+#include <set>
+#include <string>
 
 #include "../test-inc.hpp"
 #include "lib/driver/bitmap-allocator.hpp"
 #include "lib/driver/basic-driver.hpp"
 #include "lib/driver/cached-accesser.hpp"
 #include "lib/index/btree.hpp"
+#include "lib/utils/comparator.hpp"
 
 #include "lib/index/btree-intl.hpp"
 
@@ -33,8 +37,15 @@ protected:
     std::unique_ptr<CachedAccesser> accesser;
     std::unique_ptr<BTree> uut;
 
+    /** blocks allocated as new roots are cleaned by BTree::reset, start from an empty file */
+    static Driver *newDriver()
+    {
+        std::remove(TEST_PATH);
+        return new BasicDriver(TEST_PATH);
+    }
+
     BTreeTest()
-        : drv(new BasicDriver(TEST_PATH)),
+        : drv(newDriver()),
           allocator(new BitmapAllocator(drv.get(), 0)),
           accesser(new CachedAccesser(drv.get(), allocator.get()))
     {
@@ -60,6 +71,108 @@ protected:
         uut->reset();
     }
 
+    /**
+     * Fill the tree with `keys' of type T, searched as `key_type', and check lowerBound
+     * and upperBound against std::set, before and after erasing half of them
+     */
+    template <typename T>
+    void checkKeyType(BTree::KeyType key_type, std::vector<T> keys)
+    {
+        uut.reset(new BTree(
+                accesser.get(),
+                [](const Byte *a, const Byte *b) -> bool
+                { return *reinterpret_cast<const T*>(a) < *reinterpret_cast<const T*>(b); },
+                [](const Byte *a, const Byte *b) -> bool
+                { return *reinterpret_cast<const T*>(a) == *reinterpret_cast<const T*>(b); },
+                accesser->allocateBlock(),
+                sizeof(T),
+                28,
+                key_type
+            ));
+        uut->reset();
+
+        std::set<T> expected;
+        for (auto &key : keys) {
+            uut->insert(uut->makeKey(&key));
+            expected.insert(key);
+        }
+
+        auto check = [&]() {
+            for (auto &key : keys) {
+                for (T probe : {key, static_cast<T>(key - 1), static_cast<T>(key + 1)}) {
+                    auto lower = expected.lower_bound(probe);
+                    auto iter = uut->lowerBound(uut->makeKey(&probe));
+                    if (lower == expected.end()) {
+                        EXPECT_TRUE(iter == uut->end());
+                    }
+                    else {
+                        ASSERT_TRUE(iter != uut->end());
+                        EXPECT_EQ(*lower, *reinterpret_cast<const T*>(iter.getKey().start()));
+                    }
+
+                    auto upper = expected.upper_bound(probe);
+                    iter = uut->upperBound(uut->makeKey(&probe));
+                    if (upper == expected.end()) {
+                        EXPECT_TRUE(iter == uut->end());
+                    }
+                    else {
+                        ASSERT_TRUE(iter != uut->end());
+                        EXPECT_EQ(*upper, *reinterpret_cast<const T*>(iter.getKey().start()));
+                    }
+                }
+            }
+        };
+
+        check();
+        for (std::size_t i = 0; i < keys.size(); i += 2) {
+            uut->erase(uut->makeKey(&keys[i]));
+            expected.erase(keys[i]);
+        }
+        check();
+    }
+
+    std::vector<BlockIndex> leafIndices()
+    {
+        std::vector<BlockIndex> ret;
+        for (BlockIndex index = uut->_first_leaf; index; ) {
+            ret.push_back(index);
+            Block leaf = accesser->aquire(index);
+            index = uut->getHeaderFromNode(leaf)->next;
+        }
+        return ret;
+    }
+
+    /** @return the child before the first key of the root, 0 if the root is a leaf */
+    BlockIndex firstChildOfRoot()
+    {
+        Block root = accesser->aquire(uut->getRootIndex());
+        return uut->getMarkFromNode(root)->before;
+    }
+
+    Length maximumEntryPerLeaf()
+    { return uut->maximumEntryPerLeaf(); }
+
+    /**
+     * Bulk load `count' records, whose keys are even numbers from 0 and values are
+     * halves of keys
+     */
+    void bulkLoadEven(int count, double fill_factor)
+    {
+        int i = 0;
+        int record[2];
+        uut->bulkLoad([&]() -> const Byte *
+            {
+                if (i == count) {
+                    return nullptr;
+                }
+                record[0] = i * 2;
+                record[1] = i++;
+                return reinterpret_cast<const Byte *>(record);
+            },
+            fill_factor
+        );
+    }
+
     void treeDump(std::ostream &os)
     {
         os << "first_leaf: " << uut->_first_leaf << std::endl;
@@ -495,6 +608,306 @@ TEST_F(BTreeTest, Iterator)
     }
 }
 
+TEST_F(BTreeTest, ScanPrefetch)
+{
+    for (int i = 0; i < TEST_LARGE_NUMBER; ++i) {
+        auto iter = uut->insert(uut->makeKey(&i));
+        *reinterpret_cast<int*>(iter.getValue().content()) = i;
+    }
+
+    // too small to keep the leaves, so the scan misses
+    accesser->setCapacity(CachedAccesser::SHARD_COUNT * 4);
+    accesser->resetStatistics();
+
+    int expected = 0;
+    uut->forEach([&](const BTree::Iterator &iter)
+        {
+            EXPECT_EQ(expected++, *reinterpret_cast<const int*>(iter.getValue().content()));
+        });
+    EXPECT_EQ(TEST_LARGE_NUMBER, expected);
+
+    // leaves after the first are prefetched before they are reached
+    auto statistics = accesser->statistics();
+    EXPECT_LT(0u, statistics.prefetches);
+    EXPECT_GT(statistics.prefetches, statistics.misses);
+}
+
+TEST_F(BTreeTest, CleanFreesAllNodes)
+{
+    static const int REUSED = 1000;
+
+    for (int i = 0; i < TEST_LARGE_NUMBER; ++i) {
+        uut->insert(uut->makeKey(&i));
+    }
+
+    // the child before the first key of an internal node is freed with the others
+    BlockIndex before = firstChildOfRoot();
+    ASSERT_NE(0u, before);
+    uut->clean();
+
+    std::set<BlockIndex> reused;
+    for (int i = 0; i < REUSED; ++i) {
+        reused.insert(accesser->allocateBlock());
+    }
+    EXPECT_EQ(1u, reused.count(before));
+}
+
+
+TEST_F(BTreeTest, Compact)
+{
+    static const int PADDING = 1000;
+
+    // leave free blocks before the tree
+    std::vector<BlockIndex> padding;
+    for (int i = 0; i < PADDING; ++i) {
+        padding.push_back(accesser->allocateBlock());
+    }
+    for (int i = 0; i < TEST_LARGE_NUMBER; ++i) {
+        auto iter = uut->insert(uut->makeKey(&i));
+        *reinterpret_cast<int*>(iter.getValue().content()) = i;
+    }
+    for (auto index : padding) {
+        accesser->freeBlock(index);
+    }
+    auto leaves = leafIndices();
+    EXPECT_LT(static_cast<BlockIndex>(PADDING), leaves.back());
+
+    uut->compact();
+
+    // leaves are moved to the front in key order
+    leaves = leafIndices();
+    EXPECT_LT(leaves.back(), static_cast<BlockIndex>(PADDING));
+    for (unsigned int i = 1; i < leaves.size(); ++i) {
+        EXPECT_LT(leaves[i - 1], leaves[i]);
+    }
+    EXPECT_LT(uut->getRootIndex(), static_cast<BlockIndex>(PADDING));
+
+    int expected = 0;
+    uut->forEach([&](const BTree::Iterator &iter)
+        {
+            EXPECT_EQ(expected++, *reinterpret_cast<const int*>(iter.getValue().content()));
+        });
+    EXPECT_EQ(TEST_LARGE_NUMBER, expected);
+
+    for (int i = 0; i < TEST_LARGE_NUMBER; i += 2) {
+        uut->erase(uut->makeKey(&i));
+    }
+    for (int i = 1; i < TEST_LARGE_NUMBER; i += 2) {
+        EXPECT_EQ(i, *reinterpret_cast<const int*>(uut->lowerBound(uut->makeKey(&i)).getValue().content()));
+    }
+}
+
+TEST_F(BTreeTest, LeavesInRuns)
+{
+    for (int i = 0; i < TEST_LARGE_NUMBER; ++i) {
+        uut->insert(uut->makeKey(&i));
+    }
+
+    // new leaves follow the leaves they are split from, runs are broken only by
+    // blocks taken by internal nodes
+    auto leaves = leafIndices();
+    int breaks = 0;
+    for (unsigned int i = 1; i < leaves.size(); ++i) {
+        if (leaves[i] != leaves[i - 1] + 1) {
+            ++breaks;
+        }
+    }
+    EXPECT_LT(breaks * 16, static_cast<int>(leaves.size()));
+}
+
+TEST_F(BTreeTest, BulkLoad)
+{
+    bulkLoadEven(TEST_LARGE_NUMBER, 1);
+
+    // leaves are full and laid one after another
+    auto leaves = leafIndices();
+    auto per_leaf = static_cast<int>(maximumEntryPerLeaf());
+    EXPECT_EQ((TEST_LARGE_NUMBER + per_leaf - 1) / per_leaf, static_cast<int>(leaves.size()));
+    for (unsigned int i = 1; i < leaves.size(); ++i) {
+        EXPECT_EQ(leaves[i - 1] + 1, leaves[i]);
+    }
+
+    int expected = 0;
+    uut->forEach([&](const BTree::Iterator &iter)
+        {
+            EXPECT_EQ(expected * 2, *reinterpret_cast<const int*>(iter.getKey().start()));
+            EXPECT_EQ(expected++, *reinterpret_cast<const int*>(iter.getValue().content()));
+        });
+    EXPECT_EQ(TEST_LARGE_NUMBER, expected);
+
+    for (int i = 0; i < TEST_LARGE_NUMBER * 2 - 1; ++i) {
+        auto iter = uut->lowerBound(uut->makeKey(&i));
+        ASSERT_TRUE(iter != uut->end());
+        EXPECT_EQ((i + 1) / 2, *reinterpret_cast<const int*>(iter.getValue().content()));
+    }
+
+    // the tree is updated as usual afterwards
+    for (int i = 1; i < TEST_LARGE_NUMBER * 2; i += 2) {
+        auto iter = uut->insert(uut->makeKey(&i));
+        *reinterpret_cast<int*>(iter.getValue().content()) = i;
+    }
+    for (int i = 0; i < TEST_LARGE_NUMBER * 2; i += 2) {
+        uut->erase(uut->makeKey(&i));
+    }
+    expected = 1;
+    uut->forEach([&](const BTree::Iterator &iter)
+        {
+            EXPECT_EQ(expected, *reinterpret_cast<const int*>(iter.getValue().content()));
+            expected += 2;
+        });
+    EXPECT_EQ(TEST_LARGE_NUMBER * 2 + 1, expected);
+}
+
+TEST_F(BTreeTest, BulkLoadFillFactor)
+{
+    bulkLoadEven(TEST_LARGE_NUMBER, 0.5);
+
+    auto per_leaf = static_cast<int>(maximumEntryPerLeaf() / 2);
+    auto leaves = leafIndices();
+    EXPECT_EQ((TEST_LARGE_NUMBER + per_leaf - 1) / per_leaf, static_cast<int>(leaves.size()));
+
+    // the space left takes inserted keys without splitting
+    for (int i = 1; i < TEST_LARGE_NUMBER * 2; i += per_leaf * 2) {
+        uut->insert(uut->makeKey(&i));
+    }
+    EXPECT_EQ(leaves, leafIndices());
+
+    for (int i = 0; i < TEST_LARGE_NUMBER * 2; i += 2) {
+        auto iter = uut->lowerBound(uut->makeKey(&i));
+        ASSERT_TRUE(iter != uut->end());
+        EXPECT_EQ(i / 2, *reinterpret_cast<const int*>(iter.getValue().content()));
+    }
+}
+
+TEST_F(BTreeTest, BulkLoadFew)
+{
+    bulkLoadEven(0, 1);
+    EXPECT_TRUE(uut->begin() == uut->end());
+
+    uut->reset();
+    bulkLoadEven(3, 1);
+    EXPECT_EQ(std::vector<BlockIndex>({ uut->getRootIndex() }), leafIndices());
+
+    int i = 3;
+    EXPECT_EQ(2, *reinterpret_cast<const int*>(uut->lowerBound(uut->makeKey(&i)).getValue().content()));
+    i = 5;
+    EXPECT_TRUE(uut->lowerBound(uut->makeKey(&i)) == uut->end());
+}
+
+TEST_F(BTreeTest, IntegerKeyType)
+{
+    std::vector<int> keys;
+    for (int i = 0; i < TEST_LARGE_NUMBER / 2; ++i) {
+        keys.push_back((i - TEST_LARGE_NUMBER / 4) * 3);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::default_random_engine(0));
+
+    checkKeyType(BTree::KeyType::INTEGER, keys);
+}
+
+TEST_F(BTreeTest, FloatKeyType)
+{
+    std::vector<float> keys;
+    for (int i = 0; i < TEST_LARGE_NUMBER / 2; ++i) {
+        keys.push_back((i - TEST_LARGE_NUMBER / 4) * 2.5f);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::default_random_engine(0));
+
+    checkKeyType(BTree::KeyType::FLOAT, keys);
+}
+
+TEST_F(BTreeTest, CombinedKeyLayout)
+{
+    static const Length NAME_LENGTH = 8;
+    static const Length KEY_SIZE = NAME_LENGTH + sizeof(int);
+
+    uut.reset(new BTree(
+            accesser.get(),
+            Comparator::getCombineCmpFuncLT(Schema::Field::Type::CHAR, NAME_LENGTH, Schema::Field::Type::INTEGER),
+            Comparator::getCombineCmpFuncEQ(Schema::Field::Type::CHAR, NAME_LENGTH, Schema::Field::Type::INTEGER),
+            accesser->allocateBlock(),
+            KEY_SIZE,
+            0,
+            BTree::KeyLayout(BTree::KeyType::CHAR, NAME_LENGTH, BTree::KeyType::INTEGER)
+        ));
+    uut->reset();
+
+    std::vector<std::vector<Byte> > keys;
+    for (int i = 0; i < TEST_LARGE_NUMBER / 2; ++i) {
+        std::vector<Byte> key(KEY_SIZE);
+        std::string name = "k" + std::to_string(i % 97);
+        std::copy(name.begin(), name.end(), key.begin());
+        std::memcpy(key.data() + NAME_LENGTH, &i, sizeof(i));
+        keys.push_back(key);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::default_random_engine(0));
+
+    auto toPair = [](const Byte *key) {
+        int primary;
+        std::memcpy(&primary, key + NAME_LENGTH, sizeof(primary));
+        return std::make_pair(std::string(reinterpret_cast<const char*>(key)), primary);
+    };
+
+    std::set<std::pair<std::string, int> > expected;
+    for (auto &key : keys) {
+        uut->insert(uut->makeKey(key.data(), KEY_SIZE));
+        expected.insert(toPair(key.data()));
+    }
+
+    // full leaves are not split for duplicated keys
+    for (auto &key : keys) {
+        EXPECT_THROW(uut->insert(uut->makeKey(key.data(), KEY_SIZE)), BTreeDuplicateKeyException);
+    }
+
+    auto check = [&]() {
+        auto iter = expected.begin();
+        uut->forEach([&](const BTree::Iterator &record) {
+            ASSERT_TRUE(iter != expected.end());
+            EXPECT_EQ(*iter++, toPair(record.getKey().start()));
+        });
+        EXPECT_TRUE(iter == expected.end());
+
+        for (auto &key : keys) {
+            auto lower = expected.lower_bound(toPair(key.data()));
+            auto found = uut->lowerBound(uut->makeKey(key.data(), KEY_SIZE));
+            if (lower == expected.end()) {
+                EXPECT_TRUE(found == uut->end());
+            }
+            else {
+                ASSERT_TRUE(found != uut->end());
+                EXPECT_EQ(*lower, toPair(found.getKey().start()));
+            }
+        }
+    };
+
+    check();
+    for (std::size_t i = 0; i < keys.size(); i += 2) {
+        uut->erase(uut->makeKey(keys[i].data(), KEY_SIZE));
+        expected.erase(toPair(keys[i].data()));
+    }
+    check();
+}
+
+TEST_F(BTreeTest, InsertDuplicateInFullLeaf)
+{
+    auto count = static_cast<int>(maximumEntryPerLeaf());
+    for (int i = 0; i < count; ++i) {
+        uut->insert(uut->makeKey(&i));
+    }
+
+    // the full leaf is not split for a duplicated key, or its new half is left without a parent
+    for (int i = 0; i < count; ++i) {
+        EXPECT_THROW(uut->insert(uut->makeKey(&i)), BTreeDuplicateKeyException);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        auto iter = uut->lowerBound(uut->makeKey(&i));
+        ASSERT_TRUE(iter != uut->end());
+        EXPECT_EQ(i, *reinterpret_cast<const int*>(iter.getKey().start()));
+    }
+}
+
+
 TEST_F(BTreeTest, OtherSize)
 {
     uut.reset(new BTree(
@@ -582,6 +582,65 @@ TEST_F(TableTest, LargeIndex)
     }
 }
 
+TEST_F(TableTest, IndexOnRepeatedValues)
+{
+    std::unique_ptr<Table::RecordBuilder> builder(uut->getRecordBuilder(
+            {
+                    "id",
+                    "name",
+                    "gpa",
+                    "gender",
+            }
+    ));
+
+    for (int i = 0; i < LARGE_NUMBER; ++i) {
+        builder->addRow()
+                .addInteger(i)
+                .addChar("name" + std::to_string(i))
+                .addFloat(i % SMALL_NUMBER)
+                .addInteger(i & 1);
+    }
+    uut->insert(builder->getSchema(), builder->getRows());
+    uut->createIndex("gpa", "gpaIdx");
+
+    builder->reset();
+    for (int i = LARGE_NUMBER; i < LARGE_NUMBER + SMALL_NUMBER; ++i) {
+        builder->addRow()
+                .addInteger(i)
+                .addChar("name" + std::to_string(i))
+                .addFloat(i % SMALL_NUMBER)
+                .addInteger(i & 1);
+    }
+    uut->insert(builder->getSchema(), builder->getRows());
+
+    std::unique_ptr<ConditionExpr> condition(
+            uut->optimizeCondition(
+                    new AndExpr(
+                            new CompareExpr("gpa", CompareExpr::Operator::LT, "3.1"),
+                            new CompareExpr("gpa", CompareExpr::Operator::GE, "2.9")
+                    )
+            )
+    );
+    std::unique_ptr<Schema> select_schema(uut->buildSchemaFromColumnNames(std::vector<std::string>{"id", "gpa"}));
+
+    // rows of the same value are found in order of the primary key
+    int count = 0;
+    uut->select(
+            select_schema.get(),
+            condition.get(),
+            [&](ConstSlice row)
+            {
+                auto id_col = select_schema->getColumnByName("id");
+                EXPECT_EQ(
+                        count * SMALL_NUMBER + 3,
+                        *reinterpret_cast<const int*>(id_col.getValue(row).content())
+                );
+                ++count;
+            }
+    );
+    EXPECT_EQ((LARGE_NUMBER + SMALL_NUMBER) / SMALL_NUMBER, count);
+}
+
 TEST_F(TableTest, dropIndex)
 {
     uut->createIndex("gpa", "gpaIdx");
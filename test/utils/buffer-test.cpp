@@ -68,3 +68,19 @@ TEST(BufferTest, CopyOnWrite)
     EXPECT_EQ('e', uut2.content()[1]);
     EXPECT_EQ('l', uut2.content()[2]);
 }
+
+TEST(BufferTest, Aligned)
+{
+    static const Length ALIGNMENT = 4096;
+
+    Buffer uut1 = Buffer::Aligned(TEST_LENGTH, ALIGNMENT);
+    EXPECT_EQ(TEST_LENGTH, uut1.length());
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(uut1.content()) % ALIGNMENT);
+    std::strcpy(reinterpret_cast<char*>(uut1.content()), TEST_STRING);
+
+    // alignment is kept when copied on write
+    Buffer uut2(uut1);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(uut2.content()) % ALIGNMENT);
+    EXPECT_NE(uut1.content(), uut2.content());
+    EXPECT_EQ(0, std::strcmp(reinterpret_cast<const char*>(uut2.content()), TEST_STRING));
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "lib/utils/latch.hpp"
+
+using namespace cdb;
+
+TEST(LatchTest, SharedAndExclusive)
+{
+    Latch uut;
+
+    uut.lockShared();
+    EXPECT_TRUE(uut.tryLockShared());
+    EXPECT_FALSE(uut.tryLockExclusive());
+    uut.unlockShared();
+    uut.unlockShared();
+
+    uut.lockExclusive();
+    EXPECT_FALSE(uut.tryLockShared());
+    EXPECT_FALSE(uut.tryLockExclusive());
+    uut.unlockExclusive();
+
+    EXPECT_TRUE(uut.tryLockExclusive());
+    uut.unlock(Latch::Mode::EXCLUSIVE);
+
+    // Mode::NONE takes nothing
+    uut.lock(Latch::Mode::NONE);
+    EXPECT_TRUE(uut.tryLockExclusive());
+    uut.unlock(Latch::Mode::EXCLUSIVE);
+}
+
+TEST(LatchTest, Concurrent)
+{
+    static const int THREAD_COUNT = 8;
+    static const int ROUND = 10000;
+
+    Latch uut;
+    int a = 0;
+    int b = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([&, t]()
+            {
+                for (int i = 0; i < ROUND; ++i) {
+                    if ((i + t) % 2) {
+                        uut.lock(Latch::Mode::SHARED);
+                        EXPECT_EQ(a, b);
+                        uut.unlock(Latch::Mode::SHARED);
+                    }
+                    else {
+                        uut.lock(Latch::Mode::EXCLUSIVE);
+                        ++a;
+                        ++b;
+                        uut.unlock(Latch::Mode::EXCLUSIVE);
+                    }
+                }
+            });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(THREAD_COUNT * ROUND / 2, a);
+}